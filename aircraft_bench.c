@@ -0,0 +1,270 @@
+//
+// Copyright 2015, Oliver Jowett <oliver@mutability.co.uk>
+//
+
+// This file is free software: you may copy, redistribute and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 2 of the License, or (at your
+// option) any later version.
+//
+// This file is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Measure uat2json's aircraft table with many synthetic aircraft:
+// adding them, looking them up in random order (as each message
+// does), and replacing half of them (as expiry and new traffic do),
+// against a linear search of a list as uat2json used to do. The
+// table's contents are checked afterwards.
+// See "make bench-aircraft".
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include "aircraft_table.h"
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint32_t rng_state = 12345;
+
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+// A random 25-bit address not already in the table: about half are
+// ICAO addresses, the rest TIS-B track file and other addresses
+static uint32_t new_address(struct aircraft_table *t)
+{
+    uint32_t address;
+
+    do {
+        address = rng() & (NON_ICAO_ADDRESS | 0xFFFFFF);
+    } while (aircraft_table_find(t, address));
+
+    return address;
+}
+
+// The old way: a singly linked list, searched from the head
+struct list_entry {
+    struct list_entry *next;
+    uint32_t address;
+    char payload[sizeof(struct aircraft) - sizeof(void *) - sizeof(uint32_t)];
+};
+
+static struct list_entry *list_find(struct list_entry *head, uint32_t address)
+{
+    for (; head; head = head->next)
+        if (head->address == address)
+            return head;
+    return NULL;
+}
+
+static void bench_list(const uint32_t *addresses, int count, int lookups)
+{
+    struct list_entry *entries = calloc(count, sizeof(*entries));
+    struct list_entry *head = NULL;
+    uint32_t checksum = 0;
+    double start, elapsed;
+    int i;
+
+    if (!entries) {
+        perror("calloc");
+        exit(1);
+    }
+
+    for (i = 0; i < count; ++i) {
+        entries[i].address = addresses[i];
+        entries[i].next = head;
+        head = &entries[i];
+    }
+
+    start = now();
+    for (i = 0; i < lookups; ++i)
+        checksum += list_find(head, addresses[rng() % count])->address;
+    elapsed = now() - start;
+
+    printf("  %-14s %9.1f ns/lookup (checksum %08x)\n",
+           "list lookup", elapsed * 1e9 / lookups, checksum);
+    free(entries);
+}
+
+// Returns 0 if the table doesn't hold exactly the 'count' addresses given
+static int check_table(struct aircraft_table *t, const uint32_t *addresses, int count)
+{
+    struct aircraft *a, *prev = NULL;
+    unsigned listed = 0;
+    int i;
+
+    if (aircraft_table_count(t) != (unsigned) count) {
+        fprintf(stderr, "count is %u, expected %d\n", aircraft_table_count(t), count);
+        return 0;
+    }
+
+    for (a = aircraft_table_first(t); a; a = a->next) {
+        if (a->prev != prev) {
+            fprintf(stderr, "list is inconsistent at %06X\n", a->address);
+            return 0;
+        }
+        prev = a;
+        ++listed;
+    }
+
+    if (listed != (unsigned) count) {
+        fprintf(stderr, "%u aircraft listed, expected %d\n", listed, count);
+        return 0;
+    }
+
+    for (i = 0; i < count; ++i) {
+        a = aircraft_table_find(t, addresses[i]);
+        if (!a || a->address != addresses[i]) {
+            fprintf(stderr, "%06X not found\n", addresses[i]);
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static int bench(int count, int lookups)
+{
+    struct aircraft_table *t = aircraft_table_new();
+    uint32_t *addresses = malloc(count * sizeof(*addresses));
+    int *missing = malloc(count * sizeof(*missing));
+    struct aircraft *a, *next;
+    uint32_t checksum = 0;
+    double start, elapsed;
+    int i, n, removed, ok;
+
+    if (!t || !addresses || !missing) {
+        perror("malloc");
+        exit(1);
+    }
+
+    printf("%d aircraft:\n", count);
+
+    start = now();
+    for (i = 0; i < count; ++i) {
+        addresses[i] = new_address(t);
+        if (!aircraft_table_add(t, addresses[i])) {
+            perror("aircraft_table_add");
+            exit(1);
+        }
+    }
+    elapsed = now() - start;
+    printf("  %-14s %9.1f ns/aircraft\n", "add", elapsed * 1e9 / count);
+
+    start = now();
+    for (i = 0; i < lookups; ++i)
+        checksum += ++aircraft_table_find(t, addresses[rng() % count])->messages;
+    elapsed = now() - start;
+    printf("  %-14s %9.1f ns/lookup (checksum %08x)\n",
+           "lookup", elapsed * 1e9 / lookups, checksum);
+
+    // expire every other aircraft, then add as many new ones
+    start = now();
+    removed = 0;
+    for (a = aircraft_table_first(t), i = 0; a; a = next, ++i) {
+        next = a->next;
+        if (i & 1) {
+            aircraft_table_remove(t, a);
+            ++removed;
+        }
+    }
+    // (find them all first, as a new address may be one just removed)
+    for (i = 0, n = 0; i < count; ++i) {
+        if (!aircraft_table_find(t, addresses[i]))
+            missing[n++] = i;
+    }
+    for (i = 0; i < n; ++i) {
+        addresses[missing[i]] = new_address(t);
+        if (!aircraft_table_add(t, addresses[missing[i]])) {
+            perror("aircraft_table_add");
+            exit(1);
+        }
+    }
+    elapsed = now() - start;
+    printf("  %-14s %9.1f ns/aircraft\n", "replace half", elapsed * 1e9 / removed);
+
+    ok = check_table(t, addresses, count);
+
+    // keep the list baseline to a second or so
+    bench_list(addresses, count, lookups < 200000000 / count ? lookups : 200000000 / count + 1);
+
+    aircraft_table_free(t);
+    free(addresses);
+    free(missing);
+    return ok;
+}
+
+static void usage(int argc, char **argv)
+{
+    fprintf(stderr,
+            "usage: %s [-a <aircraft>] [-l <lookups>]\n"
+            "\n"
+            "Times uat2json's aircraft table with synthetic aircraft, against\n"
+            "searching a list.\n"
+            "\n"
+            "  -a <aircraft>  Number of aircraft (default: 100, 1000, 10000 and 50000)\n"
+            "  -l <lookups>   Number of lookups to time (default 10000000)\n"
+            "  -h             Show this usage message\n",
+            argv[0]);
+}
+
+int main(int argc, char **argv)
+{
+    static const int default_counts[] = { 100, 1000, 10000, 50000, 0 };
+    int counts[2] = { 0, 0 };
+    const int *count;
+    int lookups = 10000000;
+    int opt, ok = 1;
+
+    while ((opt = getopt(argc, argv, "ha:l:")) > 0) {
+        switch (opt) {
+        case 'h':
+            usage(argc, argv);
+            return 0;
+
+        case 'a':
+            counts[0] = atoi(optarg);
+            break;
+
+        case 'l':
+            lookups = atoi(optarg);
+            break;
+
+        default:
+            usage(argc, argv);
+            return 1;
+        }
+    }
+
+    if (optind < argc || lookups <= 0 || counts[0] < 0) {
+        usage(argc, argv);
+        return 1;
+    }
+
+    for (count = counts[0] ? counts : default_counts; *count; ++count) {
+        if (!bench(*count, lookups))
+            ok = 0;
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,214 @@
+//
+// Copyright 2015, Oliver Jowett <oliver@mutability.co.uk>
+//
+
+// This file is free software: you may copy, redistribute and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 2 of the License, or (at your
+// option) any later version.
+//
+// This file is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "aircraft_table.h"
+
+#define INITIAL_SLOTS 256
+#define SLAB_RECORDS 256
+
+// A hash slot holds the address too, so probing doesn't touch the records
+struct slot {
+    uint32_t address;
+    struct aircraft *aircraft;  // NULL if empty
+};
+
+struct slab {
+    struct slab *next;
+    struct aircraft records[SLAB_RECORDS];
+};
+
+struct aircraft_table {
+    struct slot *slots;     // linear probing, kept at most half full
+    unsigned mask;
+    unsigned count;
+
+    struct aircraft *head;  // most recently added
+
+    struct slab *slabs;
+    struct aircraft *free_records;  // chained through 'prev'
+};
+
+struct aircraft_table *aircraft_table_new(void)
+{
+    struct aircraft_table *t = calloc(1, sizeof(*t));
+    if (!t)
+        return NULL;
+
+    t->slots = calloc(INITIAL_SLOTS, sizeof(struct slot));
+    if (!t->slots) {
+        free(t);
+        return NULL;
+    }
+
+    t->mask = INITIAL_SLOTS - 1;
+    return t;
+}
+
+void aircraft_table_free(struct aircraft_table *t)
+{
+    struct slab *s, *next;
+
+    if (!t)
+        return;
+
+    for (s = t->slabs; s; s = next) {
+        next = s->next;
+        free(s);
+    }
+    free(t->slots);
+    free(t);
+}
+
+static inline unsigned home_slot(const struct aircraft_table *t, uint32_t address)
+{
+    uint32_t h = address * 0x9e3779b1U;
+    return (h ^ h >> 16) & t->mask;
+}
+
+struct aircraft *aircraft_table_find(struct aircraft_table *t, uint32_t address)
+{
+    unsigned i;
+
+    for (i = home_slot(t, address); t->slots[i].aircraft; i = (i + 1) & t->mask) {
+        if (t->slots[i].address == address)
+            return t->slots[i].aircraft;
+    }
+
+    return NULL;
+}
+
+static int grow(struct aircraft_table *t)
+{
+    unsigned old_size = t->mask + 1;
+    struct slot *old = t->slots;
+    unsigned i, j;
+
+    t->slots = calloc(old_size * 2, sizeof(struct slot));
+    if (!t->slots) {
+        t->slots = old;
+        return 0;
+    }
+
+    t->mask = old_size * 2 - 1;
+    for (i = 0; i < old_size; ++i) {
+        if (!old[i].aircraft)
+            continue;
+        for (j = home_slot(t, old[i].address); t->slots[j].aircraft; j = (j + 1) & t->mask)
+            ;
+        t->slots[j] = old[i];
+    }
+
+    free(old);
+    return 1;
+}
+
+static struct aircraft *new_record(struct aircraft_table *t)
+{
+    struct aircraft *a;
+
+    if (!t->free_records) {
+        struct slab *s = malloc(sizeof(*s));
+        unsigned i;
+
+        if (!s)
+            return NULL;
+
+        s->next = t->slabs;
+        t->slabs = s;
+        for (i = 0; i < SLAB_RECORDS; ++i) {
+            s->records[i].prev = t->free_records;
+            t->free_records = &s->records[i];
+        }
+    }
+
+    a = t->free_records;
+    t->free_records = a->prev;
+    memset(a, 0, sizeof(*a));
+    return a;
+}
+
+struct aircraft *aircraft_table_add(struct aircraft_table *t, uint32_t address)
+{
+    struct aircraft *a;
+    unsigned i;
+
+    if ((t->count + 1) * 2 > t->mask + 1 && !grow(t))
+        return NULL;
+
+    if (!(a = new_record(t)))
+        return NULL;
+
+    a->address = address;
+    a->next = t->head;
+    if (t->head)
+        t->head->prev = a;
+    t->head = a;
+
+    for (i = home_slot(t, address); t->slots[i].aircraft; i = (i + 1) & t->mask)
+        ;
+    t->slots[i].address = address;
+    t->slots[i].aircraft = a;
+    ++t->count;
+
+    return a;
+}
+
+void aircraft_table_remove(struct aircraft_table *t, struct aircraft *a)
+{
+    unsigned i, j, home;
+
+    for (i = home_slot(t, a->address); t->slots[i].aircraft != a; i = (i + 1) & t->mask)
+        ;
+
+    // close the gap by moving back any later entry of the same run
+    // that may not sit between its home slot and the gap
+    t->slots[i].aircraft = NULL;
+    for (j = (i + 1) & t->mask; t->slots[j].aircraft; j = (j + 1) & t->mask) {
+        home = home_slot(t, t->slots[j].address);
+        if (((j - home) & t->mask) >= ((j - i) & t->mask)) {
+            t->slots[i] = t->slots[j];
+            t->slots[j].aircraft = NULL;
+            i = j;
+        }
+    }
+    --t->count;
+
+    if (a->prev)
+        a->prev->next = a->next;
+    else
+        t->head = a->next;
+    if (a->next)
+        a->next->prev = a->prev;
+
+    // 'next' is left alone for callers that are iterating; the record
+    // goes on the free list through 'prev' until it is reused
+    a->prev = t->free_records;
+    t->free_records = a;
+}
+
+struct aircraft *aircraft_table_first(const struct aircraft_table *t)
+{
+    return t->head;
+}
+
+unsigned aircraft_table_count(const struct aircraft_table *t)
+{
+    return t->count;
+}
@@ -0,0 +1,97 @@
+//
+// Copyright 2015, Oliver Jowett <oliver@mutability.co.uk>
+//
+
+// This file is free software: you may copy, redistribute and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 2 of the License, or (at your
+// option) any later version.
+//
+// This file is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef DUMP978_AIRCRAFT_TABLE_H
+#define DUMP978_AIRCRAFT_TABLE_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include "uat_decode.h"
+
+// The aircraft tracked by uat2json, indexed by address.
+//
+// Records are found through an open-addressing hash table keyed by
+// the 25-bit address (the 24-bit address, plus NON_ICAO_ADDRESS for
+// addresses that aren't ICAO addresses), and are also kept on a list,
+// most recently added first, which is the order they are written out
+// in. Records are carved from slabs and reused once removed, so a
+// steady stream of new and expiring aircraft doesn't touch malloc.
+
+#define NON_ICAO_ADDRESS 0x1000000U
+
+struct aircraft {
+    struct aircraft *next;  // list neighbours, most recently added first
+    struct aircraft *prev;
+    uint32_t address;
+
+    uint32_t messages;
+    time_t last_seen;
+    time_t last_seen_pos;
+
+    int position_valid : 1;
+    int altitude_valid : 1;
+    int track_valid : 1;
+    int speed_valid : 1;
+    int vert_rate_valid : 1;
+
+    airground_state_t airground_state;
+    char callsign[9];
+    char squawk[9];
+
+    // if position_valid:
+    double lat;
+    double lon;
+
+    // if altitude_valid:
+    int32_t altitude; // in feet
+    
+    // if track_valid:
+    uint16_t track;
+
+    // if speed_valid:
+    uint16_t speed; // in kts
+
+    // if vert_rate_valid:
+    int16_t vert_rate; // in ft/min
+};        
+
+struct aircraft_table;
+
+// Returns NULL if out of memory.
+struct aircraft_table *aircraft_table_new(void);
+void aircraft_table_free(struct aircraft_table *t);
+
+// Returns the aircraft with this address, or NULL if there is none.
+struct aircraft *aircraft_table_find(struct aircraft_table *t, uint32_t address);
+
+// Add a zeroed record for an address that isn't in the table yet, at
+// the head of the list. Returns NULL if out of memory.
+struct aircraft *aircraft_table_add(struct aircraft_table *t, uint32_t address);
+
+// Remove an aircraft, making its record available for reuse. The
+// record's 'next' pointer stays valid, so this may be called on the
+// current aircraft while iterating.
+void aircraft_table_remove(struct aircraft_table *t, struct aircraft *a);
+
+// The most recently added aircraft (follow 'next' for the rest), or
+// NULL if the table is empty.
+struct aircraft *aircraft_table_first(const struct aircraft_table *t);
+
+unsigned aircraft_table_count(const struct aircraft_table *t);
+
+#endif
@@ -0,0 +1,101 @@
+#!/bin/bash
+#
+# Demodulator regression check: run dump978 over each case in
+# 'cases', compare its output with <case>.expected, then time it
+# over all the cases and compare with the stored throughput baseline.
+#
+# usage: check-demod.sh [--update-expected | --record-baseline]
+#
+# Environment:
+#   THRESHOLD  allowed throughput drop below the baseline, in percent (default 10)
+#   REPEAT     how many copies of the cases to time (default 100)
+
+cd "$(dirname "$0")" || exit 1
+
+DUMP978=../dump978
+UAT2IQ=../uat2iq
+# load shedding and the adaptive IQ correction both depend on timing,
+# so turn them off to get the same output every run
+DEMOD_OPTS="-D -o 0"
+THRESHOLD=${THRESHOLD:-10}
+REPEAT=${REPEAT:-100}
+BASELINE=throughput.baseline
+WORK=work
+
+mode=check
+case "${1:-}" in
+    "") ;;
+    --update-expected) mode=update ;;
+    --record-baseline) mode=baseline ;;
+    *) echo "usage: $0 [--update-expected | --record-baseline]" >&2; exit 2 ;;
+esac
+
+mkdir -p $WORK || exit 1
+rm -f $WORK/all.iq
+failed=0
+
+while read -r name opts; do
+    case "$name" in
+        ""|"#"*) continue ;;
+    esac
+
+    $UAT2IQ $opts <frames.txt >$WORK/$name.iq || exit 1
+    $DUMP978 $DEMOD_OPTS <$WORK/$name.iq >$WORK/$name.out || exit 1
+    cat $WORK/$name.iq >>$WORK/all.iq
+
+    if [ $mode = update ]; then
+        cp $WORK/$name.out $name.expected
+        echo "$name: $(wc -l <$name.expected) frames (updated)"
+    elif cmp -s $name.expected $WORK/$name.out; then
+        echo "$name: $(wc -l <$WORK/$name.out) frames, OK"
+    else
+        echo "$name: FAILED, output differs from $name.expected:"
+        diff $name.expected $WORK/$name.out | head -20
+        failed=1
+    fi
+done <cases
+
+[ $mode = update ] && exit 0
+
+# Time the demodulator over REPEAT copies of all the cases. CPU time
+# (user + system, all threads) is much less affected by other load on
+# the machine than elapsed time; take the best of five runs anyway.
+rm -f $WORK/bench.iq
+i=0
+while [ $i -lt $REPEAT ]; do
+    cat $WORK/all.iq >>$WORK/bench.iq
+    i=$((i + 1))
+done
+samples=$(($(wc -c <$WORK/bench.iq) / 2))
+
+TIMEFORMAT="%3U %3S"
+best=
+for run in 1 2 3 4 5; do
+    cpu=$( { time $DUMP978 $DEMOD_OPTS <$WORK/bench.iq >/dev/null; } 2>&1 ) || exit 1
+    # "1.234 0.056" seconds -> microseconds
+    us=$(echo $cpu | awk '{ printf "%d", ($1 + $2) * 1000000 }')
+    if [ -z "$best" ] || [ $us -lt $best ]; then
+        best=$us
+    fi
+done
+rm -f $WORK/bench.iq
+
+# samples per CPU second, in thousands
+rate=$((samples * 1000 / best))
+echo "throughput: $rate ksamples/s ($samples samples in $((best / 1000)) ms of CPU time)"
+
+if [ $mode = baseline ] || [ ! -f $BASELINE ]; then
+    echo $rate >$BASELINE
+    echo "recorded as the throughput baseline in corpus/$BASELINE"
+else
+    baseline=$(cat $BASELINE)
+    floor=$((baseline * (100 - THRESHOLD) / 100))
+    if [ $rate -lt $floor ]; then
+        echo "FAILED: throughput is more than $THRESHOLD% below the baseline of $baseline ksamples/s"
+        failed=1
+    else
+        echo "baseline: $baseline ksamples/s, OK"
+    fi
+fi
+
+exit $failed
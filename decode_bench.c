@@ -0,0 +1,287 @@
+//
+// Copyright 2015, Oliver Jowett <oliver@mutability.co.uk>
+//
+
+// This file is free software: you may copy, redistribute and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 2 of the License, or (at your
+// option) any later version.
+//
+// This file is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Measure ADS-B decoding speed: read downlink frames from stdin, then
+// decode them repeatedly, in full, with various field masks, into
+// columns, and in full followed by formatting as text or JSON.
+// See "make bench-decode".
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include "uat.h"
+#include "uat_decode.h"
+#include "reader.h"
+
+struct frames {
+    uint8_t (*data)[LONG_FRAME_DATA_BYTES];
+    int count;
+    int size;
+};
+
+static const struct {
+    const char *name;
+    unsigned fields;
+} masks[] = {
+    { "hdr", UAT_DECODE_HDR },
+    { "position", UAT_DECODE_SV_POSITION },
+    { "velocity", UAT_DECODE_SV_VELOCITY },
+    { "sv", UAT_DECODE_SV_POSITION | UAT_DECODE_SV_VELOCITY },
+    { "ms", UAT_DECODE_MS },
+    { "all", UAT_DECODE_ALL },
+    { "sv-fixed", UAT_DECODE_SV_POSITION | UAT_DECODE_SV_VELOCITY | UAT_DECODE_FIXED },
+    { "all-fixed", UAT_DECODE_ALL | UAT_DECODE_FIXED },
+    { NULL, 0 }
+};
+
+static void handle_frame(frame_type_t type, uint8_t *frame, int len, void *extra)
+{
+    struct frames *f = extra;
+
+    if (type != UAT_DOWNLINK)
+        return;
+
+    if (f->count == f->size) {
+        f->size = f->size ? f->size * 2 : 1024;
+        f->data = realloc(f->data, f->size * sizeof(*f->data));
+        if (!f->data) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+
+    memset(f->data[f->count], 0, sizeof(f->data[f->count]));
+    memcpy(f->data[f->count], frame, len);
+    ++f->count;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Decode every frame 'passes' times, and report the time per frame.
+// 'fields' < 0 means uat_decode_adsb_mdb() itself.
+static void bench(const struct frames *f, int passes, const char *name, int fields)
+{
+    struct uat_adsb_mdb mdb;
+    uint32_t checksum = 0;
+    double start, elapsed;
+    int pass, i;
+
+    start = now();
+    for (pass = 0; pass < passes; ++pass) {
+        for (i = 0; i < f->count; ++i) {
+            if (fields < 0)
+                uat_decode_adsb_mdb(f->data[i], &mdb);
+            else
+                uat_decode_adsb_mdb_fields(f->data[i], &mdb, fields);
+
+            // depend on the results so none of the decoding is optimized away
+            checksum += mdb.address + mdb.lat_e7 + mdb.altitude + mdb.track + mdb.speed + mdb.callsign[0] + mdb.sec_altitude;
+        }
+    }
+    elapsed = now() - start;
+
+    printf("%-16s %7.1f ns/frame (checksum %08x)\n",
+           name, elapsed * 1e9 / ((double) passes * f->count), checksum);
+}
+
+// As bench(), but decoding all the frames at once into columns
+static void bench_columns(const struct frames *f, int passes)
+{
+    struct uat_adsb_columns *cols = uat_adsb_columns_new(f->count);
+    uint32_t checksum = 0;
+    double start, elapsed;
+    int pass, i;
+
+    if (!cols) {
+        perror("uat_adsb_columns_new");
+        exit(1);
+    }
+
+    start = now();
+    for (pass = 0; pass < passes; ++pass) {
+        cols->count = 0;
+        uat_decode_adsb_columns(f->data[0], sizeof(f->data[0]), f->count, cols);
+        for (i = 0; i < f->count; ++i)
+            checksum += cols->address[i] + cols->lat_e7[i] + cols->altitude[i] + cols->track[i] +
+                cols->speed[i] + cols->callsign[i][0] + cols->sec_altitude[i];
+    }
+    elapsed = now() - start;
+
+    printf("%-16s %7.1f ns/frame (checksum %08x)\n",
+           "columns", elapsed * 1e9 / ((double) passes * f->count), checksum);
+    uat_adsb_columns_free(cols);
+}
+
+// As bench(), but also formatting each message as text into a reused
+// buffer (as uat2text does)
+static void bench_text(const struct frames *f, int passes)
+{
+    struct uat_text text = UAT_TEXT_INIT;
+    struct uat_adsb_mdb mdb;
+    uint32_t checksum = 0;
+    double start, elapsed;
+    int pass, i;
+
+    start = now();
+    for (pass = 0; pass < passes; ++pass) {
+        for (i = 0; i < f->count; ++i) {
+            uat_decode_adsb_mdb(f->data[i], &mdb);
+            text.len = 0;
+            if (!uat_format_adsb_mdb(&mdb, &text)) {
+                perror("uat_format_adsb_mdb");
+                exit(1);
+            }
+            checksum += text.len;
+        }
+    }
+    elapsed = now() - start;
+
+    printf("%-16s %7.1f ns/frame (checksum %08x)\n",
+           "text", elapsed * 1e9 / ((double) passes * f->count), checksum);
+    uat_text_free(&text);
+}
+
+// As bench_text(), but formatting each message as a line of JSON
+static void bench_json(const struct frames *f, int passes)
+{
+    struct uat_text text = UAT_TEXT_INIT;
+    struct uat_adsb_mdb mdb;
+    uint32_t checksum = 0;
+    double start, elapsed;
+    int pass, i;
+
+    start = now();
+    for (pass = 0; pass < passes; ++pass) {
+        for (i = 0; i < f->count; ++i) {
+            uat_decode_adsb_mdb(f->data[i], &mdb);
+            text.len = 0;
+            if (!uat_format_adsb_json(&mdb, &text)) {
+                perror("uat_format_adsb_json");
+                exit(1);
+            }
+            checksum += text.len;
+        }
+    }
+    elapsed = now() - start;
+
+    printf("%-16s %7.1f ns/frame (checksum %08x)\n",
+           "json", elapsed * 1e9 / ((double) passes * f->count), checksum);
+    uat_text_free(&text);
+}
+
+static void usage(int argc, char **argv)
+{
+    fprintf(stderr,
+            "usage: %s [-n <passes>] [-f <fields>]\n"
+            "\n"
+            "Reads UAT messages from stdin, then times decoding the downlink\n"
+            "messages among them in full and with each field mask.\n"
+            "\n"
+            "  -n <passes>  Number of times to decode each message (default 2000)\n"
+            "  -f <fields>  Time only this mask: hdr, position, velocity, sv,\n"
+            "               ms, all, sv-fixed, all-fixed, columns, text or json\n"
+            "  -h           Show this usage message\n",
+            argv[0]);
+}
+
+int main(int argc, char **argv)
+{
+    struct dump978_reader *reader;
+    struct frames frames = { NULL, 0, 0 };
+    const char *only = NULL;
+    int passes = 2000;
+    int framecount;
+    int i, opt;
+
+    while ((opt = getopt(argc, argv, "hn:f:")) > 0) {
+        switch (opt) {
+        case 'h':
+            usage(argc, argv);
+            return 0;
+
+        case 'n':
+            passes = atoi(optarg);
+            break;
+
+        case 'f':
+            only = optarg;
+            break;
+
+        default:
+            usage(argc, argv);
+            return 1;
+        }
+    }
+
+    if (optind < argc || passes <= 0) {
+        usage(argc, argv);
+        return 1;
+    }
+
+    reader = dump978_reader_new(0, 0);
+    if (!reader) {
+        perror("dump978_reader_new");
+        return 1;
+    }
+
+    while ((framecount = dump978_read_frames(reader, handle_frame, &frames)) > 0)
+        ;
+
+    if (framecount < 0) {
+        perror("dump978_read_frames");
+        return 1;
+    }
+
+    dump978_reader_free(reader);
+
+    if (frames.count == 0) {
+        fprintf(stderr, "%s: no downlink messages on stdin\n", argv[0]);
+        return 1;
+    }
+
+    printf("%d downlink messages, %d passes\n", frames.count, passes);
+
+    if (!only)
+        bench(&frames, passes, "full decode", -1);
+
+    for (i = 0; masks[i].name; ++i) {
+        if (!only || !strcmp(only, masks[i].name))
+            bench(&frames, passes, masks[i].name, masks[i].fields);
+    }
+
+    if (!only || !strcmp(only, "columns"))
+        bench_columns(&frames, passes);
+
+    if (!only || !strcmp(only, "text"))
+        bench_text(&frames, passes);
+
+    if (!only || !strcmp(only, "json"))
+        bench_json(&frames, passes);
+
+    free(frames.data);
+    return 0;
+}
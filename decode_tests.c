@@ -0,0 +1,663 @@
+//
+// Copyright 2015, Oliver Jowett <oliver@mutability.co.uk>
+//
+
+// This file is free software: you may copy, redistribute and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 2 of the License, or (at your
+// option) any later version.
+//
+// This file is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Check that the fixed-point ADS-B decoding (UAT_DECODE_FIXED) agrees
+// with the floating-point decoding: on every downlink message read
+// from stdin (see "make test"), and on every possible position and
+// velocity. Also check that columnar decoding agrees with both, that
+// positions are formatted as printf would, that uplink text with tabs
+// expanded fits the room reserved for it, the DLAC text decoder
+// against a simple reference version, and that the reader drops frames
+// of the wrong length.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "uat.h"
+#include "uat_decode.h"
+#include "reader.h"
+
+#define MAX_FRAMES 100000
+
+struct results {
+    int frames;
+    int failures;
+
+    // the messages, for the columnar decoding check
+    uint8_t (*saved)[LONG_FRAME_DATA_BYTES];
+};
+
+// Compare the two decodings of one frame; report and return 0 on a mismatch
+static int compare_decodes(uint8_t *frame, const char *what)
+{
+    struct uat_adsb_mdb flt, fix;
+    double lat_e7, lon_e7;
+
+    uat_decode_adsb_mdb(frame, &flt);
+    uat_decode_adsb_mdb_fields(frame, &fix, UAT_DECODE_ALL | UAT_DECODE_FIXED);
+
+    // rounding to the nearest 1e-7 degree is within half a unit
+    lat_e7 = flt.lat * 1e7;
+    lon_e7 = flt.lon * 1e7;
+    if (flt.position_valid != fix.position_valid ||
+        (flt.position_valid && (fabs(fix.lat_e7 - lat_e7) > 0.5 + 1e-6 || fabs(fix.lon_e7 - lon_e7) > 0.5 + 1e-6))) {
+        fprintf(stderr, "\n  %s: position %.7f,%.7f decoded as %d,%d (1e-7 deg)\n",
+                what, flt.lat, flt.lon, fix.lat_e7, fix.lon_e7);
+        return 0;
+    }
+
+    if (flt.track_type != fix.track_type || flt.track != fix.track ||
+        flt.speed_valid != fix.speed_valid || flt.speed != fix.speed) {
+        fprintf(stderr, "\n  %s: velocity N%d E%d: track %u speed %u, fixed-point track %u speed %u\n",
+                what, flt.ns_vel, flt.ew_vel, flt.track, flt.speed, fix.track, fix.speed);
+        return 0;
+    }
+
+    // everything else is decoded the same way
+    flt.lat = flt.lon = 0;
+    fix.lat_e7 = fix.lon_e7 = 0;
+    if (memcmp(&flt, &fix, sizeof(flt))) {
+        fprintf(stderr, "\n  %s: other fields differ\n", what);
+        return 0;
+    }
+
+    return 1;
+}
+
+static void handle_frame(frame_type_t type, uint8_t *frame, int len, void *extra)
+{
+    struct results *r = extra;
+    uint8_t padded[LONG_FRAME_DATA_BYTES] = { 0 };
+
+    if (type != UAT_DOWNLINK)
+        return;
+
+    memcpy(padded, frame, len);
+    if (r->frames < MAX_FRAMES)
+        memcpy(r->saved[r->frames], padded, sizeof(padded));
+    ++r->frames;
+    if (!compare_decodes(padded, "sample message"))
+        ++r->failures;
+}
+
+// Decode 'count' frames into columns, in uneven batches, and compare
+// each row with uat_decode_adsb_mdb_fields()
+static int check_columns(uint8_t (*frames)[LONG_FRAME_DATA_BYTES], int count)
+{
+    struct uat_adsb_columns *cols = uat_adsb_columns_new(count);
+    int i, done, failures = 0;
+
+    if (!cols) {
+        fprintf(stderr, "out of memory\n");
+        return 0;
+    }
+
+    for (done = 0; done < count; ) {
+        int batch = (done % 7) * 13 + 1;
+        done += uat_decode_adsb_columns(frames[done], LONG_FRAME_DATA_BYTES, batch, cols);
+    }
+
+    if (cols->count != count || uat_decode_adsb_columns(frames[0], LONG_FRAME_DATA_BYTES, 1, cols) != 0) {
+        fprintf(stderr, "\n  wrong row count %d, expected %d\n", cols->count, count);
+        uat_adsb_columns_free(cols);
+        return 0;
+    }
+
+    for (i = 0; i < count && failures < 10; ++i) {
+        struct uat_adsb_mdb mdb;
+        uint8_t flags;
+
+        uat_decode_adsb_mdb_fields(frames[i], &mdb, UAT_DECODE_ALL | UAT_DECODE_FIXED);
+        flags = (mdb.has_sv ? UAT_COLUMN_HAS_SV : 0) |
+            (mdb.has_ms ? UAT_COLUMN_HAS_MS : 0) |
+            (mdb.has_auxsv ? UAT_COLUMN_HAS_AUXSV : 0) |
+            (mdb.position_valid ? UAT_COLUMN_POSITION_VALID : 0) |
+            (mdb.ns_vel_valid ? UAT_COLUMN_NS_VEL_VALID : 0) |
+            (mdb.ew_vel_valid ? UAT_COLUMN_EW_VEL_VALID : 0) |
+            (mdb.speed_valid ? UAT_COLUMN_SPEED_VALID : 0);
+
+        if (cols->mdb_type[i] != mdb.mdb_type ||
+            cols->address_qualifier[i] != mdb.address_qualifier ||
+            cols->address[i] != mdb.address ||
+            cols->flags[i] != flags ||
+            cols->lat_e7[i] != mdb.lat_e7 ||
+            cols->lon_e7[i] != mdb.lon_e7 ||
+            cols->nic[i] != mdb.nic ||
+            cols->altitude_type[i] != mdb.altitude_type ||
+            cols->altitude[i] != mdb.altitude ||
+            cols->airground_state[i] != mdb.airground_state ||
+            cols->ns_vel[i] != mdb.ns_vel ||
+            cols->ew_vel[i] != mdb.ew_vel ||
+            cols->track_type[i] != mdb.track_type ||
+            cols->track[i] != mdb.track ||
+            cols->speed[i] != mdb.speed ||
+            cols->vert_rate_source[i] != mdb.vert_rate_source ||
+            cols->vert_rate[i] != mdb.vert_rate ||
+            cols->emitter_category[i] != mdb.emitter_category ||
+            cols->callsign_type[i] != mdb.callsign_type ||
+            strcmp(cols->callsign[i], mdb.callsign) ||
+            cols->sec_altitude_type[i] != mdb.sec_altitude_type ||
+            cols->sec_altitude[i] != mdb.sec_altitude) {
+            fprintf(stderr, "\n  row %d (address %06X) differs\n", i, mdb.address);
+            ++failures;
+        }
+    }
+
+    uat_adsb_columns_free(cols);
+    return failures == 0;
+}
+
+// Every encodable latitude and longitude
+static int check_all_positions(void)
+{
+    uint8_t frame[SHORT_FRAME_DATA_BYTES] = { 0 };
+    uint32_t raw;
+    int failures = 0;
+
+    frame[11] = 0x01; // NIC 1, so every position is valid
+
+    for (raw = 0; raw < (1 << 24) && failures < 10; ++raw) {
+        // latitude is 23 bits, longitude 24
+        uint32_t raw_lat = raw & 0x7fffff;
+        frame[4] = raw_lat >> 15;
+        frame[5] = raw_lat >> 7;
+        frame[6] = (raw_lat << 1) | (raw >> 23);
+        frame[7] = raw >> 15;
+        frame[8] = raw >> 7;
+        frame[9] = raw << 1;
+
+        if (!compare_decodes(frame, "position sweep"))
+            ++failures;
+    }
+
+    return failures == 0;
+}
+
+// Format one position as text and as JSON, returning 0 if it isn't as
+// printf would have it
+static int check_one_position_text(uint32_t raw, struct uat_text *text)
+{
+    uint8_t frame[SHORT_FRAME_DATA_BYTES] = { 0 };
+    struct uat_adsb_mdb mdb;
+    uint32_t raw_lat = raw & 0x7fffff;
+    char expected[128];
+
+    frame[4] = raw_lat >> 15;
+    frame[5] = raw_lat >> 7;
+    frame[6] = (raw_lat << 1) | (raw >> 23);
+    frame[7] = raw >> 15;
+    frame[8] = raw >> 7;
+    frame[9] = raw << 1;
+    frame[11] = 0x01;
+
+    uat_decode_adsb_mdb_fields(frame, &mdb, UAT_DECODE_HDR | UAT_DECODE_SV_POSITION);
+    text->len = 0;
+    if (!uat_format_adsb_mdb(&mdb, text) || !uat_text_reserve(text, 1)) {
+        perror("uat_format_adsb_mdb");
+        return 0;
+    }
+    text->buf[text->len] = 0;
+
+    snprintf(expected, sizeof(expected),
+             " Latitude:          %+.4f\n"
+             " Longitude:         %+.4f\n",
+             mdb.lat, mdb.lon);
+    if (!strstr(text->buf, expected)) {
+        fprintf(stderr, "\n  position %.10f,%.10f formatted as:\n%s", mdb.lat, mdb.lon, text->buf);
+        return 0;
+    }
+
+    text->len = 0;
+    if (!uat_format_adsb_json(&mdb, text) || !uat_text_reserve(text, 1)) {
+        perror("uat_format_adsb_json");
+        return 0;
+    }
+    text->buf[text->len] = 0;
+
+    snprintf(expected, sizeof(expected), "\"lat\":%.6f,\"lon\":%.6f,", mdb.lat, mdb.lon);
+    if (!strstr(text->buf, expected)) {
+        fprintf(stderr, "\n  position %.10f,%.10f formatted as:\n%s\n", mdb.lat, mdb.lon, text->buf);
+        return 0;
+    }
+
+    return 1;
+}
+
+// Positions are formatted as printf would: a spread of them, and all
+// those that are exact or near rounding ties at 4 decimal places (where
+// the raw value is close to a multiple of 2^15) or, for JSON, at 6
+// (close to an odd multiple of 2^14)
+static int check_position_text(void)
+{
+    struct uat_text text = UAT_TEXT_INIT;
+    uint32_t raw;
+    int failures = 0;
+
+    for (raw = 0; raw < (1 << 24) && failures < 10; raw += 97) {
+        if (!check_one_position_text(raw, &text))
+            ++failures;
+    }
+
+    for (raw = 0; raw < (1 << 24) && failures < 10; raw += 1 << 14) {
+        uint32_t near;
+        for (near = (raw ? raw - 4 : 0); near <= raw + 4; ++near) {
+            if (!check_one_position_text(near, &text))
+                ++failures;
+        }
+    }
+
+    uat_text_free(&text);
+    return failures == 0;
+}
+
+// An uplink message full of DLAC text that expands: eight product 413
+// frames of repeated (tab, 63 spaces, report separator), each of which
+// prints a report of 63 spaces with its headings. The formatted text
+// must fit the room uat_format_uplink_mdb() reserved for it.
+static int check_dlac_report_text(void)
+{
+    static uint8_t frame[UPLINK_FRAME_DATA_BYTES];
+    static struct uat_uplink_mdb mdb;
+    static const uint8_t pattern[3] = { 28, 63, 29 }; // TAB, 63, RS
+    struct uat_text text = UAT_TEXT_INIT;
+    const char *p;
+    unsigned f, i, reports = 0;
+    int ok = 1;
+
+    memset(frame, 0, sizeof(frame));
+    frame[6] = 0x20; // app data valid
+    for (f = 0; f < 8; ++f) {
+        uint8_t *info = frame + 8 + f * 42;
+        uint8_t *text_data = info + 6;
+
+        info[0] = 40 >> 1; // length 40, type 0 (FIS-B)
+        info[1] = 0;
+        info[2] = 413 >> 6; // product 413, unsegmented, hours and minutes
+        info[3] = (413 & 0x3f) << 2;
+        // 36 bytes of text hold 48 characters, 4 per 3 bytes
+        for (i = 0; i < 48; i += 4) {
+            uint32_t v = (pattern[i % 3] << 18) | (pattern[(i + 1) % 3] << 12) |
+                (pattern[(i + 2) % 3] << 6) | pattern[(i + 3) % 3];
+            text_data[i / 4 * 3] = v >> 16;
+            text_data[i / 4 * 3 + 1] = v >> 8;
+            text_data[i / 4 * 3 + 2] = v;
+        }
+    }
+
+    uat_decode_uplink_mdb(frame, &mdb);
+    if (mdb.num_info_frames != 8) {
+        fprintf(stderr, "\n  %u info frames decoded, expected 8\n", mdb.num_info_frames);
+        return 0;
+    }
+
+    if (!uat_format_uplink_mdb(&mdb, &text)) {
+        perror("uat_format_uplink_mdb");
+        return 0;
+    }
+
+    for (p = text.buf; (p = memchr(p, 'T', text.buf + text.len - p)) != NULL; ++p) {
+        if (!strncmp(p, "Text:\n", 6))
+            ++reports;
+    }
+
+    if (text.len > text.size) {
+        fprintf(stderr, "\n  %zu bytes of text written to a %zu byte buffer\n", text.len, text.size);
+        ok = 0;
+    } else if (reports != 8 * 16) {
+        fprintf(stderr, "\n  %u reports formatted, expected %u\n", reports, 8 * 16);
+        ok = 0;
+    }
+
+    uat_text_free(&text);
+    return ok;
+}
+
+// Every airborne north/east velocity, subsonic and supersonic
+static int check_all_velocities(void)
+{
+    uint8_t frame[SHORT_FRAME_DATA_BYTES] = { 0 };
+    int ag, raw_ns, raw_ew;
+    int failures = 0;
+
+    for (ag = AG_SUBSONIC; ag <= AG_SUPERSONIC; ++ag) {
+        for (raw_ns = 0; raw_ns < 0x800; ++raw_ns) {
+            for (raw_ew = 0; raw_ew < 0x800 && failures < 10; ++raw_ew) {
+                frame[12] = (ag << 6) | (raw_ns >> 6);
+                frame[13] = ((raw_ns << 2) & 0xfc) | (raw_ew >> 9);
+                frame[14] = raw_ew >> 1;
+                frame[15] = raw_ew << 7;
+
+                if (!compare_decodes(frame, "velocity sweep"))
+                    ++failures;
+            }
+        }
+    }
+
+    return failures == 0;
+}
+
+// Reference DLAC decoder: one 6-bit character at a time
+static void reference_dlac(const uint8_t *data, unsigned bytelen, char *out)
+{
+    static const char *alphabet = "\x03" "ABCDEFGHIJKLMNOPQRSTUVWXYZ\x1A\t\x1E\n| !\"#$%&'()*+,-./0123456789:;<=>?";
+    unsigned bit;
+    int tab = 0;
+
+    for (bit = 0; bit + 6 <= bytelen * 8; bit += 6) {
+        unsigned ch = ((data[bit / 8] << 8 | (bit / 8 + 1 < bytelen ? data[bit / 8 + 1] : 0)) >> (10 - bit % 8)) & 0x3f;
+
+        if (tab) {
+            while (ch-- > 0)
+                *out++ = ' ';
+            tab = 0;
+        } else if (ch == 28) {
+            tab = 1;
+        } else {
+            *out++ = alphabet[ch];
+        }
+    }
+
+    *out = 0;
+}
+
+static int check_dlac(void)
+{
+    uint8_t data[424];
+    char expected[424 * 32], text[424 * 32];
+    uint32_t x = 54321;
+    int trial, failures = 0;
+
+    for (trial = 0; trial < 20000 && failures < 10; ++trial) {
+        unsigned len = trial % 425, i;
+        size_t n, outlen;
+
+        for (i = 0; i < len; ++i) {
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            // plenty of tabs (28 = 011100) in some trials
+            data[i] = (trial & 1) ? x : (0x71 ^ (x & 0x82));
+        }
+
+        reference_dlac(data, len, expected);
+        n = uat_decode_dlac(data, len, text, sizeof(text));
+        if (n != strlen(expected) || strcmp(text, expected)) {
+            fprintf(stderr, "\n  %u bytes: decoded text differs\n", len);
+            ++failures;
+            continue;
+        }
+
+        // a short buffer gets a prefix
+        outlen = x % (n + 2) + 1;
+        n = uat_decode_dlac(data, len, text, outlen);
+        if (n != strlen(text) || n > outlen - 1 || strncmp(text, expected, n) ||
+            (n < outlen - 1 && n != strlen(expected))) {
+            fprintf(stderr, "\n  %u bytes into %zu: truncated text differs\n", len, outlen);
+            ++failures;
+        }
+    }
+
+    return failures == 0;
+}
+
+// Write a frame of type 'type' and 'count' bytes to 'f'. Every byte is
+// 0x08, which makes a downlink frame MDB type 1, so that even a short
+// one is decoded as a long frame.
+static void write_frame_line(FILE *f, char type, int count)
+{
+    fputc(type, f);
+    while (count-- > 0)
+        fputs("08", f);
+    fputs(";\n", f);
+}
+
+// Lines the reader must accept or drop, and how many it should accept,
+// starting with a short frame after a line of junk that puts it at the
+// very end of the reader's buffer
+static FILE *frame_length_input(int *expected)
+{
+    FILE *f = tmpfile();
+    int i;
+
+    if (!f) {
+        perror("tmpfile");
+        return NULL;
+    }
+
+    *expected = 0;
+    for (i = 0; i < DUMP978_READER_BUFFER_SIZE - 7; ++i)
+        fputc('#', f);
+    fputc('\n', f);
+    write_frame_line(f, '+', 1);
+    write_frame_line(f, '-', SHORT_FRAME_DATA_BYTES), ++*expected;
+    write_frame_line(f, '-', LONG_FRAME_DATA_BYTES), ++*expected;
+    write_frame_line(f, '+', UPLINK_FRAME_DATA_BYTES), ++*expected;
+    write_frame_line(f, '-', SHORT_FRAME_DATA_BYTES - 1);
+    write_frame_line(f, '-', LONG_FRAME_DATA_BYTES + 1);
+    write_frame_line(f, '+', SHORT_FRAME_DATA_BYTES);
+    write_frame_line(f, '+', UPLINK_FRAME_DATA_BYTES - 1);
+    write_frame_line(f, '+', 0);
+
+    fflush(f);
+    rewind(f);
+    return f;
+}
+
+// Decode each frame (so that reading past one shows up under
+// AddressSanitizer), and count them
+static void decode_frame(frame_type_t type, uint8_t *frame, int len, int *count)
+{
+    if (type == UAT_DOWNLINK) {
+        struct uat_adsb_mdb mdb;
+        uat_decode_adsb_mdb(frame, &mdb);
+    } else {
+        struct uat_uplink_mdb mdb;
+        uat_decode_uplink_mdb(frame, &mdb);
+    }
+    ++*count;
+}
+
+static void count_frame(frame_type_t type, uint8_t *frame, int len, void *extra)
+{
+    decode_frame(type, frame, len, extra);
+}
+
+static void count_batch(const struct dump978_frame *frames, int count, void *extra)
+{
+    int i;
+    for (i = 0; i < count; ++i)
+        decode_frame(frames[i].type, frames[i].data, frames[i].len, extra);
+}
+
+// Replay 'f' in order, returning the number of frames read
+static int64_t replay_count(FILE *f, int *count)
+{
+    char path[64];
+
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", fileno(f));
+    *count = 0;
+    return dump978_replay_file(path, 1, DUMP978_REPLAY_ORDERED, count_batch, count);
+}
+
+// The reader and file replay pass on only frames of the right length
+// for their type, as the decoders read whole frames
+static int check_frame_lengths(void)
+{
+    struct dump978_reader *reader;
+    FILE *f;
+    int expected, count = 0, n;
+    int64_t replayed;
+
+    if (!(f = frame_length_input(&expected)))
+        return 0;
+
+    reader = dump978_reader_new(fileno(f), 0);
+    if (!reader) {
+        perror("dump978_reader_new");
+        fclose(f);
+        return 0;
+    }
+
+    while ((n = dump978_read_frames(reader, count_frame, &count)) > 0)
+        ;
+    dump978_reader_free(reader);
+
+    if (n < 0) {
+        perror("dump978_read_frames");
+        fclose(f);
+        return 0;
+    }
+
+    if (count != expected) {
+        fprintf(stderr, "%d frames read, expected %d\n", count, expected);
+        fclose(f);
+        return 0;
+    }
+
+    replayed = replay_count(f, &count);
+    fclose(f);
+    if (replayed != expected || count != expected) {
+        fprintf(stderr, "%d frames replayed, expected %d\n", count, expected);
+        return 0;
+    }
+
+    // a lone short frame, with nothing after it in the replay's buffer
+    if (!(f = tmpfile())) {
+        perror("tmpfile");
+        return 0;
+    }
+    write_frame_line(f, '-', SHORT_FRAME_DATA_BYTES);
+    fflush(f);
+    replayed = replay_count(f, &count);
+    fclose(f);
+    if (replayed != 1 || count != 1) {
+        fprintf(stderr, "%d frames replayed from a single line, expected 1\n", count);
+        return 0;
+    }
+
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    struct dump978_reader *reader;
+    struct results results = { 0, 0, NULL };
+    int framecount;
+    int all_ok = 1;
+
+    results.saved = malloc(MAX_FRAMES * sizeof(*results.saved));
+    if (!results.saved) {
+        perror("malloc");
+        return 1;
+    }
+
+    fprintf(stderr, "fixed-point decoding, messages on stdin: ");
+    reader = dump978_reader_new(0, 0);
+    if (!reader) {
+        perror("dump978_reader_new");
+        return 1;
+    }
+
+    while ((framecount = dump978_read_frames(reader, handle_frame, &results)) > 0)
+        ;
+    dump978_reader_free(reader);
+
+    if (framecount < 0) {
+        perror("dump978_read_frames");
+        all_ok = 0;
+    } else if (results.frames == 0) {
+        fprintf(stderr, "no downlink messages\n");
+        all_ok = 0;
+    } else if (results.failures > 0) {
+        fprintf(stderr, "  %d of %d messages differ\n", results.failures, results.frames);
+        all_ok = 0;
+    } else {
+        fprintf(stderr, "PASS (%d messages)\n", results.frames);
+    }
+
+    fprintf(stderr, "fixed-point decoding, all positions: ");
+    if (check_all_positions())
+        fprintf(stderr, "PASS\n");
+    else
+        all_ok = 0;
+
+    fprintf(stderr, "fixed-point decoding, all velocities: ");
+    if (check_all_velocities())
+        fprintf(stderr, "PASS\n");
+    else
+        all_ok = 0;
+
+    fprintf(stderr, "text and JSON formatting, positions: ");
+    if (check_position_text())
+        fprintf(stderr, "PASS\n");
+    else
+        all_ok = 0;
+
+    fprintf(stderr, "text formatting, expanded DLAC reports: ");
+    if (check_dlac_report_text())
+        fprintf(stderr, "PASS\n");
+    else
+        all_ok = 0;
+
+    fprintf(stderr, "columnar decoding, messages on stdin: ");
+    if (results.frames > MAX_FRAMES)
+        results.frames = MAX_FRAMES;
+    if (results.frames > 0 && check_columns(results.saved, results.frames))
+        fprintf(stderr, "PASS\n");
+    else
+        all_ok = 0;
+
+    // random messages cover every MDB type and air/ground state
+    fprintf(stderr, "columnar decoding, random messages: ");
+    {
+        uint32_t x = 12345;
+        int i, j;
+
+        for (i = 0; i < MAX_FRAMES; ++i) {
+            for (j = 0; j < LONG_FRAME_DATA_BYTES; ++j) {
+                x ^= x << 13;
+                x ^= x >> 17;
+                x ^= x << 5;
+                results.saved[i][j] = x;
+            }
+        }
+    }
+    if (check_columns(results.saved, MAX_FRAMES))
+        fprintf(stderr, "PASS\n");
+    else
+        all_ok = 0;
+
+    free(results.saved);
+
+    fprintf(stderr, "DLAC decoding, random text: ");
+    if (check_dlac())
+        fprintf(stderr, "PASS\n");
+    else
+        all_ok = 0;
+
+    fprintf(stderr, "reader and replay, frame lengths: ");
+    if (check_frame_lengths())
+        fprintf(stderr, "PASS\n");
+    else
+        all_ok = 0;
+
+    return all_ok ? 0 : 1;
+}
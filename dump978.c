@@ -19,209 +19,633 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <errno.h>
 #include <math.h>
 #include <unistd.h>
+#include <getopt.h>
+#include <time.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/stat.h>
 
 #include "uat.h"
 #include "fec.h"
+#include "sample_queue.h"
+#include "kernels.h"
+#include "iqcorrect.h"
+#include "shm_ring.h"
 
-static void make_atan2_table();
 static void read_from_stdin();
 static int check_sync_word(uint16_t *phi, uint64_t pattern, int16_t *center);
 static int process_buffer(uint16_t *phi, int len, uint64_t offset);
-static int demod_adsb_frame(uint16_t *phi, uint8_t *to, int *rs_errors);
-static int demod_uplink_frame(uint16_t *phi, uint8_t *to, int *rs_errors);
-static void demod_frame(uint16_t *phi, uint8_t *frame, int bytes, int16_t center_dphi);
+static int demod_adsb_frame(uint16_t *phi, uint8_t *to, int *rs_errors, int basic_only);
+static int demod_uplink_frame(uint16_t *phi, uint8_t *to, int *rs_errors, int *phase, int try_both);
 static void handle_adsb_frame(uint64_t timestamp, uint8_t *frame, int rs);
 static void handle_uplink_frame(uint64_t timestamp, uint8_t *frame, int rs);
+static void check_overload(uint64_t offset);
+static void display_stats(uint64_t offset);
+static void note_latency(uint64_t frame_end);
+static void note_correction(uint64_t timestamp);
+
+#define SAMPLE_RATE (2083334.0)
+
+// Load shedding. When processing falls behind the sample clock by
+// more than overload_threshold seconds, the first step in shed_order
+// is enabled; each further multiple of the threshold enables one
+// more step.
+
+typedef enum { SHED_UPLINK, SHED_PHASE } shed_step_t;
+
+static double overload_threshold = 1.0;
+static shed_step_t shed_order[2] = { SHED_UPLINK, SHED_PHASE };
+static int shed_steps = 2;
+static int shed_level = 0;
+
+// derived from shed_level by set_shed_level()
+static int shed_uplink = 0;
+static int shed_phase = 0;
+
+// Frame types to look for; sync words for disabled types
+// are never matched, so their frames are never demodulated.
+static int want_adsb = 1;
+static int want_uplink = 1;
+static uint64_t sync_words[2];
+static int n_sync_words;
+
+// In low latency mode, input is processed in small pieces
+#define LOW_LATENCY_QUANTUM (2048)
+static int low_latency = 0;
+
+// Input is read by a separate thread into a queue of this many
+// blocks, unless it is zero; -1 means about one second of samples.
+#define READER_BLOCK_SIZE (65536)
+static int queue_depth = -1;
+static struct sample_queue *queue;
+
+// Kernel choices passed to kernels_init()
+static const char *kernel_spec = NULL;
+
+// Estimate and correct for DC offset and IQ imbalance
+static int iq_correction = 1;
+
+// Shared-memory ring that frames are also published to, if any
+static const char *shm_name = NULL;
+static struct shm_ring *shm_ring = NULL;
+
+static double stats_interval = -1;
+static uint64_t buffer_end; // sample offset of the end of the current buffer
+
+static struct {
+    uint64_t adsb_frames;
+    uint64_t uplink_frames;
+    uint64_t uplink_shed;          // uplink sync matches not demodulated
+    uint64_t phase_retries_shed;   // second-phase demodulations skipped
+    unsigned degraded_periods;
+    double degraded_time;          // seconds of samples processed while shedding
+    double max_lag;                // seconds
+    uint64_t latency_total;        // samples received after the end of
+    uint64_t latency_max;          //   each frame before it was output
+    uint64_t samples_dropped;      // by the reader thread, when the queue is full
+    uint64_t uplink_probes;        // uplink first blocks decoded to choose a phase
+    uint64_t uplink_demods_saved;  // uplink phases not fully demodulated
+    uint64_t frames_uncorrected;   // frames demodulated before, and after, the
+    uint64_t frames_corrected;     //   first DC/IQ corrected phase table was used
+} stats;
+
+static int parse_shed_order(char *arg)
+{
+    char *step;
+    int n = 0;
+
+    for (step = strtok(arg, ","); step; step = strtok(NULL, ",")) {
+        if (n >= 2)
+            return 0;
+        if (!strcmp(step, "uplink"))
+            shed_order[n++] = SHED_UPLINK;
+        else if (!strcmp(step, "phase"))
+            shed_order[n++] = SHED_PHASE;
+        else
+            return 0;
+    }
 
-#define SYNC_BITS (36)
-#define ADSB_SYNC_WORD   0xEACDDA4E2UL
-#define UPLINK_SYNC_WORD 0x153225B1DUL
+    if (n == 2 && shed_order[0] == shed_order[1])
+        return 0;
 
-// relying on signed overflow is theoretically bad. Let's do it properly.
+    shed_steps = n;
+    return 1;
+}
 
-#ifdef USE_SIGNED_OVERFLOW
-#define phi_difference(from,to) ((int16_t)((to) - (from)))
-#else
-inline int16_t phi_difference(uint16_t from, uint16_t to)
+static void usage(int argc, char **argv)
 {
-    int32_t difference = to - from; // lies in the range -65535 .. +65535
-    if (difference >= 32768)        //   +32768..+65535
-        return difference - 65536;  //   -> -32768..-1: always in range
-    else if (difference < -32768)   //   -65535..-32769
-        return difference + 65536;  //   -> +1..32767: always in range
-    else
-        return difference;
+    fprintf(stderr,
+            "usage: %s [-D] [-f <types>] [-k <kernels>] [-l] [-m <name>] [-o <seconds>] [-O <order>] [-q <blocks>] [-s <seconds>]\n"
+            "\n"
+            "Reads 8-bit I/Q samples at 2.083334MHz from stdin and writes\n"
+            "demodulated UAT messages to stdout.\n"
+            "\n"
+            "  -D            Don't correct for the receiver's DC offset and IQ imbalance\n"
+            "  -f <types>    Frame types to demodulate: downlink, uplink or both\n"
+            "                (default both)\n"
+            "  -k <kernels>  Choose kernel implementations: a comma-separated list\n"
+            "                of <kernel>=<implementation>, and/or bench to time\n"
+            "                each implementation at startup and use the fastest\n"
+            "                (default: the preferred one this CPU supports;\n"
+            "                -k list shows what is available)\n"
+            "  -l            Low latency mode: process input in small pieces\n"
+            "  -m <name>     Also publish frames to the shared-memory ring <name>\n"
+            "                (e.g. /dump978), for local readers\n"
+            "  -o <seconds>  Shed load when processing falls this far behind the\n"
+            "                sample clock (default 1.0; 0 disables load shedding)\n"
+            "  -O <order>    Comma-separated order in which to shed load\n"
+            "                (default uplink,phase):\n"
+            "                  uplink  stop demodulating uplink frames\n"
+            "                  phase   try only one sample phase per sync match\n"
+            "  -q <blocks>   Depth of the queue between the input reader thread\n"
+            "                and the demodulator (default: one second of samples;\n"
+            "                0 reads input in the demodulator thread)\n"
+            "  -s <seconds>  Write statistics to stderr every <seconds> of samples\n"
+            "                (0 = only on exit)\n"
+            "  -h            Show this usage message\n",
+            argv[0]);
 }
-#endif
 
 int main(int argc, char **argv)
 {
-    make_atan2_table();
+    int opt;
+
+    while ((opt = getopt(argc, argv, "hDf:k:lm:o:O:q:s:")) > 0) {
+        switch (opt) {
+        case 'h':
+            usage(argc, argv);
+            return 0;
+
+        case 'D':
+            iq_correction = 0;
+            break;
+
+        case 'f':
+            if (!strcmp(optarg, "downlink")) {
+                want_adsb = 1;
+                want_uplink = 0;
+            } else if (!strcmp(optarg, "uplink")) {
+                want_adsb = 0;
+                want_uplink = 1;
+            } else if (!strcmp(optarg, "both")) {
+                want_adsb = want_uplink = 1;
+            } else {
+                fprintf(stderr, "%s: bad frame types: expected one of downlink, uplink, both\n", argv[0]);
+                return 1;
+            }
+            break;
+
+        case 'k':
+            if (!strcmp(optarg, "list")) {
+                kernels_list(stdout);
+                return 0;
+            }
+            kernel_spec = optarg;
+            break;
+
+        case 'l':
+            low_latency = 1;
+            break;
+
+        case 'm':
+            shm_name = optarg;
+            break;
+
+        case 'o':
+            overload_threshold = atof(optarg);
+            break;
+
+        case 'O':
+            if (!parse_shed_order(optarg)) {
+                fprintf(stderr, "%s: bad load shedding order: expected a list of uplink,phase\n", argv[0]);
+                return 1;
+            }
+            break;
+
+        case 'q':
+            queue_depth = atoi(optarg);
+            break;
+
+        case 's':
+            stats_interval = atof(optarg);
+            break;
+
+        default:
+            usage(argc, argv);
+            return 1;
+        }
+    }
+
+    if (optind < argc) {
+        usage(argc, argv);
+        return 1;
+    }
+
+    if (want_adsb)
+        sync_words[n_sync_words++] = ADSB_SYNC_WORD;
+    if (want_uplink)
+        sync_words[n_sync_words++] = UPLINK_SYNC_WORD;
+
+    iqcorrect_init(iq_correction);
     init_fec();
+    if (!kernels_init(kernel_spec, iqcorrect_table(0)))
+        return 1;
+
+    if (shm_name) {
+        shm_ring = shm_ring_create(shm_name, SHM_RING_SLOTS);
+        if (!shm_ring) {
+            if (errno == EEXIST)
+                fprintf(stderr, "%s: can't create shared-memory ring %s: another dump978 is writing to it\n", argv[0], shm_name);
+            else if (errno == EPROTO)
+                fprintf(stderr, "%s: can't create shared-memory ring %s: /dev/shm%s exists but is not a ring; remove it if nothing uses it\n", argv[0], shm_name, shm_name);
+            else
+                fprintf(stderr, "%s: can't create shared-memory ring %s: %s\n", argv[0], shm_name, strerror(errno));
+            return 1;
+        }
+    }
+
     read_from_stdin();
+    shm_ring_close(shm_ring, shm_name);
     return 0;
 }
 
 static void dump_raw_message(char updown, uint8_t *data, int len, int rs_errors)
 {
-    int i;
+    char line[UPLINK_FRAME_DATA_BYTES * 2 + 32];
+    char *p = line;
 
-    fprintf(stdout, "%c", updown);
-    for (i = 0; i < len; ++i) {
-        fprintf(stdout, "%02x", data[i]);
-    }
+    *p++ = updown;
+    p = kernels.hex_encode(p, data, len);
 
     if (rs_errors)
-        fprintf(stdout, ";rs=%d", rs_errors);
-    fprintf(stdout, ";\n");
+        p += sprintf(p, ";rs=%d", rs_errors);
+    *p++ = ';';
+    *p++ = '\n';
+    fwrite(line, 1, p - line, stdout);
 }
 
 static void handle_adsb_frame(uint64_t timestamp, uint8_t *frame, int rs)
 {
-    dump_raw_message('-', frame, (frame[0]>>3) == 0 ? SHORT_FRAME_DATA_BYTES : LONG_FRAME_DATA_BYTES, rs);
+    int len = (frame[0]>>3) == 0 ? SHORT_FRAME_DATA_BYTES : LONG_FRAME_DATA_BYTES;
+
+    ++stats.adsb_frames;
+    note_correction(timestamp);
+    if (shm_ring)
+        shm_ring_publish(shm_ring, UAT_DOWNLINK, frame, len, rs);
+    dump_raw_message('-', frame, len, rs);
     fflush(stdout);
 }
 
 static void handle_uplink_frame(uint64_t timestamp, uint8_t *frame, int rs)
 {
+    ++stats.uplink_frames;
+    note_correction(timestamp);
+    if (shm_ring)
+        shm_ring_publish(shm_ring, UAT_UPLINK, frame, UPLINK_FRAME_DATA_BYTES, rs);
     dump_raw_message('+', frame, UPLINK_FRAME_DATA_BYTES, rs);
     fflush(stdout);
 }
 
-static uint16_t iqphase[65536]; // contains value [0..65536) -> [0, 2*pi)
 
-void make_atan2_table()
+// Convert 'n' I/Q sample pairs, starting at sample 'offset', to phase
+static void convert_to_phi(uint16_t *buffer, int n, uint64_t offset)
 {
-    unsigned i,q;
-    union {
-        uint8_t iq[2];
-        uint16_t iq16;
-    } u;
-
-    for (i = 0; i < 256; ++i) {
-        double d_i = (i - 127.5);
-        for (q = 0; q < 256; ++q) {
-            double d_q = (q - 127.5);
-            double ang = atan2(d_q, d_i) + M_PI; // atan2 returns [-pi..pi], normalize to [0..2*pi]
-            double scaled_ang = round(32768 * ang / M_PI);
-
-            u.iq[0] = i;
-            u.iq[1] = q;
-            iqphase[u.iq16] = (scaled_ang < 0 ? 0 : scaled_ang > 65535 ? 65535 : (uint16_t)scaled_ang);
-        }
-    }
+    if (iq_correction)
+        iqcorrect_observe(buffer, n);
+    kernels.convert_phi(buffer, n, iqcorrect_table(offset));
 }
 
-static void convert_to_phi(uint16_t *buffer, int n)
+// sync search state carried between calls to process_buffer
+static struct {
+    int valid;
+    uint64_t sync0, sync1;
+} sync_state;
+
+// Demodulator input: phase samples not yet consumed by process_buffer.
+static struct {
+    char buffer[65536*2];
+    int used;                // bytes in buffer
+    uint64_t offset;         // sample offset of the start of buffer
+    uint64_t next_stats;
+} input;
+
+// Demodulate what is in the input buffer and keep whatever
+// process_buffer could not consume yet.
+static void demodulate_input()
 {
-    int i;
+    int processed = process_buffer((uint16_t*) input.buffer, input.used/2, input.offset);
+
+    input.used -= processed * 2;
+    input.offset += processed;
+    if (input.used > 0) {
+        memmove(input.buffer, input.buffer+processed*2, input.used);
+    }
+
+    if (overload_threshold > 0)
+        check_overload(input.offset);
 
-    // unroll the loop. n is always > 2048, usually 36864
-    for (i = 0; i+8 <= n; i += 8) {
-        buffer[i] = iqphase[buffer[i]];
-        buffer[i+1] = iqphase[buffer[i+1]];
-        buffer[i+2] = iqphase[buffer[i+2]];
-        buffer[i+3] = iqphase[buffer[i+3]];
-        buffer[i+4] = iqphase[buffer[i+4]];
-        buffer[i+5] = iqphase[buffer[i+5]];
-        buffer[i+6] = iqphase[buffer[i+6]];
-        buffer[i+7] = iqphase[buffer[i+7]];
+    if (stats_interval > 0 && input.offset >= input.next_stats) {
+        display_stats(input.offset);
+        input.next_stats = input.offset + stats_interval * SAMPLE_RATE;
     }
-    for (; i < n; ++i)
-        buffer[i] = iqphase[buffer[i]];
 }
 
-void read_from_stdin()
+// Read and demodulate input in this thread.
+static void read_direct()
 {
-    char buffer[65536*2];
     int n;
-    int used = 0;
+
+    for (;;) {
+        int toread = sizeof(input.buffer) - input.used;
+
+        if (low_latency && toread > LOW_LATENCY_QUANTUM)
+            toread = LOW_LATENCY_QUANTUM;
+
+        if ((n = read(0, input.buffer+input.used, toread)) <= 0)
+            break;
+
+        convert_to_phi((uint16_t*) (input.buffer+(input.used&~1)), ((input.used&1)+n)/2, input.offset + input.used/2);
+
+        input.used += n;
+        demodulate_input();
+    }
+}
+
+// Wait for a free block in the reader queue
+static struct sample_block *wait_for_free_block()
+{
+    struct sample_block *block;
+
+    while (!(block = sample_queue_get_free(queue)))
+        usleep(1000);
+
+    return block;
+}
+
+// Reader thread: read input, convert it to phase samples, and queue
+// it for the demodulator. If the demodulator falls behind far enough
+// to fill the queue, live input is discarded rather than letting the
+// backlog grow in the kernel pipe buffer; input from a regular file
+// instead waits for the demodulator to catch up.
+static void *reader_thread(void *arg)
+{
+    unsigned block_bytes = *(unsigned*)arg;
+    char *discard = malloc(block_bytes);
     uint64_t offset = 0;
-    
-    while ( (n = read(0, buffer+used, sizeof(buffer)-used)) > 0 ) {
-        int processed;
-
-        convert_to_phi((uint16_t*) (buffer+(used&~1)), ((used&1)+n)/2);
-
-        used += n;
-        processed = process_buffer((uint16_t*) buffer, used/2, offset);
-        used -= processed * 2;
-        offset += processed;
-        if (used > 0) {
-            memmove(buffer, buffer+processed*2, used);
+    char carry;
+    int have_carry = 0;
+    int from_file = 0;
+    struct stat st;
+    struct sample_block *block;
+
+    if (fstat(0, &st) == 0 && S_ISREG(st.st_mode))
+        from_file = 1;
+
+    if (!discard) {
+        perror("malloc");
+        exit(1);
+    }
+
+    for (;;) {
+        block = from_file ? wait_for_free_block() : sample_queue_get_free(queue);
+        char *dest = block ? (char*) block->samples : discard;
+        int n;
+
+        // Samples are byte pairs; a read may end between the two.
+        if (have_carry)
+            dest[0] = carry;
+
+        if ((n = read(0, dest + have_carry, block_bytes - have_carry)) <= 0)
+            break;
+
+        n += have_carry;
+        have_carry = n & 1;
+        if (have_carry)
+            carry = dest[n-1];
+
+        if (block) {
+            convert_to_phi(block->samples, n/2, offset);
+            block->offset = offset;
+            block->count = n/2;
+            sample_queue_push(queue);
+        } else {
+            sample_queue_overrun(queue);
         }
+
+        offset += n/2;
     }
+
+    // Queue an end-of-input marker
+    block = wait_for_free_block();
+    block->offset = offset;
+    block->count = 0;
+    sample_queue_push(queue);
+
+    free(discard);
+    return NULL;
 }
 
+// Demodulate input queued by the reader thread.
+static void read_queued()
+{
+    unsigned block_bytes = low_latency ? LOW_LATENCY_QUANTUM : READER_BLOCK_SIZE;
+    pthread_t reader;
+    int err;
 
-// Return 1 if word is "equal enough" to expected
-static inline int sync_word_fuzzy_compare(uint64_t word, uint64_t expected)
+    if (queue_depth < 0)
+        queue_depth = SAMPLE_RATE * 2 / block_bytes + 1;
+
+    if (!(queue = sample_queue_new(queue_depth, block_bytes / 2))) {
+        perror("sample_queue_new");
+        exit(1);
+    }
+
+    if ((err = pthread_create(&reader, NULL, reader_thread, &block_bytes))) {
+        fprintf(stderr, "pthread_create: %s\n", strerror(err));
+        exit(1);
+    }
+
+    for (;;) {
+        struct sample_block *block = sample_queue_wait(queue);
+
+        if (block->count == 0) {
+            sample_queue_pop(queue);
+            break;
+        }
+
+        if (block->offset != input.offset + input.used/2) {
+            // The reader dropped input; start afresh after the gap.
+            stats.samples_dropped += block->offset - (input.offset + input.used/2);
+            input.used = 0;
+            input.offset = block->offset;
+            sync_state.valid = 0;
+        }
+
+        memcpy(input.buffer + input.used, block->samples, block->count * 2);
+        input.used += block->count * 2;
+        sample_queue_pop(queue);
+
+        demodulate_input();
+    }
+
+    pthread_join(reader, NULL);
+}
+
+void read_from_stdin()
 {
-    uint64_t diff;
+    if (stats_interval > 0)
+        input.next_stats = stats_interval * SAMPLE_RATE;
 
-    if (word == expected)
-        return 1;
+    if (queue_depth == 0)
+        read_direct();
+    else
+        read_queued();
 
-    diff = word ^ expected; // guaranteed nonzero
+    if (stats_interval >= 0)
+        display_stats(input.offset);
+}
 
-    // This is a bit-twiddling popcount
-    // hack, tweaked as we only care about
-    // "<N" or ">=N" set bits for fixed N -
-    // so we can bail out early after seeing N
-    // set bits.
-    //
-    // It relies on starting with a nonzero value
-    // with zero or more trailing clear bits
-    // after the last set bit:
-    //
-    //    010101010101010000
-    //                 ^
-    // Subtracting one, will flip the 
-    // bits starting at the last set bit:
-    //
-    //    010101010101001111
-    //                 ^
-    // then we can use that as a bitwise-and 
-    // mask to clear the lowest set bit:
-    //
-    //    010101010101000000
-    //                 ^
-    // And repeat until the value is zero
-    // or we have seen too many set bits.
-    
-    // >= 1 bit
-    diff &= (diff-1);   // clear lowest set bit
-    if (!diff)
-        return 1; // 1 bit error
-
-    // >= 2 bits
-    diff &= (diff-1);   // clear lowest set bit
-    if (!diff)
-        return 1; // 2 bits error
-
-    // >= 3 bits
-    diff &= (diff-1);   // clear lowest set bit
-    if (!diff)
-        return 1; // 3 bits error
-
-    // >= 4 bits
-    diff &= (diff-1);   // clear lowest set bit
-    if (!diff)
-        return 1; // 4 bits error
-
-    // > 4 bits in error, give up
-    return 0;
+static void set_shed_level(int level)
+{
+    int i;
+
+    if (shed_level == 0)
+        ++stats.degraded_periods;
+
+    shed_level = level;
+    shed_uplink = shed_phase = 0;
+    for (i = 0; i < level; ++i) {
+        switch (shed_order[i]) {
+        case SHED_UPLINK: shed_uplink = 1; break;
+        case SHED_PHASE: shed_phase = 1; break;
+        }
+    }
+
+    if (level == 0)
+        fprintf(stderr, "dump978: caught up with input, load shedding stopped\n");
+    else
+        fprintf(stderr, "dump978: falling behind input, load shedding level %d:%s%s\n",
+                level,
+                shed_uplink ? " no uplink demodulation" : "",
+                shed_phase ? " single phase demodulation" : "");
 }
 
-#define MAX_SYNC_ERRORS 4
+// Track how far processing lags the sample clock. We can't know
+// the absolute latency of the input, so measure (wall clock -
+// sample time) relative to its value when we last found the input
+// (or the reader thread's queue) drained; any increase beyond that
+// is backlog we have built up.
+static void check_overload(uint64_t offset)
+{
+    static int have_baseline = 0;
+    static double baseline;
+    static uint64_t last_offset;
+    struct timespec ts;
+    struct pollfd pfd;
+    double behind, lag;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    behind = ts.tv_sec + ts.tv_nsec / 1e9 - offset / SAMPLE_RATE;
+
+    if (shed_level > 0)
+        stats.degraded_time += (offset - last_offset) / SAMPLE_RATE;
+    last_offset = offset;
+
+    pfd.fd = 0;
+    pfd.events = POLLIN;
+    if (!have_baseline || behind < baseline ||
+        (queue ? sample_queue_fill(queue) == 0 : poll(&pfd, 1, 0) == 0)) {
+        // no backlog
+        have_baseline = 1;
+        baseline = behind;
+    }
 
-// check that there is a valid sync word starting at 'phi'
-// that matches the sync word 'pattern'. Place the dphi
-// threshold to use for bit slicing in '*center'. Return 1
-// if the sync word is OK, 0 on failure
-int check_sync_word(uint16_t *phi, uint64_t pattern, int16_t *center)
+    lag = behind - baseline;
+    if (lag > stats.max_lag)
+        stats.max_lag = lag;
+
+    if (shed_level < shed_steps && lag > overload_threshold * (shed_level + 1))
+        set_shed_level(shed_level + 1);
+    else if (shed_level > 0 && lag < overload_threshold * shed_level / 2)
+        set_shed_level(shed_level - 1);
+}
+
+// Count a frame at sample 'timestamp' as demodulated with or
+// without DC/IQ correction
+static void note_correction(uint64_t timestamp)
+{
+    if (timestamp >= iqcorrect_corrected_from())
+        ++stats.frames_corrected;
+    else
+        ++stats.frames_uncorrected;
+}
+
+// Record the output latency of a frame ending at sample 'frame_end'
+static void note_latency(uint64_t frame_end)
+{
+    uint64_t latency = buffer_end - frame_end;
+
+    stats.latency_total += latency;
+    if (latency > stats.latency_max)
+        stats.latency_max = latency;
+}
+
+static void display_stats(uint64_t offset)
+{
+    uint64_t frames = stats.adsb_frames + stats.uplink_frames;
+    uint64_t corrected_from = iqcorrect_corrected_from();
+    double uncorrected_time, corrected_time;
+    struct iq_correction correction;
+    unsigned rebuilds;
+
+    if (corrected_from > offset)
+        corrected_from = offset;
+    uncorrected_time = corrected_from / SAMPLE_RATE;
+    corrected_time = (offset - corrected_from) / SAMPLE_RATE;
+    iqcorrect_current(&correction, &rebuilds);
+
+    fprintf(stderr,
+            "dump978: %.1f seconds of samples processed\n"
+            "  ADS-B frames:              %llu\n"
+            "  uplink frames:             %llu\n"
+            "  uplink sync matches shed:  %llu\n"
+            "  phase retries shed:        %llu\n"
+            "  degraded periods:          %u (%.1f seconds)\n"
+            "  max processing lag:        %.3f seconds\n"
+            "  output latency:            %.3f ms mean, %.3f ms max\n"
+            "  reader queue:              %u of %d blocks max used, %llu overruns\n"
+            "  samples dropped:           %llu\n"
+            "  uplink phase probes:       %llu (%llu full demodulations saved)\n"
+            "  kernels:                   %s\n"
+            "  DC/IQ correction:          I center %.2f, Q center %.2f, phase %.4f, gain %.4f (%u tables built)\n"
+            "  frame rate:                %.1f/s uncorrected (%.1f seconds), %.1f/s corrected (%.1f seconds)\n",
+            offset / SAMPLE_RATE,
+            (unsigned long long) stats.adsb_frames,
+            (unsigned long long) stats.uplink_frames,
+            (unsigned long long) stats.uplink_shed,
+            (unsigned long long) stats.phase_retries_shed,
+            stats.degraded_periods, stats.degraded_time,
+            stats.max_lag,
+            frames ? stats.latency_total * 1000.0 / SAMPLE_RATE / frames : 0.0,
+            stats.latency_max * 1000.0 / SAMPLE_RATE,
+            queue ? sample_queue_high_watermark(queue) : 0, queue_depth,
+            (unsigned long long) (queue ? sample_queue_overruns(queue) : 0),
+            (unsigned long long) stats.samples_dropped,
+            (unsigned long long) stats.uplink_probes,
+            (unsigned long long) stats.uplink_demods_saved,
+            kernels_describe(),
+            correction.i_center, correction.q_center, correction.phase, correction.gain, rebuilds,
+            uncorrected_time > 0 ? stats.frames_uncorrected / uncorrected_time : 0.0, uncorrected_time,
+            corrected_time > 0 ? stats.frames_corrected / corrected_time : 0.0, corrected_time);
+}
+
+// count the bit errors in the sync word starting at 'phi'
+// compared to the sync word 'pattern'. Place the dphi
+// threshold to use for bit slicing in '*center'.
+static int sync_word_errors(uint16_t *phi, uint64_t pattern, int16_t *center)
 {
     int i;
     int32_t dphi_zero_total = 0;
@@ -266,19 +690,40 @@ int check_sync_word(uint16_t *phi, uint64_t pattern, int16_t *center)
 
     //fprintf(stdout, "check_sync_word: center=%.0fkHz, errors=%d\n", *center * 2083334.0 / 65536 / 1000, error_bits);
 
-    return (error_bits <= MAX_SYNC_ERRORS);
+    return error_bits;
+}
+
+// check that there is a valid sync word starting at 'phi'
+// that matches the sync word 'pattern'. Place the dphi
+// threshold to use for bit slicing in '*center'. Return 1
+// if the sync word is OK, 0 on failure
+int check_sync_word(uint16_t *phi, uint64_t pattern, int16_t *center)
+{
+    return (sync_word_errors(phi, pattern, center) <= MAX_SYNC_ERRORS);
+}
+
+// Return 1 if there are enough samples in a buffer of 'len' samples
+// to demodulate a frame of 'bits' bits (plus sync) starting at
+// 'index', in either sample phase.
+static inline int have_frame(int index, int bits, int len)
+{
+    return index + (SYNC_BITS + bits) * 2 < len;
 }
 
-#define SYNC_MASK ((((uint64_t)1)<<SYNC_BITS)-1)
+// Return 1 if 'pattern' passes check_sync_word() in either phase at 'phi'
+static int possible_sync(uint16_t *phi, uint64_t pattern)
+{
+    int16_t center;
+    return check_sync_word(phi, pattern, &center) || check_sync_word(phi+1, pattern, &center);
+}
 
 int process_buffer(uint16_t *phi, int len, uint64_t offset)    
 {
-    uint64_t sync0 = 0, sync1 = 0;
-    int lenbits;
+    uint64_t sync0, sync1;
     int bit;
 
     uint8_t demod_buf_a[UPLINK_FRAME_BYTES];
-    uint8_t demod_buf_b[UPLINK_FRAME_BYTES];
+    uint8_t demod_buf_b[LONG_FRAME_BYTES];
 
     // We expect samples at twice the UAT bitrate.
     // We look at phase difference between pairs of adjacent samples, i.e.
@@ -293,120 +738,213 @@ int process_buffer(uint16_t *phi, int len, uint64_t offset)
     // should be at the start of each UAT frame. When (if) we find it,
     // that tells us which sample to start decoding from.
 
-    // Stop when we run out of remaining samples for a max-sized frame.
-    // Arrange for our caller to pass the trailing data back to us next time;
-    // ensure we don't consume any partial sync word we might be part-way
-    // through. This means we don't need to maintain state between calls.
-
-    lenbits = len/2 - (SYNC_BITS + UPLINK_FRAME_BITS);
-    for (bit = 0; bit < lenbits; ++bit) {
-        int16_t dphi0 = phi_difference(phi[bit*2], phi[bit*2+1]);
-        int16_t dphi1 = phi_difference(phi[bit*2+1], phi[bit*2+2]);
+    // Scan up to the end of the buffer, or until we find a sync word
+    // whose frame hasn't been completely received yet. Arrange for our
+    // caller to pass the trailing data back to us next time, including
+    // the sync word we are part-way through. The sync search state is
+    // kept between calls so that data isn't scanned twice: the first
+    // SYNC_BITS bits of the next buffer have already been seen.
+
+    buffer_end = offset + len;
+
+    if (sync_state.valid) {
+        sync0 = sync_state.sync0;
+        sync1 = sync_state.sync1;
+        bit = SYNC_BITS;
+    } else {
+        sync0 = sync1 = 0;
+        bit = 0;
+    }
 
-        sync0 = ((sync0 << 1) | (dphi0 > 0 ? 1 : 0)) & SYNC_MASK;
-        sync1 = ((sync1 << 1) | (dphi1 > 0 ? 1 : 0)) & SYNC_MASK;
+    for (;; ++bit) {
+        uint64_t prev_sync0, prev_sync1, word0, word1;
 
-        if (bit < SYNC_BITS)
-            continue; // haven't fully populated sync0/1 yet
+        // skip ahead to (the start of) a possible sync word
+        bit = kernels.sync_search(phi, bit, len, &sync0, &sync1, sync_words, n_sync_words);
+        if (bit*2+2 >= len)
+            break;
 
-        // see if we have (the start of) a valid sync word
-        // It would be nice to look at popcount(expected ^ sync) 
-        // so we can tolerate some errors, but that turns out
-        // to be very expensive to do on every sample
+        prev_sync0 = sync0 >> 1;
+        prev_sync1 = sync1 >> 1;
+        word0 = sync0 & SYNC_MASK;
+        word1 = sync1 & SYNC_MASK;
 
         // when we find a match, try to demodulate both with that match
         // and with the next position, and pick the one with fewer
         // errors.
 
         // check for downlink frames:
-        if (sync_word_fuzzy_compare(sync0, ADSB_SYNC_WORD) || sync_word_fuzzy_compare(sync1, ADSB_SYNC_WORD)) {
+        if (want_adsb && (sync_word_fuzzy_compare(word0, ADSB_SYNC_WORD) || sync_word_fuzzy_compare(word1, ADSB_SYNC_WORD))) {
             int startbit = (bit-SYNC_BITS+1);
-            int shift = (sync_word_fuzzy_compare(sync0, ADSB_SYNC_WORD) ? 0 : 1);
+            int shift = (sync_word_fuzzy_compare(word0, ADSB_SYNC_WORD) ? 0 : 1);
             int index = startbit*2+shift;
+            int basic_only = 0;
 
             int skip_0, skip_1;
             int rs_0 = -1, rs_1 = -1;
 
-            skip_0 = demod_adsb_frame(phi+index, demod_buf_a, &rs_0);
-            skip_1 = demod_adsb_frame(phi+index+1, demod_buf_b, &rs_1);
+            if (!have_frame(index, LONG_FRAME_BITS, len)) {
+                if (!possible_sync(phi+index, ADSB_SYNC_WORD))
+                    continue; // demodulation will fail, don't wait for it
+
+                // We can't tell if this is a Long UAT frame until
+                // the rest arrives, but if it is a Basic UAT frame,
+                // we may already have all of it.
+                if (!have_frame(index, SHORT_FRAME_BITS, len))
+                    goto wait_for_data;
+                basic_only = 1;
+            }
+
+            skip_0 = demod_adsb_frame(phi+index, demod_buf_a, &rs_0, basic_only);
+            if (shed_phase) {
+                ++stats.phase_retries_shed;
+                skip_1 = 0;
+                rs_1 = 9999;
+            } else {
+                skip_1 = demod_adsb_frame(phi+index+1, demod_buf_b, &rs_1, basic_only);
+            }
             if (skip_0 && rs_0 <= rs_1) {
                 handle_adsb_frame(offset+index, demod_buf_a, rs_0);
+                note_latency(offset+index+skip_0*2);
                 bit = startbit + skip_0;
                 continue;
             } else if (skip_1 && rs_1 <= rs_0) {
                 handle_adsb_frame(offset+index+1, demod_buf_b, rs_1);
+                note_latency(offset+index+1+skip_1*2);
                 bit = startbit + skip_1;
                 continue;
+            } else if (basic_only) {
+                // not a Basic UAT frame, try again as a Long UAT
+                // frame when we have the rest of it
+                goto wait_for_data;
             } else {
                 // demod failed
             }
         }
 
         // check for uplink frames:
-        else if (sync_word_fuzzy_compare(sync0, UPLINK_SYNC_WORD) || sync_word_fuzzy_compare(sync1, UPLINK_SYNC_WORD)) {
+        else if (want_uplink && (sync_word_fuzzy_compare(word0, UPLINK_SYNC_WORD) || sync_word_fuzzy_compare(word1, UPLINK_SYNC_WORD))) {
             int startbit = (bit-SYNC_BITS+1);
-            int shift = (sync_word_fuzzy_compare(sync0, UPLINK_SYNC_WORD) ? 0 : 1);
+            int shift = (sync_word_fuzzy_compare(word0, UPLINK_SYNC_WORD) ? 0 : 1);
             int index = startbit*2+shift;
 
-            int skip_0, skip_1;
-            int rs_0 = -1, rs_1 = -1;
+            int skip, rs, phase;
 
-            skip_0 = demod_uplink_frame(phi+index, demod_buf_a, &rs_0);
-            skip_1 = demod_uplink_frame(phi+index+1, demod_buf_b, &rs_1);
-            if (skip_0 && rs_0 <= rs_1) {
-                handle_uplink_frame(offset+index, demod_buf_a, rs_0);
-                bit = startbit + skip_0;
+            if (shed_uplink) {
+                ++stats.uplink_shed;
                 continue;
-            } else if (skip_1 && rs_1 <= rs_0) {
-                handle_uplink_frame(offset+index+1, demod_buf_b, rs_1);
-                bit = startbit + skip_1;
+            }
+
+            if (!have_frame(index, UPLINK_FRAME_BITS, len)) {
+                if (!possible_sync(phi+index, UPLINK_SYNC_WORD))
+                    continue; // demodulation will fail, don't wait for it
+                goto wait_for_data;
+            }
+
+            if (shed_phase)
+                ++stats.phase_retries_shed;
+            skip = demod_uplink_frame(phi+index, demod_buf_a, &rs, &phase, !shed_phase);
+            if (skip) {
+                handle_uplink_frame(offset+index+phase, demod_buf_a, rs);
+                note_latency(offset+index+phase+skip*2);
+                bit = startbit + skip;
                 continue;
             } else {
                 // demod failed
             }
         }
+
+        continue;
+
+    wait_for_data:
+        // rescan this bit next time
+        sync0 = prev_sync0;
+        sync1 = prev_sync1;
+        break;
     }
 
+    if (bit < SYNC_BITS) {
+        // not enough data yet, rescan from the start when there is more
+        sync_state.valid = 0;
+        return 0;
+    }
+
+    sync_state.valid = 1;
+    sync_state.sync0 = sync0;
+    sync_state.sync1 = sync1;
     return (bit - SYNC_BITS)*2;
 }
 
-// demodulate 'bytes' bytes from samples at 'phi' into 'frame',
-// using 'center_dphi' as the bit slicing threshold
-static void demod_frame(uint16_t *phi, uint8_t *frame, int bytes, int16_t center_dphi)
+// demodulate 'bytes' bytes of a downlink frame from samples at 'phi'
+// into 'frame', using 'center_dphi' as the bit slicing threshold,
+// and compute the Reed-Solomon syndromes as we go: the Long UAT
+// syndromes of the whole frame into 'syndromes' (only if 'bytes' is
+// LONG_FRAME_BYTES) and the Basic UAT syndromes of the first
+// SHORT_FRAME_BYTES into 'basic_syndromes'.
+static void demod_adsb_syndromes(uint16_t *phi, uint8_t *frame, int bytes, int16_t center_dphi,
+                                 uint8_t *syndromes, uint8_t *basic_syndromes)
 {
-    while (--bytes >= 0) {
-        uint8_t b = 0;
-        if (phi_difference(phi[0], phi[1]) > center_dphi) b |= 0x80;
-        if (phi_difference(phi[2], phi[3]) > center_dphi) b |= 0x40;
-        if (phi_difference(phi[4], phi[5]) > center_dphi) b |= 0x20;
-        if (phi_difference(phi[6], phi[7]) > center_dphi) b |= 0x10;
-        if (phi_difference(phi[8], phi[9]) > center_dphi) b |= 0x08;
-        if (phi_difference(phi[10], phi[11]) > center_dphi) b |= 0x04;
-        if (phi_difference(phi[12], phi[13]) > center_dphi) b |= 0x02;
-        if (phi_difference(phi[14], phi[15]) > center_dphi) b |= 0x01;
-        *frame++ = b;
-        phi += 16;
+    memset(syndromes, 0, ADSB_LONG_ROOTS);
+    kernels.slice(phi, 1, SHORT_FRAME_BYTES, center_dphi, frame, syndromes,
+                  (bytes == SHORT_FRAME_BYTES ? ADSB_SHORT_ROOTS : ADSB_LONG_ROOTS));
+
+    // the Basic UAT code has the first ADSB_SHORT_ROOTS roots of the Long UAT code
+    memcpy(basic_syndromes, syndromes, ADSB_SHORT_ROOTS);
+
+    if (bytes > SHORT_FRAME_BYTES)
+        kernels.slice(phi + SHORT_FRAME_BYTES*16, 1, bytes - SHORT_FRAME_BYTES, center_dphi,
+                      frame + SHORT_FRAME_BYTES, syndromes, ADSB_LONG_ROOTS);
+}
+
+// demodulate an interleaved uplink frame from samples at 'phi',
+// using 'center_dphi' as the bit slicing threshold, deinterleaving
+// it as we go: the data bytes of each block go to 'to', the parity
+// bytes of each block to 'parity', and the syndromes of each block
+// are accumulated in 'syndromes' (see correct_uplink_frame_syndromes)
+static void demod_uplink_syndromes(uint16_t *phi, uint8_t *to, int16_t center_dphi,
+                                   uint8_t *parity, uint8_t *syndromes)
+{
+    int block;
+
+    memset(syndromes, 0, UPLINK_FRAME_BLOCKS * UPLINK_ROOTS);
+    for (block = 0; block < UPLINK_FRAME_BLOCKS; ++block) {
+        uint8_t *block_syndromes = &syndromes[block * UPLINK_ROOTS];
+
+        // each block is every UPLINK_FRAME_BLOCKS'th interleaved byte
+        kernels.slice(phi + block * 16, UPLINK_FRAME_BLOCKS, UPLINK_BLOCK_DATA_BYTES, center_dphi,
+                      &to[block * UPLINK_BLOCK_DATA_BYTES], block_syndromes, UPLINK_ROOTS);
+        kernels.slice(phi + (UPLINK_FRAME_DATA_BYTES + block) * 16, UPLINK_FRAME_BLOCKS, UPLINK_ROOTS, center_dphi,
+                      &parity[block * UPLINK_ROOTS], block_syndromes, UPLINK_ROOTS);
     }
 }
 
 // Demodulate an ADSB (Long UAT or Basic UAT) downlink frame
 // with the first sync bit in 'phi', storing the frame into 'to'
-// of length up to LONG_FRAME_BYTES. Set '*rs_errors' to the
+// of length up to LONG_FRAME_BYTES. If 'basic_only' is set,
+// only SHORT_FRAME_BYTES are demodulated and only a Basic UAT
+// frame is accepted. Set '*rs_errors' to the
 // number of corrected errors, or 9999 if demodulation failed.
 // Return 0 if demodulation failed, or the number of bits (not
 // samples) consumed if demodulation was OK.
-static int demod_adsb_frame(uint16_t *phi, uint8_t *to, int *rs_errors)
+static int demod_adsb_frame(uint16_t *phi, uint8_t *to, int *rs_errors, int basic_only)
 {
     int16_t center_dphi;
     int frametype;
+    uint8_t syndromes[ADSB_LONG_ROOTS];
+    uint8_t basic_syndromes[ADSB_SHORT_ROOTS];
 
     if (!check_sync_word(phi, ADSB_SYNC_WORD, &center_dphi)) {
         *rs_errors = 9999;
         return 0;
     }
 
-    demod_frame(phi + SYNC_BITS*2, to, LONG_FRAME_BYTES, center_dphi);    
-    frametype = correct_adsb_frame(to, rs_errors);
+    if (basic_only) {
+        demod_adsb_syndromes(phi + SYNC_BITS*2, to, SHORT_FRAME_BYTES, center_dphi, syndromes, basic_syndromes);
+        frametype = correct_basic_adsb_frame_syndromes(to, basic_syndromes, rs_errors);
+    } else {
+        demod_adsb_syndromes(phi + SYNC_BITS*2, to, LONG_FRAME_BYTES, center_dphi, syndromes, basic_syndromes);
+        frametype = correct_adsb_frame_syndromes(to, syndromes, basic_syndromes, rs_errors);
+    }
     if (frametype == 1)
         return (SYNC_BITS + SHORT_FRAME_BITS);
     else if (frametype == 2)
@@ -415,27 +953,84 @@ static int demod_adsb_frame(uint16_t *phi, uint8_t *to, int *rs_errors)
         return 0;
 }
 
+// Demodulate and correct only the first block of an uplink frame
+// with the first sync bit in 'phi', using 'center_dphi' as the
+// bit slicing threshold. Return the number of corrected errors,
+// or 9999 if the block is uncorrectable.
+static int probe_uplink_block(uint16_t *phi, int16_t center_dphi)
+{
+    uint8_t block[UPLINK_BLOCK_BYTES];
+    uint8_t syndromes[UPLINK_ROOTS] = { 0 };
+    int rs_errors;
+
+    // the first block is every UPLINK_FRAME_BLOCKS'th interleaved byte
+    kernels.slice(phi + SYNC_BITS*2, UPLINK_FRAME_BLOCKS, UPLINK_BLOCK_BYTES, center_dphi,
+                  block, syndromes, UPLINK_ROOTS);
+
+    ++stats.uplink_probes;
+    if (fec_syndromes_zero(syndromes, UPLINK_ROOTS))
+        return 0;
+
+    correct_uplink_block(block, &rs_errors);
+    return rs_errors;
+}
+
 // Demodulate an uplink frame
-// with the first sync bit in 'phi', storing the frame into 'to'
+// with the first sync bit in 'phi', or (if 'try_both' is set)
+// in 'phi+1', storing the frame into 'to'
 // of length up to UPLINK_FRAME_BYTES. Set '*rs_errors' to the
-// number of corrected errors, or 9999 if demodulation failed.
+// number of corrected errors, or 9999 if demodulation failed,
+// and '*phase' to the sample phase (0 or 1) that was used.
 // Return 0 if demodulation failed, or the number of bits (not
 // samples) consumed if demodulation was OK.
-static int demod_uplink_frame(uint16_t *phi, uint8_t *to, int *rs_errors)
+//
+// Demodulating and correcting a whole uplink frame is expensive,
+// so when trying both phases, first decode just the first block
+// of each; only phases where that succeeds can produce a valid
+// frame, and the one with the fewest block and sync errors is
+// demodulated in full first.
+static int demod_uplink_frame(uint16_t *phi, uint8_t *to, int *rs_errors, int *phase, int try_both)
 {
-    int16_t center_dphi;
-    uint8_t interleaved[UPLINK_FRAME_BYTES];
+    int16_t center_dphi[2];
+    int sync_errors[2], probe_errors[2];
+    int order[2], candidates = 0, synced = 0;
+    int p, i, result = 0;
+    uint8_t parity[UPLINK_FRAME_BLOCKS * UPLINK_ROOTS];
+    uint8_t syndromes[UPLINK_FRAME_BLOCKS * UPLINK_ROOTS];
+
+    for (p = 0; p < (try_both ? 2 : 1); ++p) {
+        sync_errors[p] = sync_word_errors(phi + p, UPLINK_SYNC_WORD, &center_dphi[p]);
+        if (sync_errors[p] > MAX_SYNC_ERRORS)
+            continue;
+
+        ++synced;
+        if (try_both && (probe_errors[p] = probe_uplink_block(phi + p, center_dphi[p])) == 9999)
+            continue;
+
+        order[candidates++] = p;
+    }
 
-    if (!check_sync_word(phi, UPLINK_SYNC_WORD, &center_dphi)) {
-        *rs_errors = 9999;
-        return 0;
+    if (candidates == 2 &&
+        (probe_errors[1] < probe_errors[0] ||
+         (probe_errors[1] == probe_errors[0] && sync_errors[1] < sync_errors[0]))) {
+        order[0] = 1;
+        order[1] = 0;
     }
 
-    demod_frame(phi + SYNC_BITS*2, interleaved, UPLINK_FRAME_BYTES, center_dphi);
+    *rs_errors = 9999;
+    for (i = 0; i < candidates; ++i) {
+        p = order[i];
+        demod_uplink_syndromes(phi + p + SYNC_BITS*2, to, center_dphi[p], parity, syndromes);
+        if (correct_uplink_frame_syndromes(to, parity, syndromes, rs_errors) == 1) {
+            *phase = p;
+            result = UPLINK_FRAME_BITS+SYNC_BITS;
+            ++i;
+            break;
+        }
+    }
 
-    // deinterleave and correct
-    if (correct_uplink_frame(interleaved, to, rs_errors) == 1)
-        return (UPLINK_FRAME_BITS+SYNC_BITS);
-    else
-        return 0;
+    // without probing, every phase with a good sync word
+    // would have been fully demodulated
+    stats.uplink_demods_saved += synced - i;
+    return result;
 }
@@ -16,11 +16,16 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <math.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
 
 #include "uat.h"
 #include "uat_decode.h"
 #include "reader.h"
+#include "fisb_dedup.h"
 
 #define BLOCK_WIDTH (48.0/60.0)
 #define WIDE_BLOCK_WIDTH (96.0/60.0)
@@ -140,7 +145,7 @@ void block_location(int bn, int ns, int sf, double *latN, double *lonW, double *
     }
 }
 
-void decode_nexrad(struct fisb_apdu *fisb)
+void decode_nexrad(struct fisb_apdu *fisb, FILE *to)
 {
     // Header:
     //
@@ -162,7 +167,7 @@ void decode_nexrad(struct fisb_apdu *fisb)
         double latN = 0, lonW = 0, latSize = 0, lonSize = 0;
         block_location(block_num, ns_flag, scale_factor, &latN, &lonW, &latSize, &lonSize);
 
-        fprintf(stdout, "NEXRAD %s %02d:%02d %d %.0f %.0f %.0f %.0f ",
+        fprintf(to, "NEXRAD %s %02d:%02d %d %.0f %.0f %.0f %.0f ",
                 fisb->product_id == 63 ? "Regional" : "CONUS",
                 fisb->hours,
                 fisb->minutes,
@@ -181,9 +186,9 @@ void decode_nexrad(struct fisb_apdu *fisb)
             int runlength = (fisb->data[i] >> 3) + 1;
 
             while (runlength-- > 0)
-                fprintf(stdout, "%d", intensity);
+                fprintf(to, "%d", intensity);
         }
-        fprintf(stdout, "\n");
+        fprintf(to, "\n");
     } else {
         int L = fisb->data[3] & 15;
         int i;
@@ -242,7 +247,7 @@ void decode_nexrad(struct fisb_apdu *fisb)
                     int k;
                     block_location(bn, ns_flag, scale_factor, &latN, &lonW, &latSize, &lonSize);
 
-                    fprintf(stdout, "NEXRAD %s %02d:%02d %d %.0f %.0f %.0f %.0f ",
+                    fprintf(to, "NEXRAD %s %02d:%02d %d %.0f %.0f %.0f %.0f ",
                             fisb->product_id == 63 ? "Regional" : "CONUS",
                             fisb->hours,
                             fisb->minutes,
@@ -256,49 +261,195 @@ void decode_nexrad(struct fisb_apdu *fisb)
                     // CONUS empty blocks = intensity 1 (valid data, but no precipitation)
                     // regional empty blocks = intensity 0 (valid data <5dBz)
                     for (k = 0; k < 128; ++k)
-                        fprintf(stdout, "%d", (fisb->product_id == 63 ? 0 : 1));
-                    fprintf(stdout, "\n");
+                        fprintf(to, "%d", (fisb->product_id == 63 ? 0 : 1));
+                    fprintf(to, "\n");
                 }
             }
         }
     }
 }
 
-void handle_frame(frame_type_t type, uint8_t *frame, int len, void *extra)
-{
-    if (type == UAT_UPLINK) {
-        struct uat_uplink_mdb mdb;
-        int i;
+// With -d: repeated products are skipped. The lock is only needed
+// by unordered replays, which extract on several threads at once.
+static struct fisb_dedup *dedup;
+static pthread_mutex_t dedup_lock = PTHREAD_MUTEX_INITIALIZER;
 
-        uat_decode_uplink_mdb(frame, &mdb);
-        if (!mdb.app_data_valid)
-            return;
+static int is_repeat(const struct uat_uplink_info_frame *info, time_t now)
+{
+    int seen;
 
-        for (i = 0; i < mdb.num_info_frames; ++i) {
-            struct fisb_apdu *fisb;
+    pthread_mutex_lock(&dedup_lock);
+    seen = fisb_dedup_seen(dedup, info, now);
+    pthread_mutex_unlock(&dedup_lock);
+    return seen;
+}
 
-            if (!mdb.info_frames[i].is_fisb)
+static void extract_frame(frame_type_t type, uint8_t *frame, time_t now, FILE *to)
+{
+    if (type == UAT_UPLINK) {
+        struct uat_uplink_iter iter;
+        struct uat_uplink_info_frame info;
+
+        // only decode the NEXRAD products
+        uat_uplink_iter_init(&iter, frame);
+        while (uat_uplink_next_info_frame(&iter, &info)) {
+            int product_id = uat_fisb_product_id(&info);
+            if (product_id != 63 && product_id != 64)
                 continue;
 
-            fisb = &mdb.info_frames[i].fisb;
-            if (fisb->product_id != 63 && fisb->product_id != 64)
+            if (dedup && is_repeat(&info, now))
                 continue;
 
-            decode_nexrad(fisb);
+            if (uat_decode_fisb_apdu(&info, &info.fisb))
+                decode_nexrad(&info.fisb, to);
         }
     }
+}
 
+void handle_frame(frame_type_t type, uint8_t *frame, int len, void *extra)
+{
+    extract_frame(type, frame, time(NULL), stdout);
     fflush(stdout);
-}        
+}
+
+// The time a frame was received, for -d: its timestamp if it has one
+static time_t frame_time(const struct dump978_frame *frame)
+{
+    return frame->timestamp_valid ? (time_t) frame->timestamp : time(NULL);
+}
+
+// Ordered replay: batches arrive in file order on the main thread
+static void handle_batch_ordered(const struct dump978_frame *frames, int count, void *extra)
+{
+    int i;
+
+    for (i = 0; i < count; ++i)
+        extract_frame(frames[i].type, frames[i].data, frame_time(&frames[i]), stdout);
+}
+
+// Unordered replay: batches arrive concurrently from the replay threads,
+// so build each batch's output separately and write it in one go
+static void handle_batch_unordered(const struct dump978_frame *frames, int count, void *extra)
+{
+    char *buf = NULL;
+    size_t size = 0;
+    FILE *to;
+    int i;
+
+    to = open_memstream(&buf, &size);
+    if (!to) {
+        perror("open_memstream");
+        exit(1);
+    }
+
+    for (i = 0; i < count; ++i)
+        extract_frame(frames[i].type, frames[i].data, frame_time(&frames[i]), to);
+
+    fclose(to);
+    fwrite(buf, 1, size, stdout);
+    free(buf);
+}
+
+static void report_dedup(void)
+{
+    const struct fisb_dedup_stats *stats;
+
+    if (!dedup)
+        return;
+
+    stats = fisb_dedup_stats(dedup);
+    fprintf(stderr, "NEXRAD products: %lu, repeats skipped: %lu (%.1f%%)\n",
+            stats->lookups, stats->hits,
+            stats->lookups ? 100.0 * stats->hits / stats->lookups : 0.0);
+    fisb_dedup_free(dedup);
+}
+
+static void usage(int argc, char **argv)
+{
+    fprintf(stderr,
+            "usage: %s [-m <name> | -f <file> [-j <threads>] [-u]] [-d <seconds>]\n"
+            "\n"
+            "Reads UAT uplink messages from stdin and writes the NEXRAD blocks\n"
+            "they carry to stdout.\n"
+            "\n"
+            "  -m <name>     Read messages from dump978's shared-memory ring <name>\n"
+            "                instead of stdin\n"
+            "  -f <file>     Read messages from an archived file of dump978 output,\n"
+            "                decoding it in parallel\n"
+            "  -j <threads>  Number of threads to use with -f (default: one per CPU)\n"
+            "  -u            With -f, write blocks as soon as they are decoded rather\n"
+            "                than in the order of the file\n"
+            "  -d <seconds>  Skip NEXRAD products identical to one seen in the last\n"
+            "                <seconds>, and report how many were skipped at exit\n"
+            "  -h            Show this usage message\n",
+            argv[0]);
+}
 
 int main(int argc, char **argv)
 {
     struct dump978_reader *reader;
+    const char *shm_name = NULL;
+    const char *replay_name = NULL;
+    int threads = 0, unordered = 0;
     int framecount;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "hm:f:j:ud:")) > 0) {
+        switch (opt) {
+        case 'h':
+            usage(argc, argv);
+            return 0;
+
+        case 'm':
+            shm_name = optarg;
+            break;
+
+        case 'f':
+            replay_name = optarg;
+            break;
+
+        case 'j':
+            threads = atoi(optarg);
+            break;
+
+        case 'u':
+            unordered = 1;
+            break;
+
+        case 'd':
+            dedup = fisb_dedup_new(FISB_DEDUP_DEFAULT_SLOTS, atoi(optarg));
+            if (!dedup) {
+                perror("fisb_dedup_new");
+                return 1;
+            }
+            break;
+
+        default:
+            usage(argc, argv);
+            return 1;
+        }
+    }
+
+    if (optind < argc || (shm_name && replay_name)) {
+        usage(argc, argv);
+        return 1;
+    }
+
+    if (replay_name) {
+        if (dump978_replay_file(replay_name, threads, unordered ? 0 : DUMP978_REPLAY_ORDERED,
+                                unordered ? handle_batch_unordered : handle_batch_ordered, NULL) < 0) {
+            perror(replay_name);
+            return 1;
+        }
+
+        fflush(stdout);
+        report_dedup();
+        return 0;
+    }
 
-    reader = dump978_reader_new(0,0);
+    reader = shm_name ? dump978_reader_new_shm(shm_name,0) : dump978_reader_new(0,0);
     if (!reader) {
-        perror("dump978_reader_new");
+        perror(shm_name ? shm_name : "dump978_reader_new");
         return 1;
     }
     
@@ -310,6 +461,7 @@ int main(int argc, char **argv)
         return 1;
     }
 
+    report_dedup();
     return 0;
 }
 
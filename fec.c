@@ -23,20 +23,49 @@
 #include <unistd.h>
 
 #include "uat.h"
+#include "fec.h"
 #include "fec/rs.h"
 
-static void *rs_uplink;
-static void *rs_adsb_short;
-static void *rs_adsb_long;
+// (shared with the encoders in fec_encode.c)
+void *fec_rs_uplink;
+void *fec_rs_adsb_short;
+void *fec_rs_adsb_long;
 
 #define UPLINK_POLY 0x187
 #define ADSB_POLY 0x187
 
+uint8_t fec_syndrome_mul[FEC_MAX_ROOTS][256];
+
+// All three codes share the same field and first consecutive root
+// (alpha^120), so one set of tables serves all of them: updating
+// syndrome i multiplies it by alpha^(120+i).
+static void init_syndrome_tables(void)
+{
+    uint8_t alpha_to[255];
+    uint8_t index_of[256];
+    unsigned i, x;
+
+    for (i = 0, x = 1; i < 255; ++i) {
+        alpha_to[i] = x;
+        index_of[x] = i;
+        x <<= 1;
+        if (x & 0x100)
+            x ^= ADSB_POLY;
+    }
+
+    for (i = 0; i < FEC_MAX_ROOTS; ++i) {
+        fec_syndrome_mul[i][0] = 0;
+        for (x = 1; x < 256; ++x)
+            fec_syndrome_mul[i][x] = alpha_to[(index_of[x] + 120 + i) % 255];
+    }
+}
+
 void init_fec(void)
 {
-    rs_adsb_short = init_rs_char(8, /* gfpoly */ ADSB_POLY, /* fcr */ 120, /* prim */ 1, /* nroots */ 12, /* pad */ 225);
-    rs_adsb_long  = init_rs_char(8, /* gfpoly */ ADSB_POLY, /* fcr */ 120, /* prim */ 1, /* nroots */ 14, /* pad */ 207);
-    rs_uplink     = init_rs_char(8, /* gfpoly */ UPLINK_POLY, /* fcr */ 120, /* prim */ 1, /* nroots */ 20, /* pad */ 163);
+    fec_rs_adsb_short = init_rs_char(8, /* gfpoly */ ADSB_POLY, /* fcr */ 120, /* prim */ 1, /* nroots */ ADSB_SHORT_ROOTS, /* pad */ 225);
+    fec_rs_adsb_long  = init_rs_char(8, /* gfpoly */ ADSB_POLY, /* fcr */ 120, /* prim */ 1, /* nroots */ ADSB_LONG_ROOTS, /* pad */ 207);
+    fec_rs_uplink     = init_rs_char(8, /* gfpoly */ UPLINK_POLY, /* fcr */ 120, /* prim */ 1, /* nroots */ UPLINK_ROOTS, /* pad */ 163);
+    init_syndrome_tables();
 }
 
 int correct_adsb_frame(uint8_t *to, int *rs_errors)
@@ -44,7 +73,7 @@ int correct_adsb_frame(uint8_t *to, int *rs_errors)
     // Try decoding as a Long UAT.
     // We rely on decode_rs_char not modifying the data if there were
     // uncorrectable errors.
-    int n_corrected = decode_rs_char(rs_adsb_long, to, NULL, 0);
+    int n_corrected = decode_rs_char(fec_rs_adsb_long, to, NULL, 0);
     if (n_corrected >= 0 && n_corrected <= 7 && (to[0]>>3) != 0) {
         // Valid long frame.
         *rs_errors = n_corrected;
@@ -52,7 +81,42 @@ int correct_adsb_frame(uint8_t *to, int *rs_errors)
     }
 
     // Retry as Basic UAT
-    n_corrected = decode_rs_char(rs_adsb_short, to, NULL, 0);
+    return correct_basic_adsb_frame(to, rs_errors);
+}
+
+int correct_basic_adsb_frame(uint8_t *to, int *rs_errors)
+{
+    int n_corrected = decode_rs_char(fec_rs_adsb_short, to, NULL, 0);
+    if (n_corrected >= 0 && n_corrected <= 6 && (to[0]>>3) == 0) {
+        // Valid short frame
+        *rs_errors = n_corrected;
+        return 1;
+    }
+
+    // Failed.
+    *rs_errors = 9999;
+    return -1;
+}
+
+int correct_adsb_frame_syndromes(uint8_t *to, const uint8_t *syndromes, const uint8_t *basic_syndromes, int *rs_errors)
+{
+    int n_corrected = decode_rs_syndromes_char(fec_rs_adsb_long, to, syndromes, NULL, 0);
+    if (n_corrected >= 0 && n_corrected <= 7 && (to[0]>>3) != 0) {
+        // Valid long frame.
+        *rs_errors = n_corrected;
+        return 2;
+    }
+
+    // Retry as Basic UAT. If the Long UAT decode changed the
+    // data, the Basic UAT syndromes no longer apply.
+    if (n_corrected > 0)
+        return correct_basic_adsb_frame(to, rs_errors);
+    return correct_basic_adsb_frame_syndromes(to, basic_syndromes, rs_errors);
+}
+
+int correct_basic_adsb_frame_syndromes(uint8_t *to, const uint8_t *syndromes, int *rs_errors)
+{
+    int n_corrected = decode_rs_syndromes_char(fec_rs_adsb_short, to, syndromes, NULL, 0);
     if (n_corrected >= 0 && n_corrected <= 6 && (to[0]>>3) == 0) {
         // Valid short frame
         *rs_errors = n_corrected;
@@ -64,6 +128,19 @@ int correct_adsb_frame(uint8_t *to, int *rs_errors)
     return -1;
 }
 
+int correct_uplink_block(uint8_t *block, int *rs_errors)
+{
+    int n_corrected = decode_rs_char(fec_rs_uplink, block, NULL, 0);
+    if (n_corrected < 0 || n_corrected > 10) {
+        // Failed
+        *rs_errors = 9999;
+        return -1;
+    }
+
+    *rs_errors = n_corrected;
+    return 1;
+}
+
 int correct_uplink_frame(uint8_t *from, uint8_t *to, int *rs_errors)
 {
     int block;
@@ -77,8 +154,7 @@ int correct_uplink_frame(uint8_t *from, uint8_t *to, int *rs_errors)
             blockdata[i] = from[i * UPLINK_FRAME_BLOCKS + block];
 
         // error-correct in place
-        n_corrected = decode_rs_char(rs_uplink, blockdata, NULL, 0);
-        if (n_corrected < 0 || n_corrected > 10) {
+        if (correct_uplink_block(blockdata, &n_corrected) < 0) {
             // Failed
             *rs_errors = 9999;
             return -1;
@@ -91,3 +167,33 @@ int correct_uplink_frame(uint8_t *from, uint8_t *to, int *rs_errors)
     *rs_errors = total_corrected;
     return 1;
 }
+
+int correct_uplink_frame_syndromes(uint8_t *to, const uint8_t *parity, const uint8_t *syndromes, int *rs_errors)
+{
+    int block;
+    int total_corrected = 0;
+
+    for (block = 0; block < UPLINK_FRAME_BLOCKS; ++block) {
+        int n_corrected;
+        uint8_t blockdata[UPLINK_BLOCK_BYTES];
+
+        if (fec_syndromes_zero(&syndromes[block * UPLINK_ROOTS], UPLINK_ROOTS))
+            continue;
+
+        memcpy(blockdata, &to[block * UPLINK_BLOCK_DATA_BYTES], UPLINK_BLOCK_DATA_BYTES);
+        memcpy(blockdata + UPLINK_BLOCK_DATA_BYTES, &parity[block * UPLINK_ROOTS], UPLINK_ROOTS);
+
+        n_corrected = decode_rs_syndromes_char(fec_rs_uplink, blockdata, &syndromes[block * UPLINK_ROOTS], NULL, 0);
+        if (n_corrected < 0 || n_corrected > 10) {
+            // Failed
+            *rs_errors = 9999;
+            return -1;
+        }
+
+        memcpy(&to[block * UPLINK_BLOCK_DATA_BYTES], blockdata, UPLINK_BLOCK_DATA_BYTES);
+        total_corrected += n_corrected;
+    }
+
+    *rs_errors = total_corrected;
+    return 1;
+}
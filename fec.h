@@ -18,6 +18,14 @@
 #ifndef DUMP978_FEC_H
 #define DUMP978_FEC_H
 
+#include <stdint.h>
+
+/* Number of Reed-Solomon parity bytes (roots) of each code */
+#define ADSB_SHORT_ROOTS 12
+#define ADSB_LONG_ROOTS 14
+#define UPLINK_ROOTS 20
+#define FEC_MAX_ROOTS 20
+
 /* Initialize. Must be called once before correct_* */
 void init_fec(void);
 
@@ -30,6 +38,24 @@ void init_fec(void);
  */
 int correct_adsb_frame(uint8_t *to, int *rs_errors);
 
+/* Correct a downlink frame that is known to be a Basic UAT frame.
+ *
+ * 'to' should contain SHORT_FRAME_BYTES of data.
+ * Errors are corrected in-place within 'to'.
+ * Returns -1 on uncorrectable errors or if the frame is not a basic frame, 1 for a valid basic frame.
+ * Sets *rs_errors to the number of corrected errors, or 9999 if uncorrectable.
+ */
+int correct_basic_adsb_frame(uint8_t *to, int *rs_errors);
+
+/* Correct a single deinterleaved uplink block.
+ *
+ * 'block' should contain UPLINK_BLOCK_BYTES of data.
+ * Errors are corrected in-place within 'block'.
+ * Returns -1 on uncorrectable errors, 1 for a valid block.
+ * Sets *rs_errors to the number of corrected errors, or 9999 if uncorrectable.
+ */
+int correct_uplink_block(uint8_t *block, int *rs_errors);
+
 /* Deinterleave and correct an uplink frame.
  *
  * 'from' should point to UPLINK_FRAME_BYTES of interleaved input data
@@ -41,4 +67,73 @@ int correct_adsb_frame(uint8_t *to, int *rs_errors);
  */
 int correct_uplink_frame(uint8_t *from, uint8_t *to, int *rs_errors);
 
+/* Encode a downlink frame. The encoders are in fec_encode.o, which
+ * needs fec/encode_rs_char.o as well.
+ *
+ * 'frame' should point to LONG_FRAME_BYTES of space holding the frame
+ * data (SHORT_FRAME_DATA_BYTES or LONG_FRAME_DATA_BYTES of it, depending
+ * on the payload type in the first byte). The Reed-Solomon parity is
+ * written after the data.
+ * Returns the total length of the encoded frame in bytes.
+ */
+int encode_adsb_frame(uint8_t *frame);
+
+/* Encode an uplink frame.
+ *
+ * 'from' should point to UPLINK_FRAME_DATA_BYTES of data.
+ * 'to' should point to UPLINK_FRAME_BYTES of space; the six encoded
+ * blocks are written to it interleaved, in transmission order.
+ */
+void encode_uplink_frame(const uint8_t *from, uint8_t *to);
+
+/* Syndrome accumulation.
+ *
+ * A demodulator can compute the syndromes of a frame as it produces
+ * each byte, and then use the correct_*_syndromes variants below,
+ * which do not need to read the frame again unless it has errors.
+ * Syndromes start at zero and are updated with each byte of the
+ * codeword in order; the Basic UAT syndromes are the first
+ * ADSB_SHORT_ROOTS Long UAT syndromes after SHORT_FRAME_BYTES bytes.
+ */
+extern uint8_t fec_syndrome_mul[FEC_MAX_ROOTS][256];
+
+static inline void fec_syndrome_update(uint8_t *syndromes, int nroots, uint8_t byte)
+{
+    int i;
+    for (i = 0; i < nroots; ++i)
+        syndromes[i] = fec_syndrome_mul[i][syndromes[i]] ^ byte;
+}
+
+static inline int fec_syndromes_zero(const uint8_t *syndromes, int nroots)
+{
+    int i;
+    uint8_t any = 0;
+    for (i = 0; i < nroots; ++i)
+        any |= syndromes[i];
+    return (any == 0);
+}
+
+/* Correct a downlink frame, as correct_adsb_frame, given the
+ * ADSB_LONG_ROOTS syndromes of the whole frame in 'syndromes' and the
+ * ADSB_SHORT_ROOTS syndromes of its first SHORT_FRAME_BYTES in
+ * 'basic_syndromes'.
+ */
+int correct_adsb_frame_syndromes(uint8_t *to, const uint8_t *syndromes, const uint8_t *basic_syndromes, int *rs_errors);
+
+/* Correct a Basic UAT frame, as correct_basic_adsb_frame, given its
+ * ADSB_SHORT_ROOTS syndromes.
+ */
+int correct_basic_adsb_frame_syndromes(uint8_t *to, const uint8_t *syndromes, int *rs_errors);
+
+/* Correct an already deinterleaved uplink frame.
+ *
+ * 'to' should contain the UPLINK_FRAME_DATA_BYTES of data of the six blocks;
+ * 'parity' the UPLINK_ROOTS parity bytes of each block in turn;
+ * 'syndromes' the UPLINK_ROOTS syndromes of each block in turn.
+ * Errors are corrected in-place within 'to'.
+ * Returns -1 on uncorrectable errors, 1 for a valid uplink frame.
+ * Sets *rs_errors to the number of corrected errors, or 9999 if uncorrectable.
+ */
+int correct_uplink_frame_syndromes(uint8_t *to, const uint8_t *parity, const uint8_t *syndromes, int *rs_errors);
+
 #endif
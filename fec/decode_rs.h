@@ -18,6 +18,9 @@
  * FCR - An integer literal or variable specifying the first consecutive root of the
  *       Reed-Solomon generator polynomial. Integer variable or literal.
  * PRIM - The primitive root of the generator poly. Integer variable or literal.
+ * SYNDROMES - If defined, the address of an array of NROOTS syndromes (in
+ *             polynomial form) already computed by the caller; data[] is then
+ *             only read to correct it.
  * DEBUG - If set to 1 or more, do various internal consistency checking. Leave this
  *         undefined for production code
 
@@ -78,6 +81,10 @@
   data_t root[NROOTS], reg[NROOTS+1], loc[NROOTS];
   int syn_error, count;
 
+#ifdef SYNDROMES
+  for(i=0;i<NROOTS;i++)
+    s[i] = SYNDROMES[i];
+#else
   /* form the syndromes; i.e., evaluate data(x) at roots of g(x) */
   for(i=0;i<NROOTS;i++)
     s[i] = data[0];
@@ -91,6 +98,7 @@
       }
     }
   }
+#endif
 
   /* Convert syndromes to index form, checking for nonzero condition */
   syn_error = 0;
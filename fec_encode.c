@@ -0,0 +1,58 @@
+//
+// Copyright 2015, Oliver Jowett <oliver@mutability.co.uk>
+//
+
+// This file is free software: you may copy, redistribute and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 2 of the License, or (at your
+// option) any later version.
+//
+// This file is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Reed-Solomon encoding of UAT frames, kept apart from fec.c so that
+// programs which only correct frames don't need fec/encode_rs_char.o.
+
+#include <stdint.h>
+#include <string.h>
+
+#include "uat.h"
+#include "fec.h"
+#include "fec/rs.h"
+
+// set up by init_fec() in fec.c
+extern void *fec_rs_uplink;
+extern void *fec_rs_adsb_short;
+extern void *fec_rs_adsb_long;
+
+int encode_adsb_frame(uint8_t *frame)
+{
+    if ((frame[0] >> 3) == 0) {
+        encode_rs_char(fec_rs_adsb_short, frame, frame + SHORT_FRAME_DATA_BYTES);
+        return SHORT_FRAME_BYTES;
+    } else {
+        encode_rs_char(fec_rs_adsb_long, frame, frame + LONG_FRAME_DATA_BYTES);
+        return LONG_FRAME_BYTES;
+    }
+}
+
+void encode_uplink_frame(const uint8_t *from, uint8_t *to)
+{
+    int block;
+
+    for (block = 0; block < UPLINK_FRAME_BLOCKS; ++block) {
+        int i;
+        uint8_t blockdata[UPLINK_BLOCK_BYTES];
+
+        memcpy(blockdata, &from[block * UPLINK_BLOCK_DATA_BYTES], UPLINK_BLOCK_DATA_BYTES);
+        encode_rs_char(fec_rs_uplink, blockdata, blockdata + UPLINK_BLOCK_DATA_BYTES);
+
+        for (i = 0; i < UPLINK_BLOCK_BYTES; ++i)
+            to[i * UPLINK_FRAME_BLOCKS + block] = blockdata[i];
+    }
+}
@@ -178,11 +178,87 @@ static void hex_to_bytes(const char *s, uint8_t *to)
         *to++ = (uint8_t) hexbyte(s);
 }
 
+// Check the result of correcting downlink test 'i'; return 1 if OK
+static int check_downlink_result(int i, int frametype, uint8_t *corrected)
+{
+    uint8_t expected[LONG_FRAME_DATA_BYTES];
+
+    if (frametype != downlink_tests[i].frametype) {
+        fprintf(stderr, "FAIL: expected frametype %d, got frametype %d\n", downlink_tests[i].frametype, frametype);
+        return 0;
+    }
+
+    if (downlink_tests[i].expected) {
+        hex_to_bytes(downlink_tests[i].expected, expected);
+        if (memcmp(expected, corrected, (frametype == 2) ? LONG_FRAME_DATA_BYTES : SHORT_FRAME_DATA_BYTES) != 0) {
+            fprintf(stderr, "FAIL: wrong corrected output\n");
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+// Encode the corrected data of downlink test 'i' and check that it
+// decodes with no errors; return 1 if OK
+static int check_downlink_encode(int i)
+{
+    uint8_t frame[LONG_FRAME_BYTES] = { 0 };
+    int frametype, rs_errors;
+
+    hex_to_bytes(downlink_tests[i].expected, frame);
+    encode_adsb_frame(frame);
+    frametype = correct_adsb_frame(frame, &rs_errors);
+    if (!check_downlink_result(i, frametype, frame))
+        return 0;
+
+    if (rs_errors != 0) {
+        fprintf(stderr, "FAIL: encoded frame needed %d corrections\n", rs_errors);
+        return 0;
+    }
+
+    return 1;
+}
+
+// Encode an uplink frame of pseudorandom data, damage it, and
+// check that it corrects back to the original; return 1 if OK
+static int check_uplink_encode(unsigned seed, int damage)
+{
+    uint8_t data[UPLINK_FRAME_DATA_BYTES];
+    uint8_t encoded[UPLINK_FRAME_BYTES];
+    uint8_t corrected[UPLINK_FRAME_BYTES];
+    int i, rs_errors;
+
+    srand(seed);
+    for (i = 0; i < UPLINK_FRAME_DATA_BYTES; ++i)
+        data[i] = rand() & 255;
+
+    encode_uplink_frame(data, encoded);
+    for (i = 0; i < damage; ++i)
+        encoded[i * 7] ^= 0x5A;
+
+    if (correct_uplink_frame(encoded, corrected, &rs_errors) < 0) {
+        fprintf(stderr, "FAIL: encoded uplink frame was uncorrectable\n");
+        return 0;
+    }
+
+    if (memcmp(data, corrected, UPLINK_FRAME_DATA_BYTES) != 0) {
+        fprintf(stderr, "FAIL: wrong corrected uplink output\n");
+        return 0;
+    }
+
+    if (rs_errors != damage) {
+        fprintf(stderr, "FAIL: expected %d uplink corrections, got %d\n", damage, rs_errors);
+        return 0;
+    }
+
+    return 1;
+}
+
 int main(int argc, char **argv)
 {
-    int i;
+    int i, j;
     uint8_t input[LONG_FRAME_BYTES];
-    uint8_t expected[LONG_FRAME_DATA_BYTES];
     int all_ok = 1;
 
     init_fec();
@@ -191,20 +267,32 @@ int main(int argc, char **argv)
         int rs_errors;
         int frametype;
         int ok = 1;
+        uint8_t syndromes[ADSB_LONG_ROOTS] = { 0 };
+        uint8_t basic_syndromes[ADSB_SHORT_ROOTS];
 
         fprintf(stderr, "%s: ", downlink_tests[i].testname);
 
         hex_to_bytes(downlink_tests[i].input, input);
         frametype = correct_adsb_frame(input, &rs_errors);
-        if (frametype != downlink_tests[i].frametype) {
-            fprintf(stderr, "FAIL: expected frametype %d, got frametype %d\n", downlink_tests[i].frametype, frametype);
+        ok = check_downlink_result(i, frametype, input);
+
+        // again, with the syndromes computed up front
+        hex_to_bytes(downlink_tests[i].input, input);
+        for (j = 0; j < LONG_FRAME_BYTES; ++j) {
+            if (j == SHORT_FRAME_BYTES)
+                memcpy(basic_syndromes, syndromes, ADSB_SHORT_ROOTS);
+            fec_syndrome_update(syndromes, ADSB_LONG_ROOTS, input[j]);
+        }
+        frametype = correct_adsb_frame_syndromes(input, syndromes, basic_syndromes, &rs_errors);
+        if (ok && !check_downlink_result(i, frametype, input)) {
+            fprintf(stderr, "  (with precomputed syndromes)\n");
+            ok = 0;
+        }
+
+        // and check that encoding the expected data round-trips
+        if (ok && downlink_tests[i].frametype > 0 && !check_downlink_encode(i)) {
+            fprintf(stderr, "  (encoding the corrected data)\n");
             ok = 0;
-        } else if (downlink_tests[i].expected) {
-            hex_to_bytes(downlink_tests[i].expected, expected);
-            if (memcmp(expected, input, (frametype == 2) ? LONG_FRAME_DATA_BYTES : SHORT_FRAME_DATA_BYTES) != 0) {
-                fprintf(stderr, "FAIL: wrong corrected output\n");
-                ok = 0;
-            }
         }
 
         if (ok)
@@ -212,6 +300,14 @@ int main(int argc, char **argv)
         else
             all_ok = 0;
     }
-    
+
+    for (i = 0; i <= 60; i += 12) {
+        fprintf(stderr, "uplink encode, %d errors: ", i);
+        if (check_uplink_encode(i + 1, i))
+            fprintf(stderr, "PASS\n");
+        else
+            all_ok = 0;
+    }
+
     return all_ok ? 0 : 1;
 }
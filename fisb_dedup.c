@@ -0,0 +1,148 @@
+//
+// Copyright 2015, Oliver Jowett <oliver@mutability.co.uk>
+//
+
+// This file is free software: you may copy, redistribute and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 2 of the License, or (at your
+// option) any later version.
+//
+// This file is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "fisb_dedup.h"
+
+// Number of slots, starting at the hash's home slot, that an entry
+// may occupy. Entries are never removed, only overwritten, so a
+// lookup can stop at the first empty slot.
+#define PROBES 16
+
+struct entry {
+    uint64_t hash;  // 0 if empty
+    time_t seen;
+};
+
+struct fisb_dedup {
+    unsigned mask;
+    unsigned ttl;
+    struct fisb_dedup_stats stats;
+    struct entry entries[];
+};
+
+struct fisb_dedup *fisb_dedup_new(unsigned slots, unsigned ttl)
+{
+    struct fisb_dedup *d;
+    unsigned size;
+
+    if (slots == 0 || slots > (1U << 30)) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    for (size = PROBES; size < slots; size *= 2)
+        ;
+
+    d = calloc(1, sizeof(*d) + size * sizeof(struct entry));
+    if (!d)
+        return NULL;
+
+    d->mask = size - 1;
+    d->ttl = ttl;
+    return d;
+}
+
+void fisb_dedup_free(struct fisb_dedup *d)
+{
+    free(d);
+}
+
+// Hash the info frame 8 bytes at a time
+static uint64_t hash_frame(const uint8_t *data, unsigned length)
+{
+    uint64_t h = 0x9e3779b97f4a7c15ULL ^ length;
+    uint64_t w;
+
+    while (length >= 8) {
+        memcpy(&w, data, 8);
+        h = (h ^ w) * 0xff51afd7ed558ccdULL;
+        h ^= h >> 32;
+        data += 8;
+        length -= 8;
+    }
+
+    if (length > 0) {
+        w = 0;
+        memcpy(&w, data, length);
+        h = (h ^ w) * 0xff51afd7ed558ccdULL;
+        h ^= h >> 32;
+    }
+
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 29;
+    return h ? h : 1;
+}
+
+int fisb_dedup_seen(struct fisb_dedup *d, const struct uat_uplink_info_frame *frame, time_t now)
+{
+    struct entry *e, *victim = NULL;
+    uint64_t hash;
+    unsigned i, slot;
+
+    if (frame->type != 0)
+        return 0; // not FIS-B
+
+    ++d->stats.lookups;
+    hash = hash_frame(frame->data, frame->length);
+    slot = hash & d->mask;
+
+    for (i = 0; i < PROBES; ++i) {
+        e = &d->entries[(slot + i) & d->mask];
+
+        if (e->hash == 0) {
+            if (!victim)
+                victim = e;
+            break;
+        }
+
+        if (now - e->seen >= (time_t) d->ttl) {
+            // expired: reusable, but keep looking for a live match
+            if (!victim || victim->seen > e->seen)
+                victim = e;
+            continue;
+        }
+
+        if (e->hash == hash) {
+            ++d->stats.hits;
+            return 1;
+        }
+    }
+
+    if (!victim) {
+        // no free slot nearby: overwrite the oldest live entry
+        victim = &d->entries[slot];
+        for (i = 1; i < PROBES; ++i) {
+            e = &d->entries[(slot + i) & d->mask];
+            if (e->seen < victim->seen)
+                victim = e;
+        }
+        ++d->stats.replaced;
+    }
+
+    victim->hash = hash;
+    victim->seen = now;
+    return 0;
+}
+
+const struct fisb_dedup_stats *fisb_dedup_stats(const struct fisb_dedup *d)
+{
+    return &d->stats;
+}
@@ -0,0 +1,65 @@
+//
+// Copyright 2015, Oliver Jowett <oliver@mutability.co.uk>
+//
+
+// This file is free software: you may copy, redistribute and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 2 of the License, or (at your
+// option) any later version.
+//
+// This file is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef DUMP978_FISB_DEDUP_H
+#define DUMP978_FISB_DEDUP_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include "uat_decode.h"
+
+// Recognizing repeated FIS-B APDUs.
+//
+// Ground stations rebroadcast each product every few minutes, and
+// overlapping stations send identical copies. This remembers a 64-bit
+// hash of the contents (header and payload) of each APDU seen in the
+// last 'ttl' seconds, in a fixed-size open-addressing table, so that
+// consumers can skip the copies. An APDU is reported as a repeat for
+// 'ttl' seconds after it was first seen, after which it is passed
+// again once.
+//
+// When the table is too full to record a new APDU, the oldest entry
+// near its slot is replaced, which at worst lets a repeat through;
+// this is rare while the table has twice as many slots as there are
+// distinct APDUs in 'ttl' seconds.
+
+#define FISB_DEDUP_DEFAULT_SLOTS 16384
+
+struct fisb_dedup_stats {
+    unsigned long lookups;  // APDUs checked
+    unsigned long hits;     // of those, repeats
+    unsigned long replaced; // unexpired entries overwritten for lack of space
+};
+
+struct fisb_dedup;
+
+// Create a table of 'slots' entries (rounded up to a power of two)
+// remembering APDUs for 'ttl' seconds. Returns NULL on error with
+// errno set.
+struct fisb_dedup *fisb_dedup_new(unsigned slots, unsigned ttl);
+
+void fisb_dedup_free(struct fisb_dedup *d);
+
+// Check the FIS-B info frame 'frame', received at time 'now'. Returns
+// 1 if the same APDU was seen in the last 'ttl' seconds; otherwise
+// remembers it and returns 0. Frames that aren't FIS-B always return 0.
+int fisb_dedup_seen(struct fisb_dedup *d, const struct uat_uplink_info_frame *frame, time_t now);
+
+const struct fisb_dedup_stats *fisb_dedup_stats(const struct fisb_dedup *d);
+
+#endif
@@ -0,0 +1,337 @@
+//
+// Copyright 2015, Oliver Jowett <oliver@mutability.co.uk>
+//
+
+// This file is free software: you may copy, redistribute and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 2 of the License, or (at your
+// option) any later version.
+//
+// This file is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "fisb_reassembly.h"
+
+// One held segment
+struct block {
+    struct block *next;     // next segment of the same product, or next free block
+    uint16_t number;
+    uint16_t length;
+    uint8_t data[FISB_SEGMENT_MAX];
+};
+
+// One incomplete product
+struct product {
+    struct product *hash_next;  // next in hash chain, or next free product
+    struct product *newer;      // LRU list neighbours
+    struct product *older;
+    struct block *blocks;       // segments received so far, in arrival order
+    struct fisb_apdu header;    // of the first segment received
+    time_t updated;             // when a segment last arrived
+    unsigned received;          // number of distinct segments held
+    uint32_t have[16];          // bitmap of segment numbers held (1..511)
+};
+
+struct fisb_reassembly {
+    unsigned timeout;
+    unsigned pending;
+
+    struct product **buckets;
+    unsigned bucket_mask;
+
+    struct product *newest;     // LRU list, most recently updated first
+    struct product *oldest;
+
+    struct product *free_products;
+    struct block *free_blocks;
+
+    struct fisb_reassembly_stats stats;
+};
+
+struct fisb_reassembly *fisb_reassembly_new(size_t memory_cap, unsigned timeout)
+{
+    struct fisb_reassembly *r;
+    struct product *products;
+    struct block *blocks;
+    size_t units, buckets, i;
+    uint8_t *arena;
+
+    // Each unit of space is a product record, a segment buffer and up to
+    // one hash bucket; there can't be more incomplete products than held
+    // segments, so this never runs out of records before buffers.
+    if (memory_cap < sizeof(*r))
+        units = 0;
+    else
+        units = (memory_cap - sizeof(*r)) / (sizeof(struct product) + sizeof(struct block) + sizeof(struct product *));
+
+    if (units == 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    for (buckets = 1; buckets * 2 <= units; buckets *= 2)
+        ;
+
+    arena = malloc(sizeof(*r) + buckets * sizeof(struct product *) + units * (sizeof(struct product) + sizeof(struct block)));
+    if (!arena)
+        return NULL;
+
+    r = (struct fisb_reassembly *) arena;
+    memset(r, 0, sizeof(*r));
+    r->timeout = timeout;
+
+    r->buckets = (struct product **) (arena + sizeof(*r));
+    r->bucket_mask = buckets - 1;
+    for (i = 0; i < buckets; ++i)
+        r->buckets[i] = NULL;
+
+    products = (struct product *) (r->buckets + buckets);
+    for (i = 0; i < units; ++i) {
+        products[i].hash_next = r->free_products;
+        r->free_products = &products[i];
+    }
+
+    blocks = (struct block *) (products + units);
+    for (i = 0; i < units; ++i) {
+        blocks[i].next = r->free_blocks;
+        r->free_blocks = &blocks[i];
+    }
+
+    return r;
+}
+
+void fisb_reassembly_free(struct fisb_reassembly *r)
+{
+    free(r); // everything else lives in the same arena
+}
+
+static int same_product(const struct fisb_apdu *a, const struct fisb_apdu *b)
+{
+    return (a->product_id == b->product_id &&
+            a->product_file_id == b->product_file_id &&
+            a->product_file_length == b->product_file_length &&
+            a->hours == b->hours &&
+            a->minutes == b->minutes &&
+            a->monthday_valid == b->monthday_valid &&
+            (!a->monthday_valid || (a->month == b->month && a->day == b->day)) &&
+            a->seconds_valid == b->seconds_valid &&
+            (!a->seconds_valid || a->seconds == b->seconds));
+}
+
+static struct product **bucket_for(struct fisb_reassembly *r, const struct fisb_apdu *apdu)
+{
+    uint32_t id = apdu->product_id | (apdu->product_file_id << 11) | (apdu->product_file_length << 21);
+    uint32_t t = apdu->minutes | (apdu->hours << 6);
+    uint32_t h;
+
+    if (apdu->monthday_valid)
+        t |= (apdu->day << 11) | (apdu->month << 16);
+    if (apdu->seconds_valid)
+        t |= apdu->seconds << 20;
+
+    h = id * 0x9e3779b1U ^ t * 0x85ebca6bU;
+    h ^= h >> 15;
+    return &r->buckets[h & r->bucket_mask];
+}
+
+static void lru_unlink(struct fisb_reassembly *r, struct product *p)
+{
+    if (p->newer)
+        p->newer->older = p->older;
+    else
+        r->newest = p->older;
+
+    if (p->older)
+        p->older->newer = p->newer;
+    else
+        r->oldest = p->newer;
+}
+
+static void lru_push(struct fisb_reassembly *r, struct product *p)
+{
+    p->newer = NULL;
+    p->older = r->newest;
+    if (r->newest)
+        r->newest->newer = p;
+    else
+        r->oldest = p;
+    r->newest = p;
+}
+
+// Forget an incomplete product, returning its space to the free lists
+static void release(struct fisb_reassembly *r, struct product *p)
+{
+    struct product **pp;
+    struct block *b, *next;
+
+    for (pp = bucket_for(r, &p->header); *pp != p; pp = &(*pp)->hash_next)
+        ;
+    *pp = p->hash_next;
+
+    lru_unlink(r, p);
+
+    for (b = p->blocks; b; b = next) {
+        next = b->next;
+        b->next = r->free_blocks;
+        r->free_blocks = b;
+    }
+
+    p->hash_next = r->free_products;
+    r->free_products = p;
+    --r->pending;
+}
+
+static void evict_oldest(struct fisb_reassembly *r)
+{
+    ++r->stats.evicted;
+    r->stats.dropped_segments += r->oldest->received;
+    release(r, r->oldest);
+}
+
+void fisb_reassembly_expire(struct fisb_reassembly *r, time_t now)
+{
+    if (!r->timeout)
+        return;
+
+    while (r->oldest && r->oldest->updated + (time_t) r->timeout <= now) {
+        ++r->stats.expired;
+        r->stats.dropped_segments += r->oldest->received;
+        release(r, r->oldest);
+    }
+}
+
+static void deliver(struct fisb_reassembly *r, struct product *p, fisb_product_handler_t handler, void *data)
+{
+    struct fisb_segment segments[512];
+    struct fisb_apdu header = p->header;
+    struct block *b;
+
+    header.data = NULL;
+    header.length = 0;
+    for (b = p->blocks; b; b = b->next) {
+        segments[b->number - 1].data = b->data;
+        segments[b->number - 1].length = b->length;
+    }
+
+    ++r->stats.completed;
+    handler(&header, segments, p->received, data);
+    release(r, p);
+}
+
+// Deliver a product that came in one piece
+static void deliver_single(const struct fisb_apdu *apdu, fisb_product_handler_t handler, void *data)
+{
+    struct fisb_segment segment = { apdu->data, apdu->length };
+    struct fisb_apdu header = *apdu;
+
+    header.data = NULL;
+    header.length = 0;
+    handler(&header, &segment, 1, data);
+}
+
+int fisb_reassembly_add(struct fisb_reassembly *r, const struct fisb_apdu *apdu, time_t now,
+                        fisb_product_handler_t handler, void *data)
+{
+    struct product **bucket, *p;
+    struct block *b;
+    unsigned n = apdu->apdu_number;
+
+    if (!apdu->s_flag) {
+        deliver_single(apdu, handler, data);
+        return 1;
+    }
+
+    ++r->stats.segments;
+    if (n == 0 || n > apdu->product_file_length || apdu->length > FISB_SEGMENT_MAX) {
+        ++r->stats.invalid;
+        return 0;
+    }
+
+    fisb_reassembly_expire(r, now);
+
+    if (apdu->product_file_length == 1) {
+        // nothing to wait for
+        ++r->stats.completed;
+        deliver_single(apdu, handler, data);
+        return 1;
+    }
+
+    bucket = bucket_for(r, apdu);
+    for (p = *bucket; p; p = p->hash_next) {
+        if (same_product(&p->header, apdu))
+            break;
+    }
+
+    if (p) {
+        lru_unlink(r, p);
+        if (p->have[n / 32] & (1U << (n % 32))) {
+            // still being sent, so keep it around
+            ++r->stats.duplicates;
+            p->updated = now;
+            lru_push(r, p);
+            return 0;
+        }
+    } else {
+        if (!r->free_products)
+            evict_oldest(r);
+
+        p = r->free_products;
+        r->free_products = p->hash_next;
+        p->hash_next = *bucket;
+        *bucket = p;
+
+        p->blocks = NULL;
+        p->header = *apdu;
+        p->received = 0;
+        memset(p->have, 0, sizeof(p->have));
+        ++r->pending;
+    }
+
+    p->updated = now;
+    lru_push(r, p);
+
+    while (!r->free_blocks) {
+        if (r->oldest == p) {
+            // this product alone fills the arena; it can never complete
+            ++r->stats.dropped_segments;
+            evict_oldest(r);
+            return 0;
+        }
+        evict_oldest(r);
+    }
+
+    b = r->free_blocks;
+    r->free_blocks = b->next;
+    b->next = p->blocks;
+    p->blocks = b;
+    b->number = n;
+    b->length = apdu->length;
+    memcpy(b->data, apdu->data, apdu->length);
+
+    p->have[n / 32] |= 1U << (n % 32);
+    if (++p->received == apdu->product_file_length) {
+        deliver(r, p, handler, data);
+        return 1;
+    }
+
+    return 0;
+}
+
+unsigned fisb_reassembly_pending(const struct fisb_reassembly *r)
+{
+    return r->pending;
+}
+
+const struct fisb_reassembly_stats *fisb_reassembly_stats(const struct fisb_reassembly *r)
+{
+    return &r->stats;
+}
@@ -0,0 +1,94 @@
+//
+// Copyright 2015, Oliver Jowett <oliver@mutability.co.uk>
+//
+
+// This file is free software: you may copy, redistribute and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 2 of the License, or (at your
+// option) any later version.
+//
+// This file is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef DUMP978_FISB_REASSEMBLY_H
+#define DUMP978_FISB_REASSEMBLY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "uat_decode.h"
+
+// Reassembly of segmented FIS-B products (APDUs with s_flag set).
+//
+// Segments are collected per product, keyed by product ID, product
+// file ID, product file length and product time, so the same product
+// heard from several ground stations is assembled once, with repeated
+// segments counted as duplicates. When the last segment arrives the
+// whole product is handed to a callback.
+//
+// All state lives in one arena of at most 'memory_cap' bytes,
+// allocated up front and carved into fixed-size segment buffers and
+// product records. When it is full, the least recently updated
+// incomplete product is evicted to make room; incomplete products
+// that see no new segment for 'timeout' seconds are expired.
+
+// The largest segment payload that can be held: a whole uplink
+// application data field, less the info frame and APDU headers.
+#define FISB_SEGMENT_MAX 416
+
+struct fisb_segment {
+    const uint8_t *data;
+    unsigned length;
+};
+
+struct fisb_reassembly_stats {
+    unsigned long segments;         // segmented APDUs added
+    unsigned long duplicates;       // segments that were already held
+    unsigned long invalid;          // segments with impossible numbering or length
+    unsigned long completed;        // products reassembled and delivered
+    unsigned long evicted;          // incomplete products evicted for space
+    unsigned long expired;          // incomplete products timed out
+    unsigned long dropped_segments; // segments discarded with evicted or expired products
+};
+
+// Called with a complete product: 'apdu' is the header of the first
+// segment received (with data NULL and length 0, as a product may be
+// larger than 64k), and 'segments' its 'count' payloads in order. The
+// payloads are only valid for the duration of the call, which must
+// not call back into the reassembly cache.
+typedef void (*fisb_product_handler_t)(const struct fisb_apdu *apdu,
+                                       const struct fisb_segment *segments,
+                                       unsigned count,
+                                       void *data);
+
+struct fisb_reassembly;
+
+// Create a reassembly cache using at most 'memory_cap' bytes;
+// 'timeout' of 0 disables expiry. Returns NULL on error with errno
+// set (EINVAL if memory_cap is too small to hold a single segment).
+struct fisb_reassembly *fisb_reassembly_new(size_t memory_cap, unsigned timeout);
+
+void fisb_reassembly_free(struct fisb_reassembly *r);
+
+// Add a decoded APDU received at time 'now'. Unsegmented APDUs are
+// passed straight to 'handler' as a single-segment product. Returns 1
+// if a product was delivered, 0 otherwise.
+int fisb_reassembly_add(struct fisb_reassembly *r, const struct fisb_apdu *apdu, time_t now,
+                        fisb_product_handler_t handler, void *data);
+
+// Expire incomplete products not updated since now - timeout. This is
+// also done by fisb_reassembly_add(), so is only needed when input is idle.
+void fisb_reassembly_expire(struct fisb_reassembly *r, time_t now);
+
+// Number of incomplete products currently held.
+unsigned fisb_reassembly_pending(const struct fisb_reassembly *r);
+
+const struct fisb_reassembly_stats *fisb_reassembly_stats(const struct fisb_reassembly *r);
+
+#endif
@@ -0,0 +1,546 @@
+//
+// Copyright 2015, Oliver Jowett <oliver@mutability.co.uk>
+//
+
+// This file is free software: you may copy, redistribute and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 2 of the License, or (at your
+// option) any later version.
+//
+// This file is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Check FIS-B segmented product reassembly: on the uplink messages read
+// from stdin (see "make test"), and on generated segments arriving out
+// of order, repeated, and in more products than fit in memory. Also
+// check that the dedup table finds exactly the repeated APDUs, and that
+// the segmentation header decodes after each kind of time field.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "uat.h"
+#include "uat_decode.h"
+#include "reader.h"
+#include "fisb_reassembly.h"
+#include "fisb_dedup.h"
+
+struct delivered {
+    int products;
+    int bad;
+    unsigned last_file_id;
+};
+
+// Generated segments: segment n of product file f has a length and
+// content that depend only on f and n
+static unsigned segment_length(unsigned f, unsigned n)
+{
+    return 100 + (f * 17 + n * 13) % 300;
+}
+
+static uint8_t segment_byte(unsigned f, unsigned n, unsigned i)
+{
+    return (f * 31 + n * 7 + i) & 0xff;
+}
+
+static void make_segment(struct fisb_apdu *apdu, uint8_t *buf, unsigned f, unsigned count, unsigned n)
+{
+    unsigned i;
+
+    memset(apdu, 0, sizeof(*apdu));
+    apdu->s_flag = 1;
+    apdu->product_id = 8;
+    apdu->hours = 12;
+    apdu->minutes = 34;
+    apdu->product_file_id = f;
+    apdu->product_file_length = count;
+    apdu->apdu_number = n;
+    apdu->length = segment_length(f, n);
+    for (i = 0; i < apdu->length; ++i)
+        buf[i] = segment_byte(f, n, i);
+    apdu->data = buf;
+}
+
+static void check_product(const struct fisb_apdu *apdu, const struct fisb_segment *segments, unsigned count, void *data)
+{
+    struct delivered *d = data;
+    unsigned f = apdu->product_file_id;
+    unsigned n, i;
+
+    ++d->products;
+    d->last_file_id = f;
+
+    if (count != apdu->product_file_length || apdu->data != NULL) {
+        ++d->bad;
+        return;
+    }
+
+    for (n = 1; n <= count; ++n) {
+        const struct fisb_segment *s = &segments[n - 1];
+        if (s->length != segment_length(f, n)) {
+            ++d->bad;
+            return;
+        }
+        for (i = 0; i < s->length; ++i) {
+            if (s->data[i] != segment_byte(f, n, i)) {
+                ++d->bad;
+                return;
+            }
+        }
+    }
+}
+
+static int add(struct fisb_reassembly *r, unsigned f, unsigned count, unsigned n, time_t now, struct delivered *d)
+{
+    struct fisb_apdu apdu;
+    uint8_t buf[FISB_SEGMENT_MAX];
+
+    make_segment(&apdu, buf, f, count, n);
+    return fisb_reassembly_add(r, &apdu, now, check_product, d);
+}
+
+static uint32_t xorshift(uint32_t *x)
+{
+    *x ^= *x << 13;
+    *x ^= *x >> 17;
+    *x ^= *x << 5;
+    return *x;
+}
+
+// Append the low 'bits' bits of 'value' to 'buf' at bit offset *pos
+static void put_bits(uint8_t *buf, unsigned *pos, unsigned bits, unsigned value)
+{
+    while (bits--) {
+        if ((value >> bits) & 1)
+            buf[*pos / 8] |= 0x80 >> (*pos % 8);
+        ++*pos;
+    }
+}
+
+// The segmentation fields follow time fields of a different length
+// for each time option, so the largest values must come through intact
+// whichever bytes they straddle
+static int check_segment_header(void)
+{
+    static const unsigned time_bits[4] = { 11, 17, 20, 26 };
+    unsigned t_opt;
+    int ok = 1;
+
+    for (t_opt = 0; t_opt < 4; ++t_opt) {
+        uint8_t data[32];
+        struct uat_uplink_info_frame frame;
+        struct fisb_apdu apdu;
+        unsigned pos = 0;
+
+        memset(data, 0, sizeof(data));
+        put_bits(data, &pos, 3, 0);          // A, G, P flags
+        put_bits(data, &pos, 11, 413);       // product ID
+        put_bits(data, &pos, 1, 1);          // S flag
+        put_bits(data, &pos, 2, t_opt);
+        put_bits(data, &pos, time_bits[t_opt], 0);
+        put_bits(data, &pos, 10, 1023);      // product file ID
+        put_bits(data, &pos, 9, 511);        // product file length
+        put_bits(data, &pos, 9, 257);        // APDU number
+        pos = (pos + 7) / 8 * 8;
+        put_bits(data, &pos, 8, 0xa5);       // first payload byte
+
+        memset(&frame, 0, sizeof(frame));
+        frame.type = 0;
+        frame.length = pos / 8 + 4;
+        frame.data = data;
+
+        if (!uat_decode_fisb_apdu(&frame, &apdu)) {
+            fprintf(stderr, "\n  t_opt %u: not decoded", t_opt);
+            ok = 0;
+        } else if (apdu.product_id != 413 || !apdu.s_flag ||
+                   apdu.product_file_id != 1023 || apdu.product_file_length != 511 ||
+                   apdu.apdu_number != 257 || apdu.data[0] != 0xa5) {
+            fprintf(stderr, "\n  t_opt %u: product %u file %u length %u APDU %u payload %02x",
+                    t_opt, apdu.product_id, apdu.product_file_id, apdu.product_file_length,
+                    apdu.apdu_number, apdu.data[0]);
+            ok = 0;
+        }
+    }
+
+    if (!ok)
+        fprintf(stderr, "\n");
+    return ok;
+}
+
+// Segments of many products, interleaved, shuffled and repeated; with
+// room for everything, each product must be delivered exactly once
+static int check_shuffled(void)
+{
+    enum { PRODUCTS = 200, MAX_SEGMENTS = 40 };
+    static struct { unsigned f, n; } order[PRODUCTS * MAX_SEGMENTS * 2];
+    static uint8_t seen[PRODUCTS][MAX_SEGMENTS + 1], done[PRODUCTS];
+    struct fisb_reassembly *r = fisb_reassembly_new(16 << 20, 0);
+    const struct fisb_reassembly_stats *stats;
+    struct delivered d = { 0, 0, 0 };
+    unsigned total = 0, repeats = 0, i, f, n;
+    uint32_t x = 1;
+    int ok;
+
+    if (!r) {
+        perror("fisb_reassembly_new");
+        return 0;
+    }
+
+    for (f = 0; f < PRODUCTS; ++f) {
+        unsigned count = 2 + f % (MAX_SEGMENTS - 1);
+        for (n = 1; n <= count; ++n) {
+            order[total].f = f;
+            order[total].n = n;
+            ++total;
+            if (xorshift(&x) % 4 == 0) {
+                order[total] = order[total - 1];
+                ++total;
+            }
+        }
+    }
+
+    for (i = total - 1; i > 0; --i) {
+        unsigned j = xorshift(&x) % (i + 1);
+        unsigned tf = order[i].f, tn = order[i].n;
+        order[i] = order[j];
+        order[j].f = tf;
+        order[j].n = tn;
+    }
+
+    for (i = 0; i < total; ++i) {
+        f = order[i].f;
+        n = order[i].n;
+        if (done[f])
+            continue; // a repeat now would start the product over
+        if (seen[f][n])
+            ++repeats;
+        seen[f][n] = 1;
+        if (add(r, f, 2 + f % (MAX_SEGMENTS - 1), n, 0, &d))
+            done[f] = 1;
+    }
+
+    stats = fisb_reassembly_stats(r);
+    ok = (!d.bad && d.products == PRODUCTS && stats->duplicates == repeats &&
+          !stats->evicted && !stats->invalid && !fisb_reassembly_pending(r));
+    if (!ok)
+        fprintf(stderr, "\n  %d products (%d bad), %lu duplicates of %u, %u pending, %lu evicted\n",
+                d.products, d.bad, stats->duplicates, repeats, fisb_reassembly_pending(r), stats->evicted);
+
+    fisb_reassembly_free(r);
+    return ok;
+}
+
+// Fill a small cache with half-complete products: the least recently
+// updated ones are evicted, and a product bigger than the whole cache
+// never completes but doesn't break anything
+static int check_eviction(void)
+{
+    struct fisb_reassembly *r = fisb_reassembly_new(64 << 10, 0);
+    const struct fisb_reassembly_stats *stats;
+    struct delivered d = { 0, 0, 0 };
+    unsigned f;
+    int ok = 1;
+
+    if (!r) {
+        perror("fisb_reassembly_new");
+        return 0;
+    }
+
+    for (f = 1; f <= 60; ++f)
+        add(r, f, 2, 1, 0, &d);
+    add(r, 1, 2, 1, 0, &d); // repeat, so product 1 is now the newest
+    for (f = 61; f <= 300; ++f)
+        add(r, f, 2, 1, 0, &d);
+
+    stats = fisb_reassembly_stats(r);
+    if (!stats->evicted || stats->dropped_segments != stats->evicted || stats->duplicates != 1) {
+        fprintf(stderr, "\n  %lu evicted, %lu segments dropped, %lu duplicates\n",
+                stats->evicted, stats->dropped_segments, stats->duplicates);
+        ok = 0;
+    }
+
+    if (add(r, 2, 2, 2, 0, &d)) {
+        fprintf(stderr, "\n  least recently updated product was not evicted\n");
+        ok = 0;
+    }
+    if (!add(r, 300, 2, 2, 0, &d) || d.last_file_id != 300) {
+        fprintf(stderr, "\n  most recently updated product was evicted\n");
+        ok = 0;
+    }
+
+    for (f = 1; f <= 500; ++f) {
+        if (add(r, 1000, 500, f, 0, &d)) {
+            fprintf(stderr, "\n  oversized product completed\n");
+            ok = 0;
+        }
+    }
+
+    if (add(r, 1001, 3, 3, 0, &d) || add(r, 1001, 3, 1, 0, &d) || !add(r, 1001, 3, 2, 0, &d) || d.bad) {
+        fprintf(stderr, "\n  product after an oversized one was not reassembled\n");
+        ok = 0;
+    }
+
+    fisb_reassembly_free(r);
+    return ok;
+}
+
+// Incomplete products time out after no new segments for the timeout
+static int check_expiry(void)
+{
+    struct fisb_reassembly *r = fisb_reassembly_new(1 << 20, 60);
+    const struct fisb_reassembly_stats *stats;
+    struct delivered d = { 0, 0, 0 };
+    int ok = 1;
+
+    if (!r) {
+        perror("fisb_reassembly_new");
+        return 0;
+    }
+
+    add(r, 1, 3, 1, 100, &d);
+    add(r, 2, 3, 1, 100, &d);
+    add(r, 2, 3, 2, 150, &d);
+    fisb_reassembly_expire(r, 159);
+    if (fisb_reassembly_pending(r) != 2)
+        ok = 0;
+    fisb_reassembly_expire(r, 160);
+    if (fisb_reassembly_pending(r) != 1)
+        ok = 0;
+    if (add(r, 1, 3, 2, 161, &d) || add(r, 1, 3, 3, 161, &d)) // product 1 started again
+        ok = 0;
+    if (!add(r, 2, 3, 3, 170, &d))
+        ok = 0;
+    if (add(r, 3, 3, 0, 170, &d) || add(r, 3, 3, 4, 170, &d))
+        ok = 0;
+
+    stats = fisb_reassembly_stats(r);
+    if (stats->expired != 1 || stats->dropped_segments != 1 || stats->completed != 1 || stats->invalid != 2 || d.bad)
+        ok = 0;
+
+    if (!ok)
+        fprintf(stderr, "\n  %lu expired, %lu dropped, %lu completed, %lu invalid, %u pending\n",
+                stats->expired, stats->dropped_segments, stats->completed, stats->invalid,
+                fisb_reassembly_pending(r));
+
+    fisb_reassembly_free(r);
+    return ok;
+}
+
+// Fill 'frames' with distinct random FIS-B info frames
+static void random_frames(struct uat_uplink_info_frame *frames, uint8_t (*data)[422], unsigned count, uint32_t seed)
+{
+    unsigned i, j;
+
+    for (i = 0; i < count; ++i) {
+        frames[i].type = 0;
+        frames[i].length = 100 + xorshift(&seed) % 300;
+        frames[i].data = data[i];
+        for (j = 0; j < frames[i].length; ++j)
+            data[i][j] = xorshift(&seed);
+        data[i][0] = i; // make sure they differ
+        data[i][1] = i >> 8;
+    }
+}
+
+// Repeats are found until their TTL runs out; overfilling the table
+// loses entries but never invents repeats
+static int check_dedup(void)
+{
+    enum { FRAMES = 500 };
+    static struct uat_uplink_info_frame frames[FRAMES];
+    static uint8_t data[FRAMES][422];
+    struct fisb_dedup *d = fisb_dedup_new(1024, 60);
+    const struct fisb_dedup_stats *stats;
+    unsigned i, hits[4] = { 0, 0, 0, 0 };
+    static const time_t when[4] = { 1000, 1010, 1060, 1061 };
+    int pass, ok;
+
+    if (!d) {
+        perror("fisb_dedup_new");
+        return 0;
+    }
+
+    random_frames(frames, data, FRAMES, 42);
+    for (pass = 0; pass < 4; ++pass) {
+        for (i = 0; i < FRAMES; ++i)
+            hits[pass] += fisb_dedup_seen(d, &frames[i], when[pass]);
+    }
+    ok = (hits[0] == 0 && hits[1] == FRAMES && hits[2] == 0 && hits[3] == FRAMES);
+    if (!ok)
+        fprintf(stderr, "\n  repeats found: %u, %u, %u, %u of %u\n",
+                hits[0], hits[1], hits[2], hits[3], FRAMES);
+    fisb_dedup_free(d);
+
+    d = fisb_dedup_new(64, 1000);
+    if (!d) {
+        perror("fisb_dedup_new");
+        return 0;
+    }
+    for (i = 0; i < FRAMES; ++i)
+        fisb_dedup_seen(d, &frames[i], 0);
+    stats = fisb_dedup_stats(d);
+    if (stats->hits || !stats->replaced) {
+        fprintf(stderr, "\n  overfilled table: %lu false repeats, %lu replaced\n", stats->hits, stats->replaced);
+        ok = 0;
+    }
+    fisb_dedup_free(d);
+
+    return ok;
+}
+
+#define MAX_SAMPLE_APDUS 10000
+
+struct sample {
+    struct fisb_reassembly *r;
+    int segmented;  // products delivered in more than one segment
+    int bad;
+
+    // every distinct FIS-B APDU so far, to check the dedup table against
+    struct fisb_dedup *dedup;
+    uint8_t (*apdus)[422];
+    uint16_t *apdu_lengths;
+    unsigned distinct;
+    unsigned repeats;
+    unsigned dedup_wrong;
+};
+
+static void check_repeat(struct sample *s, const struct uat_uplink_info_frame *info)
+{
+    unsigned i;
+    int repeat = 0;
+
+    for (i = 0; i < s->distinct; ++i) {
+        if (s->apdu_lengths[i] == info->length && !memcmp(s->apdus[i], info->data, info->length)) {
+            repeat = 1;
+            break;
+        }
+    }
+
+    if (repeat)
+        ++s->repeats;
+    else if (s->distinct < MAX_SAMPLE_APDUS) {
+        memcpy(s->apdus[s->distinct], info->data, info->length);
+        s->apdu_lengths[s->distinct++] = info->length;
+    }
+
+    if (fisb_dedup_seen(s->dedup, info, 0) != repeat)
+        ++s->dedup_wrong;
+}
+
+static void sample_product(const struct fisb_apdu *apdu, const struct fisb_segment *segments, unsigned count, void *data)
+{
+    struct sample *s = data;
+    unsigned i;
+
+    if (count < 2)
+        return;
+
+    ++s->segmented;
+    for (i = 0; i < count; ++i) {
+        if (!segments[i].data || !segments[i].length)
+            ++s->bad;
+    }
+}
+
+static void handle_frame(frame_type_t type, uint8_t *frame, int len, void *extra)
+{
+    struct sample *s = extra;
+    struct uat_uplink_iter iter;
+    struct uat_uplink_info_frame info;
+
+    if (type != UAT_UPLINK)
+        return;
+
+    uat_uplink_iter_init(&iter, frame);
+    while (uat_uplink_next_info_frame(&iter, &info)) {
+        if (uat_decode_fisb_apdu(&info, &info.fisb)) {
+            fisb_reassembly_add(s->r, &info.fisb, 0, sample_product, s);
+            check_repeat(s, &info);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    struct dump978_reader *reader;
+    struct sample sample;
+    int framecount;
+    int all_ok = 1;
+
+    fprintf(stderr, "FIS-B reassembly, messages on stdin: ");
+    memset(&sample, 0, sizeof(sample));
+    sample.r = fisb_reassembly_new(1 << 20, 0);
+    sample.dedup = fisb_dedup_new(FISB_DEDUP_DEFAULT_SLOTS, 3600);
+    sample.apdus = malloc(MAX_SAMPLE_APDUS * sizeof(*sample.apdus));
+    sample.apdu_lengths = malloc(MAX_SAMPLE_APDUS * sizeof(*sample.apdu_lengths));
+    reader = dump978_reader_new(0, 0);
+    if (!sample.r || !sample.dedup || !sample.apdus || !sample.apdu_lengths || !reader) {
+        perror("setup");
+        return 1;
+    }
+
+    while ((framecount = dump978_read_frames(reader, handle_frame, &sample)) > 0)
+        ;
+    dump978_reader_free(reader);
+
+    if (framecount < 0) {
+        perror("dump978_read_frames");
+        all_ok = 0;
+    } else if (sample.segmented == 0 || sample.bad) {
+        fprintf(stderr, "%d segmented products reassembled, %d bad segments\n", sample.segmented, sample.bad);
+        all_ok = 0;
+    } else {
+        fprintf(stderr, "PASS (%d segmented products)\n", sample.segmented);
+    }
+    fisb_reassembly_free(sample.r);
+
+    fprintf(stderr, "FIS-B dedup, messages on stdin: ");
+    if (framecount < 0 || sample.repeats == 0 || sample.dedup_wrong) {
+        fprintf(stderr, "%u of %u APDUs misjudged\n", sample.dedup_wrong, sample.distinct + sample.repeats);
+        all_ok = 0;
+    } else {
+        fprintf(stderr, "PASS (%u repeats of %u APDUs)\n", sample.repeats, sample.distinct + sample.repeats);
+    }
+    fisb_dedup_free(sample.dedup);
+    free(sample.apdus);
+    free(sample.apdu_lengths);
+
+    fprintf(stderr, "FIS-B segmentation header, all time options: ");
+    if (check_segment_header())
+        fprintf(stderr, "PASS\n");
+    else
+        all_ok = 0;
+
+    fprintf(stderr, "FIS-B reassembly, shuffled segments: ");
+    if (check_shuffled())
+        fprintf(stderr, "PASS\n");
+    else
+        all_ok = 0;
+
+    fprintf(stderr, "FIS-B reassembly, eviction: ");
+    if (check_eviction())
+        fprintf(stderr, "PASS\n");
+    else
+        all_ok = 0;
+
+    fprintf(stderr, "FIS-B reassembly, expiry: ");
+    if (check_expiry())
+        fprintf(stderr, "PASS\n");
+    else
+        all_ok = 0;
+
+    fprintf(stderr, "FIS-B dedup, random APDUs: ");
+    if (check_dedup())
+        fprintf(stderr, "PASS\n");
+    else
+        all_ok = 0;
+
+    return all_ok ? 0 : 1;
+}
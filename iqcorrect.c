@@ -0,0 +1,220 @@
+//
+// Copyright 2015, Oliver Jowett <oliver@mutability.co.uk>
+//
+
+// This file is free software: you may copy, redistribute and/or modify it  
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 2 of the License, or (at your  
+// option) any later version.  
+//
+// This file is distributed in the hope that it will be useful, but  
+// WITHOUT ANY WARRANTY; without even the implied warranty of  
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU  
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License  
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "iqcorrect.h"
+
+// Statistics are taken from every DECIMATION'th sample, and the
+// correction is re-estimated every WINDOW samples taken.
+#define DECIMATION 16
+#define WINDOW 131072
+
+// Don't bother rebuilding for smaller changes than these
+#define MIN_CENTER_CHANGE 0.05
+#define MIN_PHASE_CHANGE 0.002
+#define MIN_GAIN_CHANGE 0.002
+
+static uint16_t tables[2][PHASE_TABLE_SIZE];
+static struct iq_correction table_correction[2];
+
+// Used only by the converting thread
+static atomic_int current;           // index of the table in use (read by other threads)
+static int build_pending;            // a table is being built, or built but not yet in use
+static int skip;                     // samples to skip before the next one taken
+static struct {
+    unsigned n;
+    int64_t i, q, ii, qq, iq;
+} window;
+static atomic_uint_fast64_t corrected_from = UINT64_MAX;
+
+// Shared with the builder thread
+static pthread_mutex_t build_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t build_cond = PTHREAD_COND_INITIALIZER;
+static int build_requested;
+static atomic_int built = -1;        // index of a newly built table, or -1
+static atomic_uint rebuilds;
+
+static void build_table(uint16_t *table, const struct iq_correction *c)
+{
+    unsigned i,q;
+    union {
+        uint8_t iq[2];
+        uint16_t iq16;
+    } u;
+
+    for (i = 0; i < 256; ++i) {
+        double d_i = (i - c->i_center);
+        for (q = 0; q < 256; ++q) {
+            double d_q = (q - c->q_center - c->phase * d_i) / c->gain;
+            double ang = atan2(d_q, d_i) + M_PI; // atan2 returns [-pi..pi], normalize to [0..2*pi]
+            double scaled_ang = round(32768 * ang / M_PI);
+
+            u.iq[0] = i;
+            u.iq[1] = q;
+            table[u.iq16] = (scaled_ang < 0 ? 0 : scaled_ang > 65535 ? 65535 : (uint16_t)scaled_ang);
+        }
+    }
+
+    table[PHASE_TABLE_SIZE - 1] = 0;
+}
+
+static void *builder_thread(void *arg)
+{
+    for (;;) {
+        int target;
+
+        pthread_mutex_lock(&build_lock);
+        while (!build_requested)
+            pthread_cond_wait(&build_cond, &build_lock);
+        build_requested = 0;
+        pthread_mutex_unlock(&build_lock);
+
+        // The converting thread is using the other table, and
+        // won't request another build until it has switched to this one.
+        target = 1 - current;
+        build_table(tables[target], &table_correction[target]);
+        atomic_fetch_add(&rebuilds, 1);
+        atomic_store_explicit(&built, target, memory_order_release);
+    }
+
+    return NULL;
+}
+
+void iqcorrect_init(int enabled)
+{
+    static const struct iq_correction none = { 127.5, 127.5, 0.0, 1.0 };
+    pthread_t thread;
+    int err;
+
+    table_correction[0] = none;
+    build_table(tables[0], &none);
+
+    if (!enabled)
+        return;
+
+    if ((err = pthread_create(&thread, NULL, builder_thread, NULL))) {
+        fprintf(stderr, "pthread_create: %s\n", strerror(err));
+        exit(1);
+    }
+    pthread_detach(thread);
+}
+
+// Estimate the correction from the current window of samples.
+// Returns 0 if the estimate is unusable.
+static int estimate(struct iq_correction *c)
+{
+    double n = window.n;
+    double var_i, var_q, cov;
+
+    c->i_center = window.i / n;
+    c->q_center = window.q / n;
+    var_i = window.ii / n - c->i_center * c->i_center;
+    var_q = window.qq / n - c->q_center * c->q_center;
+    cov = window.iq / n - c->i_center * c->q_center;
+
+    if (var_i < 1.0 || var_q < 1.0)
+        return 0; // no signal to speak of
+
+    c->phase = cov / var_i;
+    c->gain = var_q / var_i - c->phase * c->phase;
+    if (c->gain <= 0)
+        return 0;
+    c->gain = sqrt(c->gain);
+
+    // anything beyond these is more likely to be a strong
+    // signal than a fault in the receiver
+    return (fabs(c->i_center - 127.5) < 32 && fabs(c->q_center - 127.5) < 32 &&
+            fabs(c->phase) < 0.5 && c->gain > 0.5 && c->gain < 2.0);
+}
+
+static void maybe_rebuild(void)
+{
+    const struct iq_correction *old = &table_correction[current];
+    struct iq_correction c;
+
+    if (!estimate(&c))
+        return;
+
+    if (fabs(c.i_center - old->i_center) < MIN_CENTER_CHANGE &&
+        fabs(c.q_center - old->q_center) < MIN_CENTER_CHANGE &&
+        fabs(c.phase - old->phase) < MIN_PHASE_CHANGE &&
+        fabs(c.gain - old->gain) < MIN_GAIN_CHANGE)
+        return;
+
+    table_correction[1 - current] = c;
+    build_pending = 1;
+
+    pthread_mutex_lock(&build_lock);
+    build_requested = 1;
+    pthread_cond_signal(&build_cond);
+    pthread_mutex_unlock(&build_lock);
+}
+
+void iqcorrect_observe(const uint16_t *samples, int n)
+{
+    const uint8_t *iq = (const uint8_t *) samples;
+    int k;
+
+    for (k = skip; k < n; k += DECIMATION) {
+        int i = iq[k*2], q = iq[k*2+1];
+
+        window.i += i;
+        window.q += q;
+        window.ii += i * i;
+        window.qq += q * q;
+        window.iq += i * q;
+
+        if (++window.n == WINDOW) {
+            if (!build_pending)
+                maybe_rebuild();
+            memset(&window, 0, sizeof(window));
+        }
+    }
+    skip = k - n;
+}
+
+const uint16_t *iqcorrect_table(uint64_t offset)
+{
+    int index = atomic_exchange_explicit(&built, -1, memory_order_acquire);
+
+    if (index >= 0) {
+        current = index;
+        build_pending = 0;
+        if (atomic_load(&corrected_from) == UINT64_MAX)
+            atomic_store(&corrected_from, offset);
+    }
+
+    return tables[current];
+}
+
+uint64_t iqcorrect_corrected_from(void)
+{
+    return atomic_load(&corrected_from);
+}
+
+void iqcorrect_current(struct iq_correction *c, unsigned *n)
+{
+    *c = table_correction[current];
+    *n = atomic_load(&rebuilds);
+}
@@ -0,0 +1,62 @@
+//
+// Copyright 2015, Oliver Jowett <oliver@mutability.co.uk>
+//
+
+// This file is free software: you may copy, redistribute and/or modify it  
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 2 of the License, or (at your  
+// option) any later version.  
+//
+// This file is distributed in the hope that it will be useful, but  
+// WITHOUT ANY WARRANTY; without even the implied warranty of  
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU  
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License  
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef DUMP978_IQCORRECT_H
+#define DUMP978_IQCORRECT_H
+
+#include <stdint.h>
+
+// The I/Q sample -> phase lookup table, with optional correction
+// for the receiver's DC offset and IQ imbalance.
+//
+// The correction is estimated from the raw samples passed to
+// iqcorrect_observe(). When it changes, a background thread builds
+// a corrected table into whichever of two buffers is not in use;
+// iqcorrect_table() then switches to it. Only one thread may call
+// iqcorrect_observe() and iqcorrect_table().
+
+// Number of entries in a phase table: one per sample pair,
+// plus a spare entry (see kernels.convert_phi)
+#define PHASE_TABLE_SIZE (65536+1)
+
+struct iq_correction {
+    double i_center;    // mean I sample value
+    double q_center;    // mean Q sample value
+    double phase;       // correlation of Q with I, relative to I's power
+    double gain;        // amplitude of Q (less the I component), relative to I
+};
+
+// Build the initial, uncorrected, table. If 'enabled' is set, also
+// start the thread that builds corrected tables.
+void iqcorrect_init(int enabled);
+
+// Accumulate statistics from 'n' raw I/Q sample pairs.
+void iqcorrect_observe(const uint16_t *samples, int n);
+
+// Return the table to use to convert samples starting at sample
+// offset 'offset', switching to a newly built one if there is one.
+const uint16_t *iqcorrect_table(uint64_t offset);
+
+// Return the offset of the first sample converted with a corrected
+// table, or UINT64_MAX if there is none yet.
+uint64_t iqcorrect_corrected_from(void);
+
+// Return the correction used by the current table, and the
+// number of corrected tables built so far.
+void iqcorrect_current(struct iq_correction *c, unsigned *rebuilds);
+
+#endif
@@ -0,0 +1,688 @@
+//
+// Copyright 2015, Oliver Jowett <oliver@mutability.co.uk>
+//
+
+// This file is free software: you may copy, redistribute and/or modify it  
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 2 of the License, or (at your  
+// option) any later version.  
+//
+// This file is distributed in the hope that it will be useful, but  
+// WITHOUT ANY WARRANTY; without even the implied warranty of  
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU  
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License  
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define KERNELS_X86
+#include <immintrin.h>
+#endif
+
+#include "fec.h"
+#include "kernels.h"
+
+struct kernels kernels;
+
+//
+// Phase conversion
+//
+
+static void convert_phi_generic(uint16_t *buffer, int n, const uint16_t *table)
+{
+    int i;
+
+    // unroll the loop. n is usually 36864, or 1024 in low latency mode
+    for (i = 0; i+8 <= n; i += 8) {
+        buffer[i] = table[buffer[i]];
+        buffer[i+1] = table[buffer[i+1]];
+        buffer[i+2] = table[buffer[i+2]];
+        buffer[i+3] = table[buffer[i+3]];
+        buffer[i+4] = table[buffer[i+4]];
+        buffer[i+5] = table[buffer[i+5]];
+        buffer[i+6] = table[buffer[i+6]];
+        buffer[i+7] = table[buffer[i+7]];
+    }
+    for (; i < n; ++i)
+        buffer[i] = table[buffer[i]];
+}
+
+#ifdef KERNELS_X86
+// 16 lookups at a time with gathers. A gather reads 32 bits, so the
+// lookup of the last entry also reads the spare entry after it.
+__attribute__((target("avx2")))
+static void convert_phi_avx2(uint16_t *buffer, int n, const uint16_t *table)
+{
+    const __m256i mask = _mm256_set1_epi32(0xFFFF);
+    int i;
+
+    for (i = 0; i+16 <= n; i += 16) {
+        __m256i in = _mm256_loadu_si256((const __m256i *) (buffer + i));
+        __m256i lo = _mm256_cvtepu16_epi32(_mm256_castsi256_si128(in));
+        __m256i hi = _mm256_cvtepu16_epi32(_mm256_extracti128_si256(in, 1));
+
+        lo = _mm256_and_si256(_mm256_i32gather_epi32((const int *) table, lo, 2), mask);
+        hi = _mm256_and_si256(_mm256_i32gather_epi32((const int *) table, hi, 2), mask);
+
+        // packus works within 128-bit lanes; put the quadwords back in order
+        _mm256_storeu_si256((__m256i *) (buffer + i),
+                            _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), 0xD8));
+    }
+    for (; i < n; ++i)
+        buffer[i] = table[buffer[i]];
+}
+#endif
+
+//
+// Sync search
+//
+
+static int sync_search_generic(const uint16_t *phi, int bit, int len,
+                               uint64_t *sync0_p, uint64_t *sync1_p,
+                               const uint64_t *words, int nwords)
+{
+    uint64_t sync0 = *sync0_p, sync1 = *sync1_p;
+    int w;
+
+    for (; bit*2+2 < len; ++bit) {
+        int16_t dphi0 = phi_difference(phi[bit*2], phi[bit*2+1]);
+        int16_t dphi1 = phi_difference(phi[bit*2+1], phi[bit*2+2]);
+
+        sync0 = (sync0 << 1) | (dphi0 > 0 ? 1 : 0);
+        sync1 = (sync1 << 1) | (dphi1 > 0 ? 1 : 0);
+
+        if (bit < SYNC_BITS)
+            continue; // haven't fully populated sync0/1 yet
+
+        for (w = 0; w < nwords; ++w) {
+            if (sync_word_fuzzy_compare(sync0 & SYNC_MASK, words[w]) ||
+                sync_word_fuzzy_compare(sync1 & SYNC_MASK, words[w]))
+                goto found;
+        }
+    }
+
+ found:
+    *sync0_p = sync0;
+    *sync1_p = sync1;
+    return bit;
+}
+
+#ifdef KERNELS_X86
+__attribute__((target("popcnt")))
+static int sync_search_popcnt(const uint16_t *phi, int bit, int len,
+                              uint64_t *sync0_p, uint64_t *sync1_p,
+                              const uint64_t *words, int nwords)
+{
+    uint64_t sync0 = *sync0_p, sync1 = *sync1_p;
+    int w;
+
+    for (; bit*2+2 < len; ++bit) {
+        int16_t dphi0 = phi_difference(phi[bit*2], phi[bit*2+1]);
+        int16_t dphi1 = phi_difference(phi[bit*2+1], phi[bit*2+2]);
+
+        sync0 = (sync0 << 1) | (dphi0 > 0 ? 1 : 0);
+        sync1 = (sync1 << 1) | (dphi1 > 0 ? 1 : 0);
+
+        if (bit < SYNC_BITS)
+            continue; // haven't fully populated sync0/1 yet
+
+        for (w = 0; w < nwords; ++w) {
+            if (__builtin_popcountll((sync0 ^ words[w]) & SYNC_MASK) <= MAX_SYNC_ERRORS ||
+                __builtin_popcountll((sync1 ^ words[w]) & SYNC_MASK) <= MAX_SYNC_ERRORS)
+                goto found;
+        }
+    }
+
+ found:
+    *sync0_p = sync0;
+    *sync1_p = sync1;
+    return bit;
+}
+#endif
+
+//
+// Bit slicing and syndromes
+//
+// Each slicer is a function to slice one byte; each syndrome
+// implementation is a state type with load/update/store functions.
+// SLICE_KERNEL combines one of each into a slice kernel, so that the
+// syndromes are updated while the byte is still in a register.
+//
+
+static inline uint8_t slice_byte_generic(const uint16_t *phi, int16_t center)
+{
+    uint8_t b = 0;
+    if (phi_difference(phi[0], phi[1]) > center) b |= 0x80;
+    if (phi_difference(phi[2], phi[3]) > center) b |= 0x40;
+    if (phi_difference(phi[4], phi[5]) > center) b |= 0x20;
+    if (phi_difference(phi[6], phi[7]) > center) b |= 0x10;
+    if (phi_difference(phi[8], phi[9]) > center) b |= 0x08;
+    if (phi_difference(phi[10], phi[11]) > center) b |= 0x04;
+    if (phi_difference(phi[12], phi[13]) > center) b |= 0x02;
+    if (phi_difference(phi[14], phi[15]) > center) b |= 0x01;
+    return b;
+}
+
+typedef struct {
+    uint8_t s[FEC_MAX_ROOTS];
+    int nroots;
+} table_syndromes;
+
+static inline void table_load(table_syndromes *st, const uint8_t *syndromes, int nroots)
+{
+    memcpy(st->s, syndromes, nroots);
+    st->nroots = nroots;
+}
+
+static inline void table_update(table_syndromes *st, uint8_t byte)
+{
+    fec_syndrome_update(st->s, st->nroots, byte);
+}
+
+static inline void table_store(table_syndromes *st, uint8_t *syndromes)
+{
+    memcpy(syndromes, st->s, st->nroots);
+}
+
+#ifdef KERNELS_X86
+// Bit reversal of the SSE2 slicer's movemask result
+static uint8_t reverse_bits[256];
+
+__attribute__((always_inline, target("sse2")))
+static inline uint8_t slice_byte_sse2(const uint16_t *phi, int16_t center)
+{
+    __m128i a = _mm_loadu_si128((const __m128i *) phi);
+    __m128i b = _mm_loadu_si128((const __m128i *) (phi + 8));
+    __m128i dphi, gt;
+
+    // each 32-bit lane holds one sample pair; put the (wrapped)
+    // difference between them in the high half, then sign-extend it
+    a = _mm_srai_epi32(_mm_sub_epi16(a, _mm_slli_epi32(a, 16)), 16);
+    b = _mm_srai_epi32(_mm_sub_epi16(b, _mm_slli_epi32(b, 16)), 16);
+    dphi = _mm_packs_epi32(a, b);
+
+    gt = _mm_cmpgt_epi16(dphi, _mm_set1_epi16(center));
+    return reverse_bits[_mm_movemask_epi8(_mm_packs_epi16(gt, gt)) & 0xFF];
+}
+
+// All syndromes in one register, one per byte lane. Multiplying by
+// a constant is linear over GF(2), so the product is the XOR of the
+// products of each set bit, which are precomputed per lane.
+typedef struct {
+    __m256i s;
+    int nroots;
+} avx2_syndromes;
+
+static uint8_t syndrome_bit_mul[8][32] __attribute__((aligned(32)));
+
+__attribute__((always_inline, target("avx2")))
+static inline void avx2_load(avx2_syndromes *st, const uint8_t *syndromes, int nroots)
+{
+    uint8_t tmp[32] = { 0 };
+    memcpy(tmp, syndromes, nroots);
+    st->s = _mm256_loadu_si256((const __m256i *) tmp);
+    st->nroots = nroots;
+}
+
+__attribute__((always_inline, target("avx2")))
+static inline void avx2_update(avx2_syndromes *st, uint8_t byte)
+{
+    __m256i s = st->s;
+    __m256i acc = _mm256_set1_epi8(byte);
+    int bit;
+
+    // examine each bit of each syndrome in the top bit of its lane
+    for (bit = 7; bit >= 0; --bit) {
+        __m256i mul = _mm256_load_si256((const __m256i *) syndrome_bit_mul[bit]);
+        acc = _mm256_xor_si256(acc, _mm256_blendv_epi8(_mm256_setzero_si256(), mul, s));
+        s = _mm256_add_epi8(s, s);
+    }
+
+    st->s = acc;
+}
+
+__attribute__((always_inline, target("avx2")))
+static inline void avx2_store(avx2_syndromes *st, uint8_t *syndromes)
+{
+    uint8_t tmp[32];
+    _mm256_storeu_si256((__m256i *) tmp, st->s);
+    memcpy(syndromes, tmp, st->nroots);
+}
+#endif
+
+#define SLICE_KERNEL(name, target, slicer, syndromes)                    \
+    target                                                              \
+    static void name(const uint16_t *phi, int stride, int bytes, int16_t center, \
+                     uint8_t *out, uint8_t *syndromes_out, int nroots)  \
+    {                                                                   \
+        syndromes##_syndromes st;                                       \
+        int i;                                                          \
+                                                                        \
+        syndromes##_load(&st, syndromes_out, nroots);                   \
+        for (i = 0; i < bytes; ++i, phi += stride * 16) {               \
+            out[i] = slice_byte_##slicer(phi, center);                  \
+            syndromes##_update(&st, out[i]);                            \
+        }                                                               \
+        syndromes##_store(&st, syndromes_out);                          \
+    }
+
+SLICE_KERNEL(slice_generic_table, , generic, table)
+#ifdef KERNELS_X86
+SLICE_KERNEL(slice_sse2_table, __attribute__((target("sse2"))), sse2, table)
+SLICE_KERNEL(slice_generic_avx2, __attribute__((target("avx2"))), generic, avx2)
+SLICE_KERNEL(slice_sse2_avx2, __attribute__((target("avx2"))), sse2, avx2)
+#endif
+
+//
+// Hex encoding
+//
+
+static const char hex_digits[16] = "0123456789abcdef";
+
+static char *hex_encode_generic(char *out, const uint8_t *data, int len)
+{
+    while (--len >= 0) {
+        *out++ = hex_digits[*data >> 4];
+        *out++ = hex_digits[*data & 15];
+        ++data;
+    }
+    return out;
+}
+
+#ifdef KERNELS_X86
+__attribute__((target("ssse3")))
+static char *hex_encode_ssse3(char *out, const uint8_t *data, int len)
+{
+    const __m128i digits = _mm_loadu_si128((const __m128i *) hex_digits);
+    const __m128i nibble = _mm_set1_epi8(15);
+
+    for (; len >= 16; len -= 16, data += 16, out += 32) {
+        __m128i in = _mm_loadu_si128((const __m128i *) data);
+        __m128i hi = _mm_shuffle_epi8(digits, _mm_and_si128(_mm_srli_epi16(in, 4), nibble));
+        __m128i lo = _mm_shuffle_epi8(digits, _mm_and_si128(in, nibble));
+        _mm_storeu_si128((__m128i *) out, _mm_unpacklo_epi8(hi, lo));
+        _mm_storeu_si128((__m128i *) (out + 16), _mm_unpackhi_epi8(hi, lo));
+    }
+
+    return hex_encode_generic(out, data, len);
+}
+#endif
+
+//
+// Selection
+//
+
+enum { K_PHASE, K_SYNC, K_SLICE, K_SYNDROME, K_HEX, K_COUNT };
+
+struct implementation {
+    const char *name;
+    const char *feature;  // for __builtin_cpu_supports, or NULL
+};
+
+static const struct implementation phase_impls[] = {
+    { "generic", NULL },
+#ifdef KERNELS_X86
+    { "avx2", "avx2" },
+#endif
+    { NULL, NULL }
+};
+
+static const struct implementation sync_impls[] = {
+    { "generic", NULL },
+#ifdef KERNELS_X86
+    { "popcnt", "popcnt" },
+#endif
+    { NULL, NULL }
+};
+
+static const struct implementation slice_impls[] = {
+    { "generic", NULL },
+#ifdef KERNELS_X86
+    { "sse2", "sse2" },
+#endif
+    { NULL, NULL }
+};
+
+static const struct implementation syndrome_impls[] = {
+    { "table", NULL },
+#ifdef KERNELS_X86
+    { "avx2", "avx2" },
+#endif
+    { NULL, NULL }
+};
+
+static const struct implementation hex_impls[] = {
+    { "generic", NULL },
+#ifdef KERNELS_X86
+    { "ssse3", "ssse3" },
+#endif
+    { NULL, NULL }
+};
+
+static struct {
+    const char *name;
+    const struct implementation *impls;
+    int chosen;
+    int forced;
+} kernel_table[K_COUNT] = {
+    { "phase", phase_impls, 0, 0 },
+    { "sync", sync_impls, 0, 0 },
+    { "slice", slice_impls, 0, 0 },
+    { "syndrome", syndrome_impls, 0, 0 },
+    { "hex", hex_impls, 0, 0 },
+};
+
+static int benchmarked = 0;
+
+static int supported(const struct implementation *impl)
+{
+    if (!impl->feature)
+        return 1;
+#ifdef KERNELS_X86
+    __builtin_cpu_init();
+    if (!strcmp(impl->feature, "avx2"))
+        return __builtin_cpu_supports("avx2");
+    if (!strcmp(impl->feature, "popcnt"))
+        return __builtin_cpu_supports("popcnt");
+    if (!strcmp(impl->feature, "sse2"))
+        return __builtin_cpu_supports("sse2");
+    if (!strcmp(impl->feature, "ssse3"))
+        return __builtin_cpu_supports("ssse3");
+#endif
+    return 0;
+}
+
+// Point 'kernels' at the chosen implementations
+static void install_kernels(void)
+{
+    int slice = kernel_table[K_SLICE].chosen;
+    int syndrome = kernel_table[K_SYNDROME].chosen;
+
+    kernels.convert_phi = convert_phi_generic;
+    kernels.sync_search = sync_search_generic;
+    kernels.slice = slice_generic_table;
+    kernels.hex_encode = hex_encode_generic;
+
+#ifdef KERNELS_X86
+    if (kernel_table[K_PHASE].chosen == 1)
+        kernels.convert_phi = convert_phi_avx2;
+    if (kernel_table[K_SYNC].chosen == 1)
+        kernels.sync_search = sync_search_popcnt;
+    if (slice == 1 && syndrome == 0)
+        kernels.slice = slice_sse2_table;
+    else if (slice == 0 && syndrome == 1)
+        kernels.slice = slice_generic_avx2;
+    else if (slice == 1 && syndrome == 1)
+        kernels.slice = slice_sse2_avx2;
+    if (kernel_table[K_HEX].chosen == 1)
+        kernels.hex_encode = hex_encode_ssse3;
+#else
+    (void) slice;
+    (void) syndrome;
+#endif
+}
+
+//
+// Benchmarks. Each runs one kernel over synthetic data and returns a
+// checksum of the result, which must match the generic version's.
+//
+
+#define BENCH_SAMPLES 16384
+
+static const uint16_t *bench_table;
+static uint16_t bench_iq[BENCH_SAMPLES];
+static uint16_t bench_phi[BENCH_SAMPLES];
+
+static uint32_t checksum(uint32_t sum, const void *data, size_t len)
+{
+    const uint8_t *p = data;
+    while (len--)
+        sum = (sum * 31) + *p++;
+    return sum;
+}
+
+static uint32_t bench_phase(void)
+{
+    uint16_t buf[BENCH_SAMPLES];
+
+    memcpy(buf, bench_iq, sizeof(buf));
+    kernels.convert_phi(buf, BENCH_SAMPLES, bench_table);
+    return checksum(0, buf, sizeof(buf));
+}
+
+static uint32_t bench_sync(void)
+{
+    static const uint64_t words[2] = { 0xEACDDA4E2ULL, 0x153225B1DULL };
+    uint64_t sync0 = 0, sync1 = 0;
+    uint32_t sum = 0;
+    int bit = 0;
+
+    while ((bit = kernels.sync_search(bench_phi, bit, BENCH_SAMPLES, &sync0, &sync1, words, 2)) * 2 + 2 < BENCH_SAMPLES) {
+        sum = checksum(sum, &bit, sizeof(bit));
+        ++bit;
+    }
+
+    return checksum(sum, &sync0, sizeof(sync0));
+}
+
+static uint32_t bench_slice(void)
+{
+    uint8_t out[BENCH_SAMPLES / 16];
+    uint8_t syndromes[FEC_MAX_ROOTS] = { 0 };
+    uint32_t sum;
+
+    kernels.slice(bench_phi, 1, BENCH_SAMPLES / 16 - 1, 0, out, syndromes, UPLINK_ROOTS);
+    sum = checksum(0, out, BENCH_SAMPLES / 16 - 1);
+    return checksum(sum, syndromes, UPLINK_ROOTS);
+}
+
+static uint32_t bench_hex(void)
+{
+    char out[BENCH_SAMPLES * 2];
+    char *end = kernels.hex_encode(out, (const uint8_t *) bench_phi, BENCH_SAMPLES - 3);
+    return checksum(0, out, end - out);
+}
+
+static uint32_t (*const benchmarks[K_COUNT])(void) = {
+    bench_phase, bench_sync, bench_slice, bench_slice, bench_hex
+};
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Return the best time of a few runs of benchmark 'k'
+static double time_benchmark(int k)
+{
+    double best = 1e9;
+    int i;
+
+    for (i = 0; i < 20; ++i) {
+        double start = now();
+        double elapsed;
+        benchmarks[k]();
+        elapsed = now() - start;
+        if (elapsed < best)
+            best = elapsed;
+    }
+
+    return best;
+}
+
+static void run_benchmarks(void)
+{
+    uint32_t state = 0x12345678;
+    int i, k;
+
+    for (i = 0; i < BENCH_SAMPLES; ++i) {
+        // xorshift32
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        bench_iq[i] = state;
+        bench_phi[i] = bench_table[bench_iq[i]];
+    }
+
+    for (k = 0; k < K_COUNT; ++k) {
+        const struct implementation *impls = kernel_table[k].impls;
+        uint32_t expected;
+        double best_time = 0;
+        int best = -1;
+
+        if (kernel_table[k].forced)
+            continue;
+
+        kernel_table[k].chosen = 0;
+        install_kernels();
+        expected = benchmarks[k]();
+
+        for (i = 0; impls[i].name; ++i) {
+            double t;
+
+            if (!supported(&impls[i]))
+                continue;
+
+            kernel_table[k].chosen = i;
+            install_kernels();
+            if (benchmarks[k]() != expected) {
+                fprintf(stderr, "dump978: %s kernel %s gives wrong results, not using it\n",
+                        kernel_table[k].name, impls[i].name);
+                continue;
+            }
+
+            t = time_benchmark(k);
+            if (best < 0 || t < best_time) {
+                best = i;
+                best_time = t;
+            }
+        }
+
+        kernel_table[k].chosen = best;
+        install_kernels();
+    }
+
+    benchmarked = 1;
+}
+
+static void init_tables(void)
+{
+#ifdef KERNELS_X86
+    int i, bit;
+
+    for (i = 0; i < 256; ++i) {
+        reverse_bits[i] = 0;
+        for (bit = 0; bit < 8; ++bit)
+            if (i & (1 << bit))
+                reverse_bits[i] |= 0x80 >> bit;
+    }
+
+    for (bit = 0; bit < 8; ++bit)
+        for (i = 0; i < 32; ++i)
+            syndrome_bit_mul[bit][i] = (i < FEC_MAX_ROOTS ? fec_syndrome_mul[i][1 << bit] : 0);
+#endif
+}
+
+int kernels_init(const char *spec, const uint16_t *phase_table)
+{
+    int k, i, bench = 0;
+    char *copy, *item;
+
+    init_tables();
+    bench_table = phase_table;
+
+    // default: the last (most preferred) supported implementation
+    for (k = 0; k < K_COUNT; ++k) {
+        for (i = 0; kernel_table[k].impls[i].name; ++i)
+            if (supported(&kernel_table[k].impls[i]))
+                kernel_table[k].chosen = i;
+    }
+
+    copy = strdup(spec ? spec : "");
+    for (item = strtok(copy, ","); item; item = strtok(NULL, ",")) {
+        char *impl = strchr(item, '=');
+
+        if (!strcmp(item, "bench")) {
+            bench = 1;
+            continue;
+        }
+
+        if (!impl) {
+            fprintf(stderr, "dump978: bad kernel choice '%s': expected <kernel>=<implementation> or bench\n", item);
+            free(copy);
+            return 0;
+        }
+
+        *impl++ = 0;
+        for (k = 0; k < K_COUNT; ++k)
+            if (!strcmp(item, kernel_table[k].name))
+                break;
+        if (k == K_COUNT) {
+            fprintf(stderr, "dump978: unknown kernel '%s'\n", item);
+            free(copy);
+            return 0;
+        }
+
+        for (i = 0; kernel_table[k].impls[i].name; ++i)
+            if (!strcmp(impl, kernel_table[k].impls[i].name))
+                break;
+        if (!kernel_table[k].impls[i].name) {
+            fprintf(stderr, "dump978: unknown %s kernel implementation '%s'\n", item, impl);
+            free(copy);
+            return 0;
+        }
+        if (!supported(&kernel_table[k].impls[i])) {
+            fprintf(stderr, "dump978: %s kernel implementation '%s' is not supported by this CPU\n", item, impl);
+            free(copy);
+            return 0;
+        }
+
+        kernel_table[k].chosen = i;
+        kernel_table[k].forced = 1;
+    }
+    free(copy);
+
+    install_kernels();
+    if (bench)
+        run_benchmarks();
+
+    return 1;
+}
+
+void kernels_list(FILE *f)
+{
+    int k, i;
+
+    for (k = 0; k < K_COUNT; ++k) {
+        fprintf(f, "%-10s", kernel_table[k].name);
+        for (i = 0; kernel_table[k].impls[i].name; ++i)
+            fprintf(f, " %s%s", kernel_table[k].impls[i].name,
+                    supported(&kernel_table[k].impls[i]) ? "" : " (unsupported)");
+        fprintf(f, "\n");
+    }
+}
+
+const char *kernels_describe(void)
+{
+    static char buf[256];
+    int k, used = 0;
+
+    for (k = 0; k < K_COUNT; ++k)
+        used += snprintf(buf + used, sizeof(buf) - used, "%s%s=%s",
+                         k ? " " : "", kernel_table[k].name,
+                         kernel_table[k].impls[kernel_table[k].chosen].name);
+
+    if (benchmarked)
+        snprintf(buf + used, sizeof(buf) - used, " (benchmarked)");
+
+    return buf;
+}
@@ -0,0 +1,155 @@
+//
+// Copyright 2015, Oliver Jowett <oliver@mutability.co.uk>
+//
+
+// This file is free software: you may copy, redistribute and/or modify it  
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 2 of the License, or (at your  
+// option) any later version.  
+//
+// This file is distributed in the hope that it will be useful, but  
+// WITHOUT ANY WARRANTY; without even the implied warranty of  
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU  
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License  
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef DUMP978_KERNELS_H
+#define DUMP978_KERNELS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define SYNC_BITS (36)
+#define SYNC_MASK ((((uint64_t)1)<<SYNC_BITS)-1)
+#define MAX_SYNC_ERRORS 4
+
+// relying on signed overflow is theoretically bad. Let's do it properly.
+
+#ifdef USE_SIGNED_OVERFLOW
+#define phi_difference(from,to) ((int16_t)((to) - (from)))
+#else
+static inline int16_t phi_difference(uint16_t from, uint16_t to)
+{
+    int32_t difference = to - from; // lies in the range -65535 .. +65535
+    if (difference >= 32768)        //   +32768..+65535
+        return difference - 65536;  //   -> -32768..-1: always in range
+    else if (difference < -32768)   //   -65535..-32769
+        return difference + 65536;  //   -> +1..32767: always in range
+    else
+        return difference;
+}
+#endif
+
+// Return 1 if word is "equal enough" to expected
+static inline int sync_word_fuzzy_compare(uint64_t word, uint64_t expected)
+{
+    uint64_t diff;
+
+    if (word == expected)
+        return 1;
+
+    diff = word ^ expected; // guaranteed nonzero
+
+    // This is a bit-twiddling popcount
+    // hack, tweaked as we only care about
+    // "<N" or ">=N" set bits for fixed N -
+    // so we can bail out early after seeing N
+    // set bits.
+    //
+    // It relies on starting with a nonzero value
+    // with zero or more trailing clear bits
+    // after the last set bit:
+    //
+    //    010101010101010000
+    //                 ^
+    // Subtracting one, will flip the 
+    // bits starting at the last set bit:
+    //
+    //    010101010101001111
+    //                 ^
+    // then we can use that as a bitwise-and 
+    // mask to clear the lowest set bit:
+    //
+    //    010101010101000000
+    //                 ^
+    // And repeat until the value is zero
+    // or we have seen too many set bits.
+    
+    // >= 1 bit
+    diff &= (diff-1);   // clear lowest set bit
+    if (!diff)
+        return 1; // 1 bit error
+
+    // >= 2 bits
+    diff &= (diff-1);   // clear lowest set bit
+    if (!diff)
+        return 1; // 2 bits error
+
+    // >= 3 bits
+    diff &= (diff-1);   // clear lowest set bit
+    if (!diff)
+        return 1; // 3 bits error
+
+    // >= 4 bits
+    diff &= (diff-1);   // clear lowest set bit
+    if (!diff)
+        return 1; // 4 bits error
+
+    // > 4 bits in error, give up
+    return 0;
+}
+
+// The demodulator's hot loops. Each has a portable implementation
+// and possibly others that need particular CPU features;
+// kernels_init() picks one of each and stores it here.
+struct kernels {
+    // Replace each of the 'n' I/Q sample pairs in 'buffer' with its
+    // phase, looked up in 'table' (which must have one spare entry
+    // at the end).
+    void (*convert_phi)(uint16_t *buffer, int n, const uint16_t *table);
+
+    // Scan for sync words: shift the bits starting at bit 'bit' of
+    // the phase samples in 'phi' (of length 'len') into '*sync0'
+    // and '*sync1', one per sample phase, until the low SYNC_BITS
+    // of either fuzzily match one of the 'nwords' words in 'words'.
+    // Bits before SYNC_BITS are never matched. Returns the bit that
+    // matched, or the first bit that could not be scanned because
+    // there are not enough samples. The registers are not masked,
+    // so shifting them right by one undoes the last bit.
+    int (*sync_search)(const uint16_t *phi, int bit, int len,
+                       uint64_t *sync0, uint64_t *sync1,
+                       const uint64_t *words, int nwords);
+
+    // Slice 'bytes' bytes of 8 bits from the phase samples at 'phi'
+    // into 'out', using 'center' as the slicing threshold. Successive
+    // bytes start 'stride' bytes apart in the input. Each byte also
+    // updates the first 'nroots' Reed-Solomon syndromes in
+    // 'syndromes' (see fec_syndrome_update).
+    void (*slice)(const uint16_t *phi, int stride, int bytes, int16_t center,
+                  uint8_t *out, uint8_t *syndromes, int nroots);
+
+    // Write 'len' bytes of 'data' to 'out' as lowercase hex, returning
+    // a pointer to the end of the output (not NUL-terminated).
+    char *(*hex_encode)(char *out, const uint8_t *data, int len);
+};
+
+extern struct kernels kernels;
+
+// Choose kernels. Must be called after init_fec(). 'spec' is NULL,
+// or a comma-separated list of <kernel>=<implementation> choices
+// and/or "bench" to time each implementation the CPU supports on
+// synthetic data and use the fastest. Otherwise, the preferred
+// implementation the CPU supports is used. 'phase_table' is the
+// phase lookup table used for convert_phi benchmarks. Returns 1 on
+// success, or 0 (with a message on stderr) if 'spec' is bad.
+int kernels_init(const char *spec, const uint16_t *phase_table);
+
+// Write the kernels and implementations available to 'f'.
+void kernels_list(FILE *f);
+
+// Return a description of the chosen implementations.
+const char *kernels_describe(void);
+
+#endif
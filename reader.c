@@ -20,45 +20,225 @@
 #include <errno.h>
 #include <unistd.h>
 #include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/epoll.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define READER_X86
+#include <immintrin.h>
+#endif
 
 #include "uat.h"
 #include "reader.h"
+#include "shm_ring.h"
+
+// How often a blocking shared-memory reader checks for new frames
+#define SHM_POLL_NS (5 * 1000 * 1000)
+
+// Smallest read buffer allowed; it must hold at least one whole line
+#define MIN_BUFFER_SIZE 2048
+
+// Frames delivered per call of a batch handler, at most
+#define BATCH_SIZE 256
 
 struct dump978_reader {
     int fd;
-    char buf[4096];
-    uint8_t frame[UPLINK_FRAME_DATA_BYTES]; // max uplink frame size
-    int used;
+    int source;     // copied into each frame delivered
+    int unpolled;   // in a poller, but not waited on with epoll
+    int close_fd;   // in a poller, which closes fd when freeing the reader
+    char *buf;
+    size_t buf_size;
+    size_t used;
+
+    struct dump978_frame batch[BATCH_SIZE];
+
+    // if reading from a shared-memory ring, rather than fd:
+    const struct shm_ring *ring;
+    uint8_t (*batch_data)[UPLINK_FRAME_DATA_BYTES];  // frames copied out of the ring
+    size_t ring_size;
+    int nonblock;
+    uint64_t next;  // sequence number of the next frame to read
+    uint64_t lost;  // frames overwritten before they could be read
+};
+
+static int process_input(struct dump978_reader *reader, frame_batch_handler_t handler, void *handler_data);
+static int process_line(struct dump978_frame *frame, char *p, char *end, uint8_t *out);
+static int frame_length_ok(frame_type_t type, int len);
+static void parse_metadata(struct dump978_frame *frame, char *p, char *end);
+static int hexbyte(const char *buf);
+static int read_shm_frames(struct dump978_reader *reader, frame_batch_handler_t handler, void *handler_data);
+static ssize_t read_input(struct dump978_reader *reader, frame_batch_handler_t handler, void *handler_data, int *framecount);
+
+// Hex decoders: convert 'len' pairs of hex digits at 'in' to bytes
+// at 'out'. Return 0 on success, -1 if there is a non-hex character.
+typedef int (*hex_decoder_t)(uint8_t *out, const char *in, int len);
+
+static int hex_decode_generic(uint8_t *out, const char *in, int len);
+#ifdef READER_X86
+static int hex_decode_sse2(uint8_t *out, const char *in, int len);
+static int hex_decode_avx2(uint8_t *out, const char *in, int len);
+#endif
+
+static const struct {
+    const char *name;
+    hex_decoder_t decode;
+} hex_decoders[] = {
+    { "generic", hex_decode_generic },
+#ifdef READER_X86
+    { "sse2", hex_decode_sse2 },
+    { "avx2", hex_decode_avx2 },
+#endif
+    { NULL, NULL }
 };
 
-static int process_input(struct dump978_reader *reader, frame_handler_t handler, void *handler_data);
-static int process_line(struct dump978_reader *reader, frame_handler_t handler, void *handler_data, char *p, char *end);
-static int hexbyte(char *buf);
+static int hex_decoder = -1;
+
+static int hex_decoder_supported(int i)
+{
+#ifdef READER_X86
+    __builtin_cpu_init();
+    if (!strcmp(hex_decoders[i].name, "sse2"))
+        return __builtin_cpu_supports("sse2");
+    if (!strcmp(hex_decoders[i].name, "avx2"))
+        return __builtin_cpu_supports("avx2");
+#endif
+    return 1;
+}
+
+// Use the last (fastest) supported decoder unless one was chosen
+static void choose_hex_decoder(void)
+{
+    int i;
+
+    if (hex_decoder >= 0)
+        return;
+
+    for (i = 0; hex_decoders[i].name; ++i) {
+        if (hex_decoder_supported(i))
+            hex_decoder = i;
+    }
+}
+
+int dump978_reader_set_decoder(const char *name)
+{
+    int i;
+
+    for (i = 0; hex_decoders[i].name; ++i) {
+        if (!strcmp(hex_decoders[i].name, name) && hex_decoder_supported(i)) {
+            hex_decoder = i;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+const char *dump978_reader_decoder(void)
+{
+    choose_hex_decoder();
+    return hex_decoders[hex_decoder].name;
+}
 
 struct dump978_reader *dump978_reader_new(int fd, int nonblock)
 {
-    struct dump978_reader *reader = calloc(1, sizeof(*reader));
+    return dump978_reader_new_buffered(fd, nonblock, DUMP978_READER_BUFFER_SIZE);
+}
+
+struct dump978_reader *dump978_reader_new_buffered(int fd, int nonblock, size_t buffer_size)
+{
+    struct dump978_reader *reader;
+
+    if (buffer_size < MIN_BUFFER_SIZE) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    reader = calloc(1, sizeof(*reader));
     if (!reader)
         return NULL;
 
+    reader->buf = malloc(buffer_size);
+    if (!reader->buf) {
+        free(reader);
+        errno = ENOMEM;
+        return NULL;
+    }
+
     if (nonblock) {
         int flags = fcntl(fd, F_GETFL);
         if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
             int save_errno = errno;
+            free(reader->buf);
             free(reader);
             errno = save_errno;
             return NULL;
         }
     }
-        
+
+    choose_hex_decoder();
     reader->fd = fd;
+    reader->buf_size = buffer_size;
     reader->used = 0;
     return reader;
 }
+
+struct dump978_reader *dump978_reader_new_shm(const char *name, int nonblock)
+{
+    struct dump978_reader *reader = calloc(1, sizeof(*reader));
+    if (!reader)
+        return NULL;
+
+    reader->batch_data = malloc(BATCH_SIZE * sizeof(*reader->batch_data));
+    if (!reader->batch_data) {
+        free(reader);
+        return NULL;
+    }
+
+    reader->ring = shm_ring_attach(name, &reader->ring_size);
+    if (!reader->ring) {
+        int save_errno = errno;
+        free(reader->batch_data);
+        free(reader);
+        errno = save_errno;
+        return NULL;
+    }
+
+    // like a pipe, start with the next frame published
+    reader->fd = -1;
+    reader->nonblock = nonblock;
+    reader->next = atomic_load_explicit((atomic_uint_fast64_t *) &reader->ring->head, memory_order_acquire);
+    return reader;
+}
     
+// dump978_read_frames() is a batch reader with this handler
+struct single_frame_adapter {
+    frame_handler_t handler;
+    void *handler_data;
+};
+
+static void deliver_single_frames(const struct dump978_frame *frames, int count, void *data)
+{
+    struct single_frame_adapter *adapter = data;
+    int i;
+
+    for (i = 0; i < count; ++i)
+        adapter->handler(frames[i].type, frames[i].data, frames[i].len, adapter->handler_data);
+}
+
 int dump978_read_frames(struct dump978_reader *reader,
                         frame_handler_t handler,
                         void *handler_data)
+{
+    struct single_frame_adapter adapter = { handler, handler_data };
+    return dump978_read_frame_batches(reader, deliver_single_frames, &adapter);
+}
+
+int dump978_read_frame_batches(struct dump978_reader *reader,
+                               frame_batch_handler_t handler,
+                               void *handler_data)
 {
     int framecount = 0;
     ssize_t bytes_read;
@@ -68,22 +248,11 @@ int dump978_read_frames(struct dump978_reader *reader,
         return -1;
     }
 
-    for (;;) {
-        if (reader->used == sizeof(reader->buf)) {
-            // line too long, ditch input
-            reader->used = 0;
-        }
-
-        bytes_read = read(reader->fd,
-                          reader->buf + reader->used,
-                          sizeof(reader->buf) - reader->used);
-        if (bytes_read <= 0)
-            break;
-        
-        reader->used += bytes_read;
+    if (reader->ring)
+        return read_shm_frames(reader, handler, handler_data);
 
-        framecount += process_input(reader, handler, handler_data);
-    }
+    while ((bytes_read = read_input(reader, handler, handler_data, &framecount)) > 0)
+        ;
 
     if (bytes_read == 0)
         return framecount; // EOF
@@ -95,19 +264,313 @@ int dump978_read_frames(struct dump978_reader *reader,
     return -1; // propagate unexpected error
 }
 
+// Do one read() from the reader's FD and pass any complete frames
+// to the handler, adding them to *framecount. Returns the result
+// of read().
+static ssize_t read_input(struct dump978_reader *reader, frame_batch_handler_t handler, void *handler_data, int *framecount)
+{
+    ssize_t bytes_read;
+
+    if (reader->used == reader->buf_size) {
+        // line too long, ditch input
+        reader->used = 0;
+    }
+
+    bytes_read = read(reader->fd,
+                      reader->buf + reader->used,
+                      reader->buf_size - reader->used);
+    if (bytes_read <= 0)
+        return bytes_read;
+
+    reader->used += bytes_read;
+    *framecount += process_input(reader, handler, handler_data);
+    return bytes_read;
+}
+
 void dump978_reader_free(struct dump978_reader *reader)
 {
     if (!reader)
         return;
 
+    shm_ring_detach(reader->ring, reader->ring_size);
+    free(reader->batch_data);
+    free(reader->buf);
     free(reader);
 }
 
-static int process_input(struct dump978_reader *reader, frame_handler_t handler, void *handler_data)
+uint64_t dump978_reader_lost(struct dump978_reader *reader)
+{
+    return reader ? reader->lost : 0;
+}
+
+void dump978_reader_set_source(struct dump978_reader *reader, int source)
+{
+    if (reader)
+        reader->source = source;
+}
+
+//
+// Several readers in one event loop
+//
+
+#define POLLER_MAX_EVENTS 32
+
+struct dump978_poller {
+    int epfd;
+    struct dump978_reader **readers;
+    int count;
+    int unpolled;   // readers epoll can't wait on: shared-memory rings and regular files
+};
+
+struct dump978_poller *dump978_poller_new(void)
+{
+    struct dump978_poller *poller = calloc(1, sizeof(*poller));
+    if (!poller)
+        return NULL;
+
+    poller->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (poller->epfd < 0) {
+        int save_errno = errno;
+        free(poller);
+        errno = save_errno;
+        return NULL;
+    }
+
+    return poller;
+}
+
+int dump978_poller_add(struct dump978_poller *poller, struct dump978_reader *reader, int source, int flags)
+{
+    struct dump978_reader **grown;
+
+    if (!poller || !reader) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    grown = realloc(poller->readers, (poller->count + 1) * sizeof(*grown));
+    if (!grown)
+        return -1;
+    poller->readers = grown;
+
+    if (reader->ring) {
+        reader->nonblock = 1;
+        reader->unpolled = 1;
+    } else {
+        struct epoll_event ev;
+        int flags = fcntl(reader->fd, F_GETFL);
+
+        if (flags < 0 || fcntl(reader->fd, F_SETFL, flags | O_NONBLOCK) < 0)
+            return -1;
+
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.ptr = reader;
+        if (epoll_ctl(poller->epfd, EPOLL_CTL_ADD, reader->fd, &ev) < 0) {
+            if (errno != EPERM)
+                return -1;
+            reader->unpolled = 1; // a regular file, always readable
+        }
+    }
+
+    if (reader->unpolled)
+        ++poller->unpolled;
+
+    reader->source = source;
+    reader->close_fd = (flags & DUMP978_POLLER_CLOSE_FD) != 0;
+    poller->readers[poller->count++] = reader;
+    return 0;
+}
+
+// Free a reader the poller holds, and its FD if the poller owns that
+static void poller_free_reader(struct dump978_reader *reader)
+{
+    if (reader->close_fd)
+        close(reader->fd);
+    dump978_reader_free(reader);
+}
+
+static void poller_remove(struct dump978_poller *poller, struct dump978_reader *reader)
+{
+    int i;
+
+    for (i = 0; i < poller->count; ++i) {
+        if (poller->readers[i] == reader) {
+            poller->readers[i] = poller->readers[--poller->count];
+            break;
+        }
+    }
+
+    if (reader->unpolled)
+        --poller->unpolled;
+    else
+        epoll_ctl(poller->epfd, EPOLL_CTL_DEL, reader->fd, NULL);
+    poller_free_reader(reader);
+}
+
+int dump978_poller_wait(struct dump978_poller *poller, int timeout_ms,
+                        frame_batch_handler_t handler, void *handler_data)
+{
+    struct epoll_event events[POLLER_MAX_EVENTS];
+    int framecount = 0;
+    int i, n;
+
+    if (!poller) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // shared-memory rings have to be polled, and files are always readable
+    for (i = 0; i < poller->count; ++i) {
+        if (poller->readers[i]->unpolled) {
+            if (!poller->readers[i]->ring)
+                timeout_ms = 0;
+            else if (timeout_ms < 0 || timeout_ms > SHM_POLL_NS / 1000000)
+                timeout_ms = SHM_POLL_NS / 1000000;
+        }
+    }
+
+    n = epoll_wait(poller->epfd, events, POLLER_MAX_EVENTS, timeout_ms);
+    if (n < 0)
+        return (errno == EINTR ? 0 : -1);
+
+    // one read() per ready source per call, so a busy source can't
+    // starve the others
+    for (i = 0; i < n; ++i) {
+        struct dump978_reader *reader = events[i].data.ptr;
+        ssize_t bytes_read = read_input(reader, handler, handler_data, &framecount);
+
+        if (bytes_read == 0 || (bytes_read < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+            poller_remove(poller, reader);
+    }
+
+    for (i = poller->count - 1; i >= 0 && poller->unpolled > 0; --i) {
+        struct dump978_reader *reader = poller->readers[i];
+
+        if (!reader->unpolled)
+            continue;
+
+        if (reader->ring) {
+            int shm_frames = read_shm_frames(reader, handler, handler_data);
+            if (shm_frames > 0)
+                framecount += shm_frames;
+            else if (shm_frames == 0)
+                poller_remove(poller, reader);
+        } else {
+            ssize_t bytes_read = read_input(reader, handler, handler_data, &framecount);
+            if (bytes_read == 0 || (bytes_read < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+                poller_remove(poller, reader);
+        }
+    }
+
+    return framecount;
+}
+
+int dump978_poller_sources(struct dump978_poller *poller)
+{
+    return poller ? poller->count : 0;
+}
+
+void dump978_poller_free(struct dump978_poller *poller)
+{
+    int i;
+
+    if (!poller)
+        return;
+
+    for (i = 0; i < poller->count; ++i)
+        poller_free_reader(poller->readers[i]);
+    close(poller->epfd);
+    free(poller->readers);
+    free(poller);
+}
+
+// Pass the frames published since the last call to the handler.
+// Each frame is copied out of its slot, and passed on only if the
+// slot's sequence number is unchanged afterwards; a frame that the
+// writer overwrote while it was being copied is counted as lost.
+static int read_shm_frames(struct dump978_reader *reader, frame_batch_handler_t handler, void *handler_data)
+{
+    const struct shm_ring *ring = reader->ring;
+    struct timespec poll_interval = { 0, SHM_POLL_NS };
+    int framecount = 0;
+
+    for (;;) {
+        int gone = shm_ring_writer_gone(ring);
+        uint64_t head = atomic_load_explicit((atomic_uint_fast64_t *) &ring->head, memory_order_acquire);
+
+        // the slot of frame 'head' may already be being overwritten
+        if (head - reader->next >= ring->slot_count) {
+            uint64_t oldest = head - ring->slot_count + 1;
+            reader->lost += oldest - reader->next;
+            reader->next = oldest;
+        }
+
+        while (reader->next < head) {
+            int n = 0;
+
+            for (; reader->next < head && n < BATCH_SIZE; ++reader->next) {
+                const struct shm_ring_slot *slot = &ring->slots[reader->next % ring->slot_count];
+                uint64_t seq = atomic_load_explicit((atomic_uint_fast64_t *) &slot->seq, memory_order_acquire);
+                struct dump978_frame *frame = &reader->batch[n];
+                uint8_t *data = reader->batch_data[n];
+                frame_type_t type = (frame_type_t) slot->type;
+                int len = slot->len;
+                int rs_errors = slot->rs_errors;
+
+                if (seq != 2*reader->next + 2 || !frame_length_ok(type, len)) {
+                    ++reader->lost;
+                    continue;
+                }
+
+                memcpy(data, slot->data, len);
+
+                atomic_thread_fence(memory_order_acquire);
+                if (atomic_load_explicit((atomic_uint_fast64_t *) &slot->seq, memory_order_relaxed) != seq) {
+                    ++reader->lost; // overwritten while it was copied
+                    continue;
+                }
+
+                // a short frame with a long payload type is decoded as a long frame
+                if (len < LONG_FRAME_DATA_BYTES)
+                    memset(data + len, 0, LONG_FRAME_DATA_BYTES - len);
+
+                memset(frame, 0, sizeof(*frame));
+                frame->type = type;
+                frame->data = data;
+                frame->len = len;
+                frame->rs_errors = rs_errors;
+                frame->source = reader->source;
+                ++n;
+            }
+
+            if (n > 0) {
+                handler(reader->batch, n, handler_data);
+                framecount += n;
+            }
+        }
+
+        if (framecount > 0)
+            return framecount;
+
+        if (gone)
+            return 0; // EOF, everything published has been read
+
+        if (reader->nonblock) {
+            errno = EAGAIN;
+            return -1;
+        }
+
+        nanosleep(&poll_interval, NULL);
+    }
+}
+
+static int process_input(struct dump978_reader *reader, frame_batch_handler_t handler, void *handler_data)
 {
     char *p = reader->buf;
     char *end = reader->buf + reader->used;
     int framecount = 0;
+    int n = 0;
 
     while (p < end) {
         char *newline;
@@ -116,12 +579,24 @@ static int process_input(struct dump978_reader *reader, frame_handler_t handler,
         if (newline == NULL)
             break;
         
-        if (*p == '-' || *p == '+')
-            framecount += process_line(reader, handler, handler_data, p, newline);
+        if ((*p == '-' || *p == '+') && process_line(&reader->batch[n], p, newline, NULL)) {
+            reader->batch[n].source = reader->source;
+            if (++n == BATCH_SIZE) {
+                handler(reader->batch, n, handler_data);
+                framecount += n;
+                n = 0;
+            }
+        }
         
         p = newline+1;
     }
 
+    // deliver before the frame data is moved
+    if (n > 0) {
+        handler(reader->batch, n, handler_data);
+        framecount += n;
+    }
+
     if (p >= end) {
         reader->used = 0;
     } else {
@@ -132,10 +607,23 @@ static int process_input(struct dump978_reader *reader, frame_handler_t handler,
     return framecount;
 }
 
-static int process_line(struct dump978_reader *reader, frame_handler_t handler, void *handler_data, char *p, char *end)
+// The decoders read a whole frame of the type given, so anything
+// shorter would have them read past the data
+static int frame_length_ok(frame_type_t type, int len)
 {
-    uint8_t *out;
-    int len = 0;
+    if (type == UAT_UPLINK)
+        return len == UPLINK_FRAME_DATA_BYTES;
+    else
+        return len == SHORT_FRAME_DATA_BYTES || len == LONG_FRAME_DATA_BYTES;
+}
+
+// Parse the line from 'p' to 'end' into 'frame', decoding the hex
+// data to 'out', or in place in the buffer if 'out' is NULL.
+// Returns 1 if it is a valid frame.
+static int process_line(struct dump978_frame *frame, char *p, char *end, uint8_t *out)
+{
+    char *semicolon;
+    int len;
     frame_type_t frametype;
     
     if (*p == '-')
@@ -145,33 +633,400 @@ static int process_line(struct dump978_reader *reader, frame_handler_t handler,
     else
         return 0;
     
-    out = reader->frame;
     ++p;
-    while (p < end) {
-        int byte;
-                
-        if (p[0] == ';') {
-            // ignore rest of line
-            handler(frametype, reader->frame, len, handler_data);
-            return 1;
+    semicolon = memchr(p, ';', end - p);
+    if (!semicolon)
+        return 0; // ran off the end without seeing semicolon
+
+    if ((semicolon - p) & 1)
+        return 0; // badly formatted byte
+
+    len = (semicolon - p) / 2;
+    if (!frame_length_ok(frametype, len))
+        return 0; // wrong size for the frame type
+
+    // in place, each byte is written no later than the hex digits it came from
+    if (!out)
+        out = (uint8_t *) p;
+    if (hex_decoders[hex_decoder].decode(out, p, len) < 0)
+        return 0; // badly formatted byte
+
+    memset(frame, 0, sizeof(*frame));
+    frame->type = frametype;
+    frame->data = out;
+    frame->len = len;
+    parse_metadata(frame, semicolon + 1, end);
+    return 1;
+}    
+
+//
+// Parallel replay of a file
+//
+
+// Aim for this many chunks per thread, to balance the load
+#define CHUNKS_PER_THREAD 8
+// but make chunks no smaller than this
+#define MIN_CHUNK_SIZE (1024 * 1024)
+// nor larger than this: ordered delivery holds the parsed frames of up
+// to 'window' chunks at once, which should not grow with the file size
+#define MAX_CHUNK_SIZE (32 * 1024 * 1024)
+
+struct replay_chunk {
+    char *start;
+    char *end;
+
+    // ordered delivery: the parsed frames, waiting to be delivered
+    struct dump978_frame *frames;
+    uint8_t *data;
+    int count;
+    int parsed;
+};
+
+struct replay {
+    struct replay_chunk *chunks;
+    int n_chunks;
+    int ordered;
+    frame_batch_handler_t handler;
+    void *handler_data;
+
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    int next_parse;     // next chunk for a worker to take
+    int next_deliver;   // ordered delivery: next chunk to deliver
+    int window;         // ordered delivery: how far parsing may get ahead
+    int failed;         // a worker ran out of memory
+    int64_t framecount;
+};
+
+// Parse a chunk and pass its frames straight to the handler
+static int replay_unordered(struct replay *r, struct replay_chunk *c, struct dump978_frame *batch, uint8_t *data)
+{
+    char *p = c->start;
+    int n = 0, framecount = 0;
+
+    while (p < c->end) {
+        char *newline = memchr(p, '\n', c->end - p);
+
+        if ((*p == '-' || *p == '+') &&
+            process_line(&batch[n], p, newline, data + n * UPLINK_FRAME_DATA_BYTES)) {
+            if (++n == BATCH_SIZE) {
+                r->handler(batch, n, r->handler_data);
+                framecount += n;
+                n = 0;
+            }
         }
-        
-        if (len >= sizeof(reader->frame))
-            return 0; // oversized frame
-                
-        byte = hexbyte(p);
-        if (byte < 0)
-            return 0; // badly formatted byte
-                
-        ++len;
-        *out++ = byte;
-        p += 2;
+
+        p = newline + 1;
     }
 
-    return 0; // ran off the end without seeing semicolon
-}    
+    if (n > 0) {
+        r->handler(batch, n, r->handler_data);
+        framecount += n;
+    }
+
+    return framecount;
+}
+
+// Parse a chunk and keep its frames for replay_deliver()
+static int replay_parse(struct replay_chunk *c)
+{
+    char *p = c->start;
+    int size = 0;
+    uint8_t *out;
+
+    // the decoded data is at most half the size of the text, and
+    // frames are packed end to end; a short downlink frame with a long
+    // payload type is decoded as a long frame, so leave room for the
+    // last one to be read that far
+    c->data = malloc((c->end - c->start) / 2 + LONG_FRAME_DATA_BYTES);
+    if (!c->data)
+        return 0;
+    memset(c->data + (c->end - c->start) / 2, 0, LONG_FRAME_DATA_BYTES);
+    out = c->data;
+
+    while (p < c->end) {
+        char *newline = memchr(p, '\n', c->end - p);
+
+        if (c->count == size) {
+            struct dump978_frame *grown;
+            size = size ? size * 2 : 1024;
+            grown = realloc(c->frames, size * sizeof(*grown));
+            if (!grown)
+                return 0;
+            c->frames = grown;
+        }
+
+        if ((*p == '-' || *p == '+') && process_line(&c->frames[c->count], p, newline, out)) {
+            out += c->frames[c->count].len;
+            ++c->count;
+        }
+
+        p = newline + 1;
+    }
 
-static int hexbyte(char *buf)
+    return 1;
+}
+
+static void *replay_worker(void *arg)
+{
+    struct replay *r = arg;
+    struct dump978_frame *batch = NULL;
+    uint8_t *data = NULL;
+    int64_t framecount = 0;
+    int ok = 1;
+
+    if (!r->ordered) {
+        batch = malloc(BATCH_SIZE * sizeof(*batch));
+        data = malloc(BATCH_SIZE * UPLINK_FRAME_DATA_BYTES);
+        ok = (batch && data);
+    }
+
+    pthread_mutex_lock(&r->lock);
+    while (ok && !r->failed) {
+        struct replay_chunk *c;
+
+        while (r->ordered && r->next_parse >= r->next_deliver + r->window && !r->failed)
+            pthread_cond_wait(&r->changed, &r->lock);
+        if (r->failed || r->next_parse >= r->n_chunks)
+            break;
+
+        c = &r->chunks[r->next_parse++];
+        pthread_mutex_unlock(&r->lock);
+
+        if (r->ordered)
+            ok = replay_parse(c);
+        else
+            framecount += replay_unordered(r, c, batch, data);
+
+        pthread_mutex_lock(&r->lock);
+        c->parsed = 1;
+        pthread_cond_broadcast(&r->changed);
+    }
+
+    if (!ok) {
+        r->failed = 1;
+        pthread_cond_broadcast(&r->changed);
+    }
+    r->framecount += framecount;
+    pthread_mutex_unlock(&r->lock);
+
+    free(batch);
+    free(data);
+    return NULL;
+}
+
+// Ordered delivery: hand each chunk's frames to the handler, in order,
+// as the workers finish parsing them
+static void replay_deliver(struct replay *r)
+{
+    int64_t framecount = 0;
+    int i, j;
+
+    for (i = 0; i < r->n_chunks; ++i) {
+        struct replay_chunk *c = &r->chunks[i];
+
+        pthread_mutex_lock(&r->lock);
+        while (!c->parsed && !r->failed)
+            pthread_cond_wait(&r->changed, &r->lock);
+        pthread_mutex_unlock(&r->lock);
+
+        if (r->failed)
+            break;
+
+        for (j = 0; j < c->count; j += BATCH_SIZE)
+            r->handler(c->frames + j, (c->count - j < BATCH_SIZE ? c->count - j : BATCH_SIZE), r->handler_data);
+        framecount += c->count;
+
+        free(c->frames);
+        free(c->data);
+        c->frames = NULL;
+        c->data = NULL;
+
+        pthread_mutex_lock(&r->lock);
+        r->next_deliver = i + 1;
+        pthread_cond_broadcast(&r->changed);
+        pthread_mutex_unlock(&r->lock);
+    }
+
+    // (the workers add to r->framecount too, under the lock)
+    pthread_mutex_lock(&r->lock);
+    r->framecount += framecount;
+    pthread_mutex_unlock(&r->lock);
+}
+
+int64_t dump978_replay_file(const char *path, int threads, int flags,
+                            frame_batch_handler_t handler, void *handler_data)
+{
+    struct replay r;
+    struct stat st;
+    pthread_t *workers = NULL;
+    char *map = NULL;
+    size_t chunk_size;
+    int fd, i, err = 0, started = 0;
+
+    memset(&r, 0, sizeof(r));
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    if (fstat(fd, &st) < 0) {
+        err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+
+    if (st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    err = errno;
+    close(fd);
+    if (map == MAP_FAILED) {
+        errno = err;
+        return -1;
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    if (threads <= 0)
+        threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads <= 0)
+        threads = 1;
+
+    choose_hex_decoder();
+
+    // Split at newlines into chunks; an unterminated last line is
+    // ignored, as it is by dump978_read_frames()
+    chunk_size = st.st_size / (threads * CHUNKS_PER_THREAD) + 1;
+    if (chunk_size < MIN_CHUNK_SIZE)
+        chunk_size = MIN_CHUNK_SIZE;
+    if (chunk_size > MAX_CHUNK_SIZE)
+        chunk_size = MAX_CHUNK_SIZE;
+
+    r.chunks = calloc(st.st_size / chunk_size + 1, sizeof(*r.chunks));
+    workers = calloc(threads, sizeof(*workers));
+    if (!r.chunks || !workers) {
+        err = ENOMEM;
+        goto done;
+    }
+
+    {
+        char *p = map, *end = map + st.st_size;
+
+        while (end > map && end[-1] != '\n')
+            --end;
+
+        while (p < end) {
+            size_t step = (size_t) (end - p) < chunk_size ? (size_t) (end - p) : chunk_size;
+            char *newline = memchr(p + step - 1, '\n', end - (p + step - 1));
+
+            r.chunks[r.n_chunks].start = p;
+            r.chunks[r.n_chunks].end = newline + 1;
+            ++r.n_chunks;
+            p = newline + 1;
+        }
+    }
+
+    r.ordered = (flags & DUMP978_REPLAY_ORDERED) != 0;
+    r.handler = handler;
+    r.handler_data = handler_data;
+    r.window = threads * 2;
+    pthread_mutex_init(&r.lock, NULL);
+    pthread_cond_init(&r.changed, NULL);
+
+    for (started = 0; started < threads; ++started) {
+        if ((err = pthread_create(&workers[started], NULL, replay_worker, &r)) != 0) {
+            pthread_mutex_lock(&r.lock);
+            r.failed = 1;
+            pthread_cond_broadcast(&r.changed);
+            pthread_mutex_unlock(&r.lock);
+            break;
+        }
+    }
+
+    if (r.ordered && started == threads)
+        replay_deliver(&r);
+
+    for (i = 0; i < started; ++i)
+        pthread_join(workers[i], NULL);
+
+    if (r.failed && !err)
+        err = ENOMEM;
+
+    pthread_mutex_destroy(&r.lock);
+    pthread_cond_destroy(&r.changed);
+
+ done:
+    if (r.chunks) {
+        for (i = 0; i < r.n_chunks; ++i) {
+            free(r.chunks[i].frames);
+            free(r.chunks[i].data);
+        }
+    }
+    free(r.chunks);
+    free(workers);
+    munmap(map, st.st_size);
+
+    if (err) {
+        errno = err;
+        return -1;
+    }
+
+    return r.framecount;
+}
+
+// Parse the semicolon-separated key=value pairs between 'p' and
+// 'end' into 'frame', ignoring anything not understood
+static void parse_metadata(struct dump978_frame *frame, char *p, char *end)
+{
+    while (p < end) {
+        char *next = memchr(p, ';', end - p);
+        char *value;
+        if (!next)
+            next = end;
+
+        value = memchr(p, '=', next - p);
+        if (value) {
+            char *parsed;
+            long l;
+            double d;
+
+            ++value;
+            switch (value - p) {
+            case 3:
+                if (!memcmp(p, "rs", 2)) {
+                    l = strtol(value, &parsed, 10);
+                    if (parsed == next && parsed != value)
+                        frame->rs_errors = l;
+                } else if (!memcmp(p, "ss", 2)) {
+                    d = strtod(value, &parsed);
+                    if (parsed == next && parsed != value) {
+                        frame->signal = d;
+                        frame->signal_valid = 1;
+                    }
+                }
+                break;
+
+            case 2:
+                if (*p == 't') {
+                    d = strtod(value, &parsed);
+                    if (parsed == next && parsed != value) {
+                        frame->timestamp = d;
+                        frame->timestamp_valid = 1;
+                    }
+                }
+                break;
+            }
+        }
+
+        p = next + 1;
+    }
+}
+
+static int hexbyte(const char *buf)
 {
     int i;
     char c;
@@ -197,3 +1052,93 @@ static int hexbyte(char *buf)
     else
         return -1;
 }
+
+static int hex_decode_generic(uint8_t *out, const char *in, int len)
+{
+    while (--len >= 0) {
+        int byte = hexbyte(in);
+        if (byte < 0)
+            return -1;
+        *out++ = byte;
+        in += 2;
+    }
+
+    return 0;
+}
+
+#ifdef READER_X86
+// Decode 16 characters to 8 bytes; return -1 if any is not a hex digit
+__attribute__((target("sse2")))
+static inline int hex_decode16_sse2(uint8_t *out, const char *in)
+{
+    __m128i c = _mm_loadu_si128((const __m128i *) in);
+    __m128i lower = _mm_or_si128(c, _mm_set1_epi8(0x20));
+    __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('0' - 1)),
+                                  _mm_cmplt_epi8(c, _mm_set1_epi8('9' + 1)));
+    __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                                  _mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+    __m128i v, pairs;
+
+    if (_mm_movemask_epi8(_mm_or_si128(digit, alpha)) != 0xFFFF)
+        return -1;
+
+    v = _mm_or_si128(_mm_and_si128(digit, _mm_sub_epi8(c, _mm_set1_epi8('0'))),
+                     _mm_and_si128(alpha, _mm_sub_epi8(lower, _mm_set1_epi8('a' - 10))));
+    // each 16-bit lane holds the high nibble in its low byte
+    pairs = _mm_or_si128(_mm_and_si128(_mm_slli_epi16(v, 4), _mm_set1_epi16(0x00F0)),
+                         _mm_srli_epi16(v, 8));
+    _mm_storel_epi64((__m128i *) out, _mm_packus_epi16(pairs, pairs));
+    return 0;
+}
+
+__attribute__((target("sse2")))
+static int hex_decode_sse2(uint8_t *out, const char *in, int len)
+{
+    for (; len >= 8; len -= 8, in += 16, out += 8) {
+        if (hex_decode16_sse2(out, in) < 0)
+            return -1;
+    }
+
+    return hex_decode_generic(out, in, len);
+}
+
+// 32 characters (16 bytes) per step
+__attribute__((target("avx2")))
+static int hex_decode_avx2(uint8_t *out, const char *in, int len)
+{
+    for (; len >= 16; len -= 16, in += 32, out += 16) {
+        __m256i c = _mm256_loadu_si256((const __m256i *) in);
+        __m256i lower = _mm256_or_si256(c, _mm256_set1_epi8(0x20));
+        __m256i digit = _mm256_andnot_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8('9')),
+                                            _mm256_cmpgt_epi8(c, _mm256_set1_epi8('0' - 1)));
+        __m256i alpha = _mm256_andnot_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('f')),
+                                            _mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)));
+        __m256i v, pairs;
+
+        if (_mm256_movemask_epi8(_mm256_or_si256(digit, alpha)) != -1)
+            return -1;
+
+        v = _mm256_or_si256(_mm256_and_si256(digit, _mm256_sub_epi8(c, _mm256_set1_epi8('0'))),
+                            _mm256_and_si256(alpha, _mm256_sub_epi8(lower, _mm256_set1_epi8('a' - 10))));
+        // high nibble * 16 + low nibble in each 16-bit lane, then pack
+        // the two 128-bit lanes' results together
+        pairs = _mm256_maddubs_epi16(v, _mm256_set1_epi16(0x0110));
+        pairs = _mm256_permute4x64_epi64(_mm256_packus_epi16(pairs, pairs), 0x08);
+        _mm_storeu_si128((__m128i *) out, _mm256_castsi256_si128(pairs));
+    }
+
+    // The compiler doesn't reliably clear the upper halves of the
+    // registers before the tail call below, which would slow down
+    // any legacy SSE code the caller runs next
+    _mm256_zeroupper();
+
+    // finish with 128-bit steps here, rather than in hex_decode_sse2,
+    // to avoid mixing AVX and legacy SSE instructions
+    for (; len >= 8; len -= 8, in += 16, out += 8) {
+        if (hex_decode16_sse2(out, in) < 0)
+            return -1;
+    }
+
+    return hex_decode_generic(out, in, len);
+}
+#endif
@@ -19,6 +19,7 @@
 #define DUMP978_READER_H
 
 #include <stdint.h>
+#include <stddef.h>
 
 struct dump978_reader;
 
@@ -35,13 +36,57 @@ typedef enum { UAT_UPLINK, UAT_DOWNLINK } frame_type_t;
 // preserve the data after returning, it should take a copy.
 typedef void (*frame_handler_t)(frame_type_t t,uint8_t *f,int l,void *d);
 
+// A frame delivered by dump978_read_frame_batches(), with the metadata
+// that followed it on its line. 'data' points into the reader's own
+// buffer and is only valid until the handler returns. Every frame in a
+// batch has been checked to be a whole frame of its type (an uplink
+// frame, or a short or long downlink frame) before the batch is
+// delivered.
+struct dump978_frame {
+    frame_type_t type;
+    uint8_t *data;
+    int len;
+
+    int source;               // the reader's source ID (see dump978_poller_add)
+
+    int rs_errors;            // "rs=": corrected Reed-Solomon errors (0 if absent)
+
+    unsigned timestamp_valid : 1;
+    unsigned signal_valid : 1;
+
+    double timestamp;         // "t=": if timestamp_valid, seconds since the epoch
+    double signal;            // "ss=": if signal_valid, signal strength
+};
+
+// Function pointer type for a handler called by dump978_read_frame_batches()
+// with 'count' frames in 'frames', and the value of handler_data.
+typedef void (*frame_batch_handler_t)(const struct dump978_frame *frames,int count,void *d);
+
+// Default size of a reader's input buffer, in bytes
+#define DUMP978_READER_BUFFER_SIZE (65536)
+
 // Allocate a new reader that reads from file descriptor 'fd'.
 // If 'nonblock' is nonzero, the FD will be made nonblocking.
 // Returns the reader, or NULL on error with errno set.
 struct dump978_reader *dump978_reader_new(int fd, int nonblock);
 
-// Free a reader previously created by dump978_reader_new.
-// Does not close the underlying file descriptor.
+// As dump978_reader_new, but reading up to 'buffer_size' bytes
+// at a time (at least 2048). Larger buffers mean fewer read()
+// calls when replaying files.
+struct dump978_reader *dump978_reader_new_buffered(int fd, int nonblock, size_t buffer_size);
+
+// Allocate a new reader that reads frames that dump978 -m <name>
+// publishes to the shared-memory ring 'name', starting with the
+// next frame published. Each frame is copied out of the ring, and
+// passed to the handler only if dump978 didn't overwrite it while it
+// was being copied (otherwise it counts as lost; see
+// dump978_reader_lost). If 'nonblock' is nonzero,
+// dump978_read_frames() returns EAGAIN rather than waiting for frames.
+// Returns the reader, or NULL on error with errno set.
+struct dump978_reader *dump978_reader_new_shm(const char *name, int nonblock);
+
+// Free a reader previously created by dump978_reader_new or
+// dump978_reader_new_shm. Does not close the underlying file descriptor.
 void dump978_reader_free(struct dump978_reader *reader);
 
 // Read frames from the given reader.
@@ -57,6 +102,85 @@ int dump978_read_frames(struct dump978_reader *reader,
                         frame_handler_t handler,
                         void *handler_data);
 
+// As dump978_read_frames, but pass frames to 'handler' in batches
+// of up to a few hundred. Returns the same values.
+int dump978_read_frame_batches(struct dump978_reader *reader,
+                               frame_batch_handler_t handler,
+                               void *handler_data);
+
+// Flags for dump978_replay_file()
+#define DUMP978_REPLAY_ORDERED 1   // deliver frames in file order
+
+// Read every frame in the file 'path', e.g. an archive of dump978
+// output, using 'threads' threads (0 = one per CPU). The file is
+// mapped into memory and split at line boundaries into chunks that
+// are parsed in parallel.
+//
+// With DUMP978_REPLAY_ORDERED, 'handler' is called only from the
+// calling thread, with the frames in the order they appear in the
+// file. Otherwise it is called from the worker threads as soon as
+// each batch is parsed, so it must be thread-safe, and batches
+// arrive in no particular order.
+//
+// Returns the number of frames read, or <0 on error with errno set.
+int64_t dump978_replay_file(const char *path, int threads, int flags,
+                            frame_batch_handler_t handler, void *handler_data);
+
+// Return the number of frames a shared-memory reader missed because
+// dump978 overwrote them before they were read (always 0 for a
+// file descriptor reader).
+uint64_t dump978_reader_lost(struct dump978_reader *reader);
+
+// Set the source ID copied into each frame the reader delivers
+// (0 by default).
+void dump978_reader_set_source(struct dump978_reader *reader, int source);
+
+//
+// A poller reads from several readers in one epoll event loop, e.g. to
+// take feeds from several dump978 instances or TCP connections.
+//
+struct dump978_poller;
+
+// Allocate a new, empty poller.
+// Returns the poller, or NULL on error with errno set.
+struct dump978_poller *dump978_poller_new(void);
+
+// Flags for dump978_poller_add()
+#define DUMP978_POLLER_CLOSE_FD 1  // close the reader's FD when it is freed
+
+// Add a reader to a poller, which makes its FD nonblocking and takes
+// ownership of it: the reader is freed when its input ends or fails,
+// or when the poller is freed. Frames it delivers carry 'source'.
+// With DUMP978_POLLER_CLOSE_FD the poller owns the FD too, e.g. a
+// socket opened just for this reader.
+// Returns 0 on success, <0 on error with errno set.
+int dump978_poller_add(struct dump978_poller *poller, struct dump978_reader *reader, int source, int flags);
+
+// Wait up to 'timeout_ms' milliseconds (-1 = forever) for input on any
+// of the poller's readers, then pass the frames that arrived to
+// 'handler'. Shared-memory readers are polled, so with one of those
+// the wait is at most a few milliseconds.
+//
+// Returns the number of frames read, which may be 0; <0 on error with
+// errno set. Use dump978_poller_sources() to see if any input remains.
+int dump978_poller_wait(struct dump978_poller *poller, int timeout_ms,
+                        frame_batch_handler_t handler, void *handler_data);
+
+// Return the number of readers still open in the poller.
+int dump978_poller_sources(struct dump978_poller *poller);
+
+// Free a poller and the readers it still holds. Closes only the file
+// descriptors added with DUMP978_POLLER_CLOSE_FD.
+void dump978_poller_free(struct dump978_poller *poller);
+
+// Choose the hex decoder used by all readers: "generic", or on x86
+// "sse2" or "avx2". By default the fastest one the CPU supports is
+// used. Returns 0 if 'name' is unknown or not supported by this CPU.
+int dump978_reader_set_decoder(const char *name);
+
+// Return the name of the hex decoder in use.
+const char *dump978_reader_decoder(void);
+
 #endif
 
 
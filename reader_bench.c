@@ -0,0 +1,141 @@
+//
+// Copyright 2015, Oliver Jowett <oliver@mutability.co.uk>
+//
+
+// This file is free software: you may copy, redistribute and/or modify it  
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 2 of the License, or (at your  
+// option) any later version.  
+//
+// This file is distributed in the hope that it will be useful, but  
+// WITHOUT ANY WARRANTY; without even the implied warranty of  
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU  
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License  
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Measure dump978_reader throughput: read frames from stdin and
+// discard them. See "make bench-reader".
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include "reader.h"
+
+struct totals {
+    uint64_t frames;
+    uint64_t bytes;
+    uint32_t checksum;
+};
+
+static void handle_frame(frame_type_t type, uint8_t *frame, int len, void *extra)
+{
+    struct totals *t = extra;
+    uint32_t sum = 0;
+    int i;
+
+    // cheap enough not to swamp the reader, and order-sensitive
+    // within a frame
+    for (i = 0; i < len; ++i)
+        sum += frame[i] * (i + 1);
+
+    ++t->frames;
+    t->bytes += len;
+    t->checksum += sum;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage(int argc, char **argv)
+{
+    fprintf(stderr,
+            "usage: %s [-b <bytes>] [-d <decoder>]\n"
+            "\n"
+            "Reads UAT messages from stdin as fast as possible and reports\n"
+            "the reader's throughput and a checksum of the frames read.\n"
+            "\n"
+            "  -b <bytes>    Read buffer size (default %d)\n"
+            "  -d <decoder>  Hex decoder: generic, sse2 or avx2 (default: the\n"
+            "                fastest this CPU supports)\n"
+            "  -h            Show this usage message\n",
+            argv[0], DUMP978_READER_BUFFER_SIZE);
+}
+
+int main(int argc, char **argv)
+{
+    struct dump978_reader *reader;
+    struct totals totals = { 0, 0, 0 };
+    size_t buffer_size = DUMP978_READER_BUFFER_SIZE;
+    off_t input_bytes;
+    double start, elapsed;
+    int framecount;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "hb:d:")) > 0) {
+        switch (opt) {
+        case 'h':
+            usage(argc, argv);
+            return 0;
+
+        case 'b':
+            buffer_size = strtoul(optarg, NULL, 0);
+            break;
+
+        case 'd':
+            if (!dump978_reader_set_decoder(optarg)) {
+                fprintf(stderr, "%s: hex decoder %s is not available\n", argv[0], optarg);
+                return 1;
+            }
+            break;
+
+        default:
+            usage(argc, argv);
+            return 1;
+        }
+    }
+
+    if (optind < argc) {
+        usage(argc, argv);
+        return 1;
+    }
+
+    reader = dump978_reader_new_buffered(0, 0, buffer_size);
+    if (!reader) {
+        perror("dump978_reader_new_buffered");
+        return 1;
+    }
+
+    start = now();
+    while ((framecount = dump978_read_frames(reader, handle_frame, &totals)) > 0)
+        ;
+    elapsed = now() - start;
+
+    if (framecount < 0) {
+        perror("dump978_read_frames");
+        return 1;
+    }
+
+    dump978_reader_free(reader);
+
+    input_bytes = lseek(0, 0, SEEK_CUR);
+    printf("%s decoder, %zu byte buffer: %llu frames (%llu bytes, checksum %08x) in %.3f s",
+           dump978_reader_decoder(), buffer_size,
+           (unsigned long long) totals.frames, (unsigned long long) totals.bytes,
+           totals.checksum, elapsed);
+    if (input_bytes > 0)
+        printf(", %.1f MB/s of input", input_bytes / elapsed / 1e6);
+    printf("\n");
+    return 0;
+}
@@ -0,0 +1,149 @@
+//
+// Copyright 2015, Oliver Jowett <oliver@mutability.co.uk>
+//
+
+// This file is free software: you may copy, redistribute and/or modify it  
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 2 of the License, or (at your  
+// option) any later version.  
+//
+// This file is distributed in the hope that it will be useful, but  
+// WITHOUT ANY WARRANTY; without even the implied warranty of  
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU  
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License  
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <semaphore.h>
+#include <errno.h>
+
+#include "sample_queue.h"
+
+struct sample_queue {
+    unsigned depth;
+    size_t block_size;  // bytes, including the header
+    char *blocks;
+
+    // head and tail only ever increase; the block
+    // in use is (index % depth). head is written
+    // only by the producer, tail only by the consumer.
+    atomic_uint head;
+    atomic_uint tail;
+
+    // counts queued blocks, so the consumer can sleep
+    sem_t queued;
+
+    atomic_uint high_watermark;
+    atomic_uint_fast64_t overruns;
+};
+
+static struct sample_block *get_block(struct sample_queue *q, unsigned index)
+{
+    return (struct sample_block *) (q->blocks + (size_t)(index % q->depth) * q->block_size);
+}
+
+struct sample_queue *sample_queue_new(unsigned depth, unsigned block_samples)
+{
+    struct sample_queue *q;
+
+    if (depth == 0 || block_samples == 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    q = calloc(1, sizeof(*q));
+    if (!q)
+        return NULL;
+
+    q->depth = depth;
+    q->block_size = sizeof(struct sample_block) + block_samples * sizeof(uint16_t);
+    q->block_size = (q->block_size + 63) & ~(size_t)63; // keep blocks on separate cache lines
+    q->blocks = malloc(q->block_size * depth);
+    if (!q->blocks) {
+        free(q);
+        return NULL;
+    }
+
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+    atomic_init(&q->high_watermark, 0);
+    atomic_init(&q->overruns, 0);
+    if (sem_init(&q->queued, 0, 0) < 0) {
+        int save_errno = errno;
+        free(q->blocks);
+        free(q);
+        errno = save_errno;
+        return NULL;
+    }
+
+    return q;
+}
+
+void sample_queue_free(struct sample_queue *q)
+{
+    if (!q)
+        return;
+
+    sem_destroy(&q->queued);
+    free(q->blocks);
+    free(q);
+}
+
+struct sample_block *sample_queue_get_free(struct sample_queue *q)
+{
+    unsigned head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+
+    if (head - tail >= q->depth)
+        return NULL; // full
+
+    return get_block(q, head);
+}
+
+void sample_queue_push(struct sample_queue *q)
+{
+    unsigned head = atomic_load_explicit(&q->head, memory_order_relaxed) + 1;
+    unsigned fill = head - atomic_load_explicit(&q->tail, memory_order_relaxed);
+
+    atomic_store_explicit(&q->head, head, memory_order_release);
+    if (fill > atomic_load_explicit(&q->high_watermark, memory_order_relaxed))
+        atomic_store_explicit(&q->high_watermark, fill, memory_order_relaxed);
+
+    sem_post(&q->queued);
+}
+
+void sample_queue_overrun(struct sample_queue *q)
+{
+    atomic_fetch_add_explicit(&q->overruns, 1, memory_order_relaxed);
+}
+
+struct sample_block *sample_queue_wait(struct sample_queue *q)
+{
+    while (sem_wait(&q->queued) < 0)
+        ; // EINTR
+
+    return get_block(q, atomic_load_explicit(&q->tail, memory_order_relaxed));
+}
+
+void sample_queue_pop(struct sample_queue *q)
+{
+    atomic_fetch_add_explicit(&q->tail, 1, memory_order_release);
+}
+
+unsigned sample_queue_fill(struct sample_queue *q)
+{
+    return atomic_load_explicit(&q->head, memory_order_acquire) - atomic_load_explicit(&q->tail, memory_order_acquire);
+}
+
+unsigned sample_queue_high_watermark(struct sample_queue *q)
+{
+    return atomic_load_explicit(&q->high_watermark, memory_order_relaxed);
+}
+
+uint64_t sample_queue_overruns(struct sample_queue *q)
+{
+    return atomic_load_explicit(&q->overruns, memory_order_relaxed);
+}
@@ -0,0 +1,73 @@
+//
+// Copyright 2015, Oliver Jowett <oliver@mutability.co.uk>
+//
+
+// This file is free software: you may copy, redistribute and/or modify it  
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 2 of the License, or (at your  
+// option) any later version.  
+//
+// This file is distributed in the hope that it will be useful, but  
+// WITHOUT ANY WARRANTY; without even the implied warranty of  
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU  
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License  
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef DUMP978_SAMPLE_QUEUE_H
+#define DUMP978_SAMPLE_QUEUE_H
+
+#include <stdint.h>
+
+// A lock-free single-producer, single-consumer queue of
+// preallocated blocks of samples.
+//
+// The producer fills the block returned by sample_queue_get_free()
+// and then calls sample_queue_push(); the consumer waits for a
+// block with sample_queue_wait(), uses it, and then calls
+// sample_queue_pop(). The producer never blocks: if the queue is
+// full, it should drop its data and call sample_queue_overrun().
+
+struct sample_block {
+    uint64_t offset;   // sample offset of samples[0] in the input stream
+    int count;         // number of samples; 0 marks the end of input
+    uint16_t samples[];
+};
+
+struct sample_queue;
+
+// Allocate a new queue of 'depth' blocks, each holding up to
+// 'block_samples' samples. Returns NULL on error with errno set.
+struct sample_queue *sample_queue_new(unsigned depth, unsigned block_samples);
+
+// Free a queue. Neither side may be using it.
+void sample_queue_free(struct sample_queue *q);
+
+// Producer side: return the next free block, or NULL if the queue is full.
+struct sample_block *sample_queue_get_free(struct sample_queue *q);
+
+// Producer side: make the block returned by sample_queue_get_free()
+// available to the consumer.
+void sample_queue_push(struct sample_queue *q);
+
+// Producer side: record that a block's worth of data was dropped
+// because the queue was full.
+void sample_queue_overrun(struct sample_queue *q);
+
+// Consumer side: wait for, and return, the oldest queued block.
+struct sample_block *sample_queue_wait(struct sample_queue *q);
+
+// Consumer side: release the block returned by sample_queue_wait().
+void sample_queue_pop(struct sample_queue *q);
+
+// Return the number of blocks currently queued.
+unsigned sample_queue_fill(struct sample_queue *q);
+
+// Return the maximum number of blocks that have been queued at once.
+unsigned sample_queue_high_watermark(struct sample_queue *q);
+
+// Return the number of times sample_queue_overrun() was called.
+uint64_t sample_queue_overruns(struct sample_queue *q);
+
+#endif
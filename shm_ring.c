@@ -0,0 +1,233 @@
+//
+// Copyright 2015, Oliver Jowett <oliver@mutability.co.uk>
+//
+
+// This file is free software: you may copy, redistribute and/or modify it  
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 2 of the License, or (at your  
+// option) any later version.  
+//
+// This file is distributed in the hope that it will be useful, but  
+// WITHOUT ANY WARRANTY; without even the implied warranty of  
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU  
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License  
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "shm_ring.h"
+
+static size_t ring_size(unsigned slot_count)
+{
+    return sizeof(struct shm_ring) + (size_t)slot_count * sizeof(struct shm_ring_slot);
+}
+
+static int pid_gone(pid_t pid)
+{
+    return (pid <= 0 || (kill(pid, 0) < 0 && errno == ESRCH));
+}
+
+// Decide whether the existing object 'name' can be replaced. Returns 1
+// if so: it is a ring whose writer has gone, or one whose writer died
+// before finishing setting it up, or one from another version of the
+// ring whose writer has gone. Returns 0 with errno EEXIST if a writer
+// may still be using it (or another errno if it can't be read), or -1
+// with errno EPROTO if it isn't a ring.
+static int ring_is_stale(const char *name)
+{
+    const struct shm_ring *ring;
+    struct stat st;
+    int fd, stale, save_errno;
+
+    fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+        return (errno == ENOENT); // already gone
+
+    if (fstat(fd, &st) < 0) {
+        save_errno = errno;
+        close(fd);
+        errno = save_errno;
+        return 0;
+    }
+
+    if (st.st_size < sizeof(struct shm_ring)) {
+        close(fd);
+        return 1; // the writer never got as far as sizing it
+    }
+
+    ring = mmap(NULL, sizeof(struct shm_ring), PROT_READ, MAP_SHARED, fd, 0);
+    save_errno = errno;
+    close(fd);
+    if (ring == MAP_FAILED) {
+        errno = save_errno;
+        return 0;
+    }
+
+    if (ring->magic == SHM_RING_MAGIC && ring->version == SHM_RING_VERSION) {
+        stale = shm_ring_writer_gone(ring);
+        errno = EEXIST;
+    } else if (ring->magic == SHM_RING_MAGIC || ring->magic == 0) {
+        // another version, or the writer didn't get as far as the
+        // magic number; either way, writer_pid is where we expect it
+        stale = pid_gone(ring->writer_pid);
+        errno = EEXIST;
+    } else {
+        stale = -1;
+        errno = EPROTO;
+    }
+
+    munmap((void *) ring, sizeof(struct shm_ring));
+    return stale;
+}
+
+struct shm_ring *shm_ring_create(const char *name, unsigned slot_count)
+{
+    struct shm_ring *ring;
+    size_t size;
+    int fd, save_errno;
+
+    if (slot_count == 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    // Always start from a fresh object rather than resizing one that an
+    // old reader may still have mapped; that reader sees the old ring
+    // closed. Only a ring left behind by a writer that has gone is
+    // replaced, so a second writer can't take over a ring in use.
+    fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0 && errno == EEXIST) {
+        if (ring_is_stale(name) <= 0)
+            return NULL;
+        shm_unlink(name);
+        fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    }
+    if (fd < 0)
+        return NULL;
+
+    size = ring_size(slot_count);
+    if (ftruncate(fd, size) < 0)
+        goto fail;
+
+    ring = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (ring == MAP_FAILED)
+        goto fail;
+    close(fd);
+
+    // the object is zero-filled, so every slot starts with seq 0
+    ring->version = SHM_RING_VERSION;
+    ring->slot_count = slot_count;
+    ring->slot_size = sizeof(struct shm_ring_slot);
+    ring->writer_pid = getpid();
+    atomic_init(&ring->closed, 0);
+    atomic_init(&ring->head, 0);
+    atomic_thread_fence(memory_order_release);
+    ring->magic = SHM_RING_MAGIC;
+    return ring;
+
+ fail:
+    save_errno = errno;
+    close(fd);
+    shm_unlink(name);
+    errno = save_errno;
+    return NULL;
+}
+
+void shm_ring_publish(struct shm_ring *ring, frame_type_t type,
+                      const uint8_t *data, int len, int rs_errors)
+{
+    uint64_t n = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    struct shm_ring_slot *slot = &ring->slots[n % ring->slot_count];
+
+    if (len > sizeof(slot->data))
+        len = sizeof(slot->data);
+
+    atomic_store_explicit(&slot->seq, 2*n + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    slot->type = type;
+    slot->rs_errors = rs_errors;
+    slot->len = len;
+    memcpy(slot->data, data, len);
+
+    atomic_store_explicit(&slot->seq, 2*n + 2, memory_order_release);
+    atomic_store_explicit(&ring->head, n + 1, memory_order_release);
+}
+
+void shm_ring_close(struct shm_ring *ring, const char *name)
+{
+    if (!ring)
+        return;
+
+    atomic_store_explicit(&ring->closed, 1, memory_order_release);
+    shm_unlink(name);
+    munmap(ring, ring_size(ring->slot_count));
+}
+
+const struct shm_ring *shm_ring_attach(const char *name, size_t *size)
+{
+    const struct shm_ring *ring;
+    struct stat st;
+    int fd, save_errno;
+
+    fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+        return NULL;
+
+    if (fstat(fd, &st) < 0)
+        goto fail;
+
+    if (st.st_size < sizeof(struct shm_ring)) {
+        errno = EPROTO;
+        goto fail;
+    }
+
+    ring = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (ring == MAP_FAILED)
+        goto fail;
+    close(fd);
+
+    if (ring->magic != SHM_RING_MAGIC ||
+        ring->version != SHM_RING_VERSION ||
+        ring->slot_size != sizeof(struct shm_ring_slot) ||
+        ring->slot_count == 0 ||
+        st.st_size < ring_size(ring->slot_count)) {
+        munmap((void *) ring, st.st_size);
+        errno = EPROTO;
+        return NULL;
+    }
+    atomic_thread_fence(memory_order_acquire);
+
+    *size = st.st_size;
+    return ring;
+
+ fail:
+    save_errno = errno;
+    close(fd);
+    errno = save_errno;
+    return NULL;
+}
+
+void shm_ring_detach(const struct shm_ring *ring, size_t size)
+{
+    if (ring)
+        munmap((void *) ring, size);
+}
+
+int shm_ring_writer_gone(const struct shm_ring *ring)
+{
+    if (atomic_load_explicit((atomic_int *) &ring->closed, memory_order_acquire))
+        return 1;
+
+    // a writer killed by a signal never gets to close the ring
+    return pid_gone(ring->writer_pid);
+}
@@ -0,0 +1,92 @@
+//
+// Copyright 2015, Oliver Jowett <oliver@mutability.co.uk>
+//
+
+// This file is free software: you may copy, redistribute and/or modify it  
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 2 of the License, or (at your  
+// option) any later version.  
+//
+// This file is distributed in the hope that it will be useful, but  
+// WITHOUT ANY WARRANTY; without even the implied warranty of  
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU  
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License  
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef DUMP978_SHM_RING_H
+#define DUMP978_SHM_RING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <sys/types.h>
+
+#include "uat.h"
+#include "reader.h"
+
+// A ring of demodulated frames in POSIX shared memory, written by
+// one dump978 process and read by any number of local consumers.
+//
+// Frame n (counting from 0) goes in slot n % slot_count. Each slot
+// carries a sequence number, written like a seqlock: 2n+1 while
+// frame n is being copied in, 2n+2 once it is complete. The writer
+// never waits for readers; a reader that falls a whole ring behind
+// sees a later sequence number than it expected and skips ahead,
+// counting the frames it missed.
+
+#define SHM_RING_MAGIC   0x55415452  // "UATR"
+#define SHM_RING_VERSION 1
+#define SHM_RING_SLOTS   4096
+
+struct shm_ring_slot {
+    atomic_uint_fast64_t seq;
+    uint8_t type;       // frame_type_t
+    uint8_t rs_errors;  // corrected Reed-Solomon errors
+    uint16_t len;
+    uint8_t data[UPLINK_FRAME_DATA_BYTES];
+};
+
+// magic, version and writer_pid stay where they are in every version,
+// so that a writer can tell whether any old ring is still in use.
+struct shm_ring {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slot_count;
+    uint32_t slot_size;     // sizeof(struct shm_ring_slot) of the writer
+    pid_t writer_pid;
+    atomic_int closed;      // set once the writer has published its last frame
+    atomic_uint_fast64_t head;  // number of frames published
+    struct shm_ring_slot slots[];
+};
+
+// Writer side: create and map a ring named 'name', which should start
+// with a slash. An existing ring of the same name, of any version or
+// left half set up, is replaced only if its writer has gone (see
+// shm_ring_writer_gone); otherwise this fails with EEXIST. It fails
+// with EPROTO if 'name' exists but isn't a ring at all.
+// Returns NULL on error with errno set.
+struct shm_ring *shm_ring_create(const char *name, unsigned slot_count);
+
+// Writer side: copy a frame into the next slot.
+void shm_ring_publish(struct shm_ring *ring, frame_type_t type,
+                      const uint8_t *data, int len, int rs_errors);
+
+// Writer side: mark the ring closed so readers see end of input,
+// then unlink and unmap it.
+void shm_ring_close(struct shm_ring *ring, const char *name);
+
+// Reader side: map an existing ring read-only, storing the size of the
+// mapping in *size. Returns NULL on error with errno set (EPROTO if the
+// ring has an unexpected layout).
+const struct shm_ring *shm_ring_attach(const char *name, size_t *size);
+
+// Reader side: unmap a ring returned by shm_ring_attach().
+void shm_ring_detach(const struct shm_ring *ring, size_t size);
+
+// Reader side: return nonzero if the writer has closed the ring
+// or has gone away without closing it.
+int shm_ring_writer_gone(const struct shm_ring *ring);
+
+#endif
@@ -41,4 +41,9 @@
 #define UPLINK_FRAME_DATA_BYTES (UPLINK_FRAME_DATA_BITS/8)
 #define UPLINK_FRAME_BYTES (UPLINK_FRAME_BITS/8)
 
+// Sync words (36 bits) that precede each frame
+
+#define ADSB_SYNC_WORD   0xEACDDA4E2UL
+#define UPLINK_SYNC_WORD 0x153225B1DUL
+
 #endif
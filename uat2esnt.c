@@ -671,13 +671,15 @@ static void handle_frame(frame_type_t type, uint8_t *frame, int len, void *extra
 void usage(int argc, char **argv)
 {
     fprintf(stderr,
-            "usage: %s [-t]\n"
+            "usage: %s [-m <name>] [-t]\n"
             "\n"
             "Reads UAT downlink messages from stdin and writes ADS-B ES/NT messages\n"
             "(1090MHz-style) to stdout.\n"
             "\n"
-            "  -t   Disable forwarding of TIS-B traffic\n"
-            "  -h   Show this usage message\n",
+            "  -m <name>  Read messages from dump978's shared-memory ring <name>\n"
+            "             instead of stdin\n"
+            "  -t         Disable forwarding of TIS-B traffic\n"
+            "  -h         Show this usage message\n",
             argv[0]);
 }
 
@@ -685,14 +687,19 @@ int main(int argc, char **argv)
 {
     struct dump978_reader *reader;
     int framecount;
+    const char *shm_name = NULL;
     int opt;
 
-    while ((opt = getopt(argc, argv, "ht")) > 0) {
+    while ((opt = getopt(argc, argv, "hm:t")) > 0) {
         switch (opt) {
         case 'h':
             usage(argc, argv);
             return 0;
 
+        case 'm':
+            shm_name = optarg;
+            break;
+
         case 't':
             use_tisb = 0;
             break;
@@ -710,9 +717,9 @@ int main(int argc, char **argv)
 
     initCrcTables();
 
-    reader = dump978_reader_new(0,0);
+    reader = shm_name ? dump978_reader_new_shm(shm_name,0) : dump978_reader_new(0,0);
     if (!reader) {
-        perror("dump978_reader_new");
+        perror(shm_name ? shm_name : "dump978_reader_new");
         return 1;
     }
     
@@ -0,0 +1,288 @@
+//
+// Copyright 2015, Oliver Jowett <oliver@mutability.co.uk>
+//
+
+// This file is free software: you may copy, redistribute and/or modify it  
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation, either version 2 of the License, or (at your  
+// option) any later version.  
+//
+// This file is distributed in the hope that it will be useful, but  
+// WITHOUT ANY WARRANTY; without even the implied warranty of  
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU  
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License  
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Modulate UAT frames into 8-bit I/Q samples, the reverse of dump978.
+// Used to build the demodulator test corpus (see corpus/README).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include "uat.h"
+#include "fec.h"
+#include "reader.h"
+
+#define SAMPLE_RATE (2083334.0)
+#define SYNC_BITS (36)
+
+// Each bit is two samples; the modulation index is 0.6, so the
+// phase moves by +/- 0.3*pi per sample
+#define PHASE_STEP (0.3 * M_PI)
+
+// Silence before the first and after the last burst, in samples
+#define LEAD_SAMPLES (2000)
+
+static double amplitude = 0.75;
+static double noise = 0;
+static double freq_offset = 0;
+static int gap_bits = 100;
+static double overlap = 0;
+static double weak_db = 0;
+static uint64_t rng_state = 1;
+
+struct burst {
+    uint8_t bytes[UPLINK_FRAME_BYTES];
+    int len;          // bytes, after the sync word
+    uint64_t sync;
+};
+
+static struct burst *bursts;
+static int n_bursts, max_bursts;
+
+// xorshift64*: the same sequence everywhere, so a given seed
+// always produces the same samples
+static uint64_t rng_next(void)
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+static double rng_uniform(void)
+{
+    return ((rng_next() >> 11) + 0.5) / 9007199254740992.0;
+}
+
+static double rng_gauss(void)
+{
+    return sqrt(-2 * log(rng_uniform())) * cos(2 * M_PI * rng_uniform());
+}
+
+static void handle_frame(frame_type_t type, uint8_t *frame, int len, void *extra)
+{
+    struct burst *b;
+
+    if (n_bursts == max_bursts) {
+        max_bursts = max_bursts ? max_bursts * 2 : 256;
+        bursts = realloc(bursts, max_bursts * sizeof(*bursts));
+        if (!bursts) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+
+    b = &bursts[n_bursts];
+    memset(b, 0, sizeof(*b));
+
+    if (type == UAT_UPLINK) {
+        if (len != UPLINK_FRAME_DATA_BYTES)
+            return;
+        encode_uplink_frame(frame, b->bytes);
+        b->len = UPLINK_FRAME_BYTES;
+        b->sync = UPLINK_SYNC_WORD;
+    } else {
+        if (len != SHORT_FRAME_DATA_BYTES && len != LONG_FRAME_DATA_BYTES)
+            return;
+        if (len != ((frame[0] >> 3) == 0 ? SHORT_FRAME_DATA_BYTES : LONG_FRAME_DATA_BYTES))
+            return; // payload type doesn't match the length
+        memcpy(b->bytes, frame, len);
+        b->len = encode_adsb_frame(b->bytes);
+        b->sync = ADSB_SYNC_WORD;
+    }
+
+    ++n_bursts;
+}
+
+static int burst_samples(const struct burst *b)
+{
+    return (SYNC_BITS + b->len * 8) * 2;
+}
+
+// Add burst 'b' to the signal starting at sample 'start'
+static void add_burst(float *iq, int start, const struct burst *b, double amp)
+{
+    double phase = 2 * M_PI * rng_uniform();
+    double carrier = 2 * M_PI * freq_offset / SAMPLE_RATE;
+    int nbits = SYNC_BITS + b->len * 8;
+    int i, j;
+    float *out = iq + 2 * start;
+
+    for (i = 0; i < nbits; ++i) {
+        int bit;
+        if (i < SYNC_BITS)
+            bit = (b->sync >> (SYNC_BITS - 1 - i)) & 1;
+        else
+            bit = (b->bytes[(i - SYNC_BITS) / 8] >> (7 - (i - SYNC_BITS) % 8)) & 1;
+
+        for (j = 0; j < 2; ++j) {
+            phase += (bit ? PHASE_STEP : -PHASE_STEP) + carrier;
+            *out++ += amp * cos(phase);
+            *out++ += amp * sin(phase);
+        }
+    }
+}
+
+static void usage(int argc, char **argv)
+{
+    fprintf(stderr,
+            "usage: %s [-a <amplitude>] [-n <noise>] [-f <hz>] [-g <bits>] [-O <fraction>] [-w <dB>] [-s <seed>]\n"
+            "\n"
+            "Reads UAT messages on stdin and writes them to stdout as 8-bit I/Q\n"
+            "samples at 2.083334MHz, as dump978 expects. The output depends only\n"
+            "on the input and the options.\n"
+            "\n"
+            "  -a <amplitude>  Signal amplitude as a fraction of full scale (default 0.75)\n"
+            "  -n <noise>      Standard deviation of added Gaussian noise, as a\n"
+            "                  fraction of full scale (default 0)\n"
+            "  -f <hz>         Carrier frequency offset (default 0)\n"
+            "  -g <bits>       Silence between bursts (default 100)\n"
+            "  -O <fraction>   Overlap bursts: start each one this fraction of the way\n"
+            "                  through the previous one\n"
+            "  -w <dB>         Attenuate every other burst by this much (default 0)\n"
+            "  -s <seed>       Seed for the random noise and carrier phases (default 1)\n"
+            "  -h              Show this usage message\n",
+            argv[0]);
+}
+
+int main(int argc, char **argv)
+{
+    struct dump978_reader *reader;
+    int framecount;
+    int opt, i;
+    int total, start;
+    float *iq;
+    uint8_t *out;
+
+    while ((opt = getopt(argc, argv, "ha:n:f:g:O:w:s:")) > 0) {
+        switch (opt) {
+        case 'h':
+            usage(argc, argv);
+            return 0;
+
+        case 'a':
+            amplitude = atof(optarg);
+            break;
+
+        case 'n':
+            noise = atof(optarg);
+            break;
+
+        case 'f':
+            freq_offset = atof(optarg);
+            break;
+
+        case 'g':
+            gap_bits = atoi(optarg);
+            break;
+
+        case 'O':
+            overlap = atof(optarg);
+            break;
+
+        case 'w':
+            weak_db = atof(optarg);
+            break;
+
+        case 's':
+            rng_state = strtoull(optarg, NULL, 0) * 2 + 1;
+            break;
+
+        default:
+            usage(argc, argv);
+            return 1;
+        }
+    }
+
+    if (optind < argc || overlap < 0 || overlap >= 1 || gap_bits < 0) {
+        usage(argc, argv);
+        return 1;
+    }
+
+    init_fec();
+
+    reader = dump978_reader_new(0,0);
+    if (!reader) {
+        perror("dump978_reader_new");
+        return 1;
+    }
+
+    while ((framecount = dump978_read_frames(reader, handle_frame, NULL)) > 0)
+        ;
+
+    if (framecount < 0) {
+        perror("dump978_read_frames");
+        return 1;
+    }
+
+    dump978_reader_free(reader);
+
+    // lay out the bursts
+    total = start = LEAD_SAMPLES;
+    for (i = 0; i < n_bursts; ++i) {
+        int end = start + burst_samples(&bursts[i]);
+        if (end > total)
+            total = end;
+        if (overlap > 0)
+            start += (int) (burst_samples(&bursts[i]) * overlap);
+        else
+            start = end + gap_bits * 2;
+    }
+    total += LEAD_SAMPLES;
+
+    iq = calloc(total * 2, sizeof(float));
+    out = malloc(total * 2);
+    if (!iq || !out) {
+        perror("malloc");
+        return 1;
+    }
+
+    start = LEAD_SAMPLES;
+    for (i = 0; i < n_bursts; ++i) {
+        double amp = amplitude;
+        if (i & 1)
+            amp *= pow(10, -weak_db / 20);
+        add_burst(iq, start, &bursts[i], amp);
+        if (overlap > 0)
+            start += (int) (burst_samples(&bursts[i]) * overlap);
+        else
+            start += burst_samples(&bursts[i]) + gap_bits * 2;
+    }
+
+    for (i = 0; i < total * 2; ++i) {
+        double v = 127.5 + 127.5 * (iq[i] + (noise > 0 ? noise * rng_gauss() : 0));
+        if (v < 0)
+            v = 0;
+        if (v > 255)
+            v = 255;
+        out[i] = (uint8_t) v;
+    }
+
+    if (fwrite(out, 1, total * 2, stdout) != total * 2) {
+        perror("fwrite");
+        return 1;
+    }
+
+    free(iq);
+    free(out);
+    free(bursts);
+    return 0;
+}
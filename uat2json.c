@@ -20,91 +20,42 @@
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
+#include <unistd.h>
 
 #include <time.h>
-#include <sys/select.h>
 #include <errno.h>
+#include <netdb.h>
+#include <sys/socket.h>
 
 #include "uat.h"
 #include "uat_decode.h"
 #include "reader.h"
+#include "aircraft_table.h"
 
-#define NON_ICAO_ADDRESS 0x1000000U
-
-struct aircraft {
-    struct aircraft *next;
-    uint32_t address;
-
-    uint32_t messages;
-    time_t last_seen;
-    time_t last_seen_pos;
-
-    int position_valid : 1;
-    int altitude_valid : 1;
-    int track_valid : 1;
-    int speed_valid : 1;
-    int vert_rate_valid : 1;
-
-    airground_state_t airground_state;
-    char callsign[9];
-    char squawk[9];
-
-    // if position_valid:
-    double lat;
-    double lon;
-
-    // if altitude_valid:
-    int32_t altitude; // in feet
-    
-    // if track_valid:
-    uint16_t track;
-
-    // if speed_valid:
-    uint16_t speed; // in kts
-
-    // if vert_rate_valid:
-    int16_t vert_rate; // in ft/min
-};        
-
-static struct aircraft *aircraft_list;
+static struct aircraft_table *aircraft;
 static time_t NOW;
 static const char *json_dir;
 
-static struct aircraft *find_aircraft(uint32_t address)
-{
-    struct aircraft *a;
-    for (a = aircraft_list; a; a = a->next)
-        if (a->address == address)
-            return a;
-    return NULL;
-}
-
 static struct aircraft *find_or_create_aircraft(uint32_t address)
 {
-    struct aircraft *a = find_aircraft(address);
+    struct aircraft *a = aircraft_table_find(aircraft, address);
     if (a)
         return a;
 
-    a = calloc(1, sizeof(*a));
-    a->address = address;
-    a->airground_state = AG_RESERVED;
-
-    a->next = aircraft_list;
-    aircraft_list = a;
+    a = aircraft_table_add(aircraft, address);
+    if (a)
+        a->airground_state = AG_RESERVED;
 
     return a;
 }
 
 static void expire_old_aircraft()
 {
-    struct aircraft *a, **last;    
-    for (last = &aircraft_list, a = *last; a; a = *last) {
-        if ((NOW - a->last_seen) > 300) {
-            *last = a->next;
-            free(a);
-        } else {
-            last = &a->next;
-        }
+    struct aircraft *a, *next;
+    for (a = aircraft_table_first(aircraft); a; a = next) {
+        next = a->next;
+        if ((NOW - a->last_seen) > 300)
+            aircraft_table_remove(aircraft, a);
     }
 }
 
@@ -129,6 +80,8 @@ static void process_mdb(struct uat_adsb_mdb *mdb)
     }
    
     a = find_or_create_aircraft(addr);
+    if (!a)
+        return; // out of memory
     a->last_seen = NOW;
     ++a->messages;
     
@@ -235,8 +188,8 @@ static int write_aircraft_json(const char *dir)
             message_count);
     
 
-    for (a = aircraft_list; a; a = a->next) {
-        if (a != aircraft_list)
+    for (a = aircraft_table_first(aircraft); a; a = a->next) {
+        if (a != aircraft_table_first(aircraft))
             fprintf(f, ",\n");
         fprintf(f,
                 "    {\"hex\":\"%s%06x\"",
@@ -284,7 +237,7 @@ static void periodic_work()
     }
 }
 
-static void handle_frame(frame_type_t type, uint8_t *frame, int len, void *extra)
+static void handle_frame(frame_type_t type, uint8_t *frame, int len)
 {
     struct uat_adsb_mdb mdb;
 
@@ -311,68 +264,156 @@ static void handle_frame(frame_type_t type, uint8_t *frame, int len, void *extra
     process_mdb(&mdb);
 }                                                        
 
-static void read_loop()
+static void handle_batch(const struct dump978_frame *frames, int count, void *extra)
 {
-    struct dump978_reader *reader;
+    int i;
 
-    reader = dump978_reader_new(0, 1);
-    if (!reader) {
-        perror("dump978_reader_new");
-        return;
+    NOW = time(NULL);
+    for (i = 0; i < count; ++i)
+        handle_frame(frames[i].type, frames[i].data, frames[i].len);
+}
+
+// Connect to a TCP feed of dump978 output at "host:port".
+// Returns the socket, or -1 after reporting an error.
+static int connect_feed(const char *spec)
+{
+    struct addrinfo hints, *res, *ai;
+    char host[256];
+    const char *colon = strrchr(spec, ':');
+    int fd = -1, err;
+
+    if (!colon || colon == spec || (size_t) (colon - spec) >= sizeof(host)) {
+        fprintf(stderr, "%s: expected host:port\n", spec);
+        return -1;
     }
 
-    for (;;) {
-        fd_set readset, writeset, excset;
-        struct timeval timeout;
-        int framecount;
+    memcpy(host, spec, colon - spec);
+    host[colon - spec] = 0;
 
-        FD_ZERO(&readset);
-        FD_ZERO(&writeset);
-        FD_ZERO(&excset);
-        FD_SET(0, &readset);
-        FD_SET(0, &excset);
-        timeout.tv_sec = 0;
-        timeout.tv_usec = 500000;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if ((err = getaddrinfo(host, colon + 1, &hints, &res)) != 0) {
+        fprintf(stderr, "%s: %s\n", spec, gai_strerror(err));
+        return -1;
+    }
 
-        select(1, &readset, &writeset, &excset, &timeout);
+    for (ai = res; ai; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0)
+            continue;
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+            break;
+        close(fd);
+        fd = -1;
+    }
 
-        NOW = time(NULL);
-        framecount = dump978_read_frames(reader, handle_frame, NULL);
+    if (fd < 0)
+        fprintf(stderr, "%s: %m\n", spec);
+    freeaddrinfo(res);
+    return fd;
+}
 
-        if (framecount == 0)
-            break;
+// Add a source to the poller, numbering sources in the order given.
+// 'flags' are as for dump978_poller_add().
+static int add_source(struct dump978_poller *poller, struct dump978_reader *reader, int flags, const char *what)
+{
+    if (!reader || dump978_poller_add(poller, reader, dump978_poller_sources(poller), flags) < 0) {
+        perror(what);
+        dump978_reader_free(reader);
+        return 0;
+    }
+
+    return 1;
+}
 
-        if (framecount < 0 && errno != EAGAIN && errno != EINTR && errno != EWOULDBLOCK) {
-            perror("dump978_read_frames");
+static void read_loop(struct dump978_poller *poller)
+{
+    // wake at least every half second to age out aircraft
+    while (dump978_poller_sources(poller) > 0) {
+        if (dump978_poller_wait(poller, 500, handle_batch, NULL) < 0) {
+            perror("dump978_poller_wait");
             break;
         }
 
+        NOW = time(NULL);
         periodic_work();
     }
-
-    dump978_reader_free(reader);
-}                    
+}
 
 int main(int argc, char **argv)
 {
-    if (argc < 2) {
+    struct dump978_poller *poller;
+    const char *shm_names[argc], *feeds[argc];
+    int n_shm = 0, n_feeds = 0;
+    int i, opt, bad = 0;
+
+    while ((opt = getopt(argc, argv, "m:c:")) > 0) {
+        switch (opt) {
+        case 'm':
+            shm_names[n_shm++] = optarg;
+            break;
+
+        case 'c':
+            feeds[n_feeds++] = optarg;
+            break;
+
+        default:
+            bad = 1;
+            break;
+        }
+    }
+
+    if (bad || optind != argc - 1) {
         fprintf(stderr,
-                "Syntax: %s <dir>\n"
+                "Syntax: %s [-m <name>] [-c <host:port>] <dir>\n"
                 "\n"
-                "Reads UAT messages on stdin.\n"
+                "Reads UAT messages on stdin, or with -m from dump978's\n"
+                "shared-memory ring <name>, or with -c from a TCP connection\n"
+                "to <host:port>. -m and -c may be given more than once to\n"
+                "merge several feeds.\n"
                 "Periodically writes aircraft state to <dir>/aircraft.json\n"
                 "Also writes <dir>/receiver.json once on startup\n",
                 argv[0]);
         return 1;
     }
 
-    json_dir = argv[1];
+    json_dir = argv[optind];
+
+    aircraft = aircraft_table_new();
+    if (!aircraft) {
+        perror("aircraft_table_new");
+        return 1;
+    }
 
     if (!write_receiver_json(json_dir)) {
         fprintf(stderr, "Failed to write receiver.json - check permissions?\n");
         return 1;
     }
-    read_loop();
+
+    poller = dump978_poller_new();
+    if (!poller) {
+        perror("dump978_poller_new");
+        return 1;
+    }
+
+    for (i = 0; i < n_shm; ++i) {
+        if (!add_source(poller, dump978_reader_new_shm(shm_names[i], 1), 0, shm_names[i]))
+            return 1;
+    }
+
+    for (i = 0; i < n_feeds; ++i) {
+        int fd = connect_feed(feeds[i]);
+        if (fd < 0 || !add_source(poller, dump978_reader_new(fd, 1), DUMP978_POLLER_CLOSE_FD, feeds[i]))
+            return 1;
+    }
+
+    if (n_shm == 0 && n_feeds == 0 && !add_source(poller, dump978_reader_new(0, 1), 0, "stdin"))
+        return 1;
+
+    read_loop(poller);
+    dump978_poller_free(poller);
     write_aircraft_json(json_dir);
+    aircraft_table_free(aircraft);
     return 0;
 }
@@ -16,46 +16,459 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
 
 #include "uat.h"
 #include "uat_decode.h"
 #include "reader.h"
+#include "fisb_dedup.h"
+#include "fisb_reassembly.h"
 
-void handle_frame(frame_type_t type, uint8_t *frame, int len, void *extra)
+static struct fisb_dedup *dedup;
+static struct fisb_reassembly *reassembly;
+static int json;
+
+// Memory for segments of products still being reassembled, with -r
+#define REASSEMBLY_MEMORY (4 * 1024 * 1024)
+
+// Text of the messages decoded so far, written out whenever the input
+// runs dry or it reaches OUTPUT_CHUNK bytes
+#define OUTPUT_CHUNK 65536
+static struct uat_text output = UAT_TEXT_INIT;
+
+// Which info frames of an uplink frame are repeats, by index
+#define REPEAT_WORDS ((UPLINK_MAX_INFO_FRAMES + 31) / 32)
+typedef uint32_t repeat_mask_t[REPEAT_WORDS];
+
+// Find the FIS-B info frames of an uplink frame that have been shown
+// recently. This must see frames in input order, so is done before
+// they are handed out for decoding.
+static void find_repeats(uint8_t *frame, repeat_mask_t repeats)
 {
+    struct uat_uplink_iter iter;
+    struct uat_uplink_info_frame info;
+    time_t now = time(NULL);
+    unsigned i;
+
+    memset(repeats, 0, sizeof(repeat_mask_t));
+    uat_uplink_iter_init(&iter, frame);
+    for (i = 0; i < UPLINK_MAX_INFO_FRAMES && uat_uplink_next_info_frame(&iter, &info); ++i) {
+        if (fisb_dedup_seen(dedup, &info, now))
+            repeats[i / 32] |= 1U << (i % 32);
+    }
+}
+
+static void product_done(const struct fisb_apdu *apdu, const struct fisb_segment *segments, unsigned count, void *data)
+{
+    // only the counts are reported, at exit
+}
+
+// Pass the segmented FIS-B APDUs of an uplink frame to the reassembly
+// cache. Like find_repeats(), this must see frames in input order.
+static void reassemble(uint8_t *frame)
+{
+    struct uat_uplink_iter iter;
+    struct uat_uplink_info_frame info;
+    time_t now = time(NULL);
+
+    uat_uplink_iter_init(&iter, frame);
+    while (uat_uplink_next_info_frame(&iter, &info)) {
+        if (uat_decode_fisb_apdu(&info, &info.fisb) && info.fisb.s_flag)
+            fisb_reassembly_add(reassembly, &info.fisb, now, product_done, NULL);
+    }
+}
+
+// Decode one frame and append it to 'text', leaving out the info
+// frames marked in 'repeats' (if not NULL)
+static void format_frame(frame_type_t type, uint8_t *frame, const uint32_t *repeats, struct uat_text *text)
+{
+    int ok;
+
     if (type == UAT_DOWNLINK) {
         struct uat_adsb_mdb mdb;
         uat_decode_adsb_mdb(frame, &mdb);
-        uat_display_adsb_mdb(&mdb, stdout);
+        if (json)
+            ok = uat_format_adsb_json(&mdb, text);
+        else
+            ok = uat_format_adsb_mdb(&mdb, text);
     } else {
         struct uat_uplink_mdb mdb;
         uat_decode_uplink_mdb(frame, &mdb);
-        uat_display_uplink_mdb(&mdb, stdout);
+        if (repeats) {
+            unsigned i, kept = 0;
+            for (i = 0; i < mdb.num_info_frames; ++i) {
+                if (!(repeats[i / 32] & (1U << (i % 32))))
+                    mdb.info_frames[kept++] = mdb.info_frames[i];
+            }
+            mdb.num_info_frames = kept;
+        }
+        if (json)
+            ok = uat_format_uplink_json(&mdb, text);
+        else
+            ok = uat_format_uplink_mdb(&mdb, text);
     }
 
-    fprintf(stdout, "\n");
+    if (!ok || !uat_text_reserve(text, 1)) {
+        perror("uat_format");
+        exit(1);
+    }
+    text->buf[text->len++] = '\n';
+}
+
+static void flush_output(void)
+{
+    if (output.len > 0) {
+        fwrite(output.buf, 1, output.len, stdout);
+        output.len = 0;
+    }
     fflush(stdout);
-}        
+}
+
+static void handle_batch(const struct dump978_frame *frames, int count, void *extra)
+{
+    repeat_mask_t repeats;
+    int i;
+
+    for (i = 0; i < count; ++i) {
+        if (reassembly && frames[i].type == UAT_UPLINK)
+            reassemble(frames[i].data);
+
+        if (dedup && frames[i].type == UAT_UPLINK) {
+            find_repeats(frames[i].data, repeats);
+            format_frame(frames[i].type, frames[i].data, repeats, &output);
+        } else {
+            format_frame(frames[i].type, frames[i].data, NULL, &output);
+        }
+
+        if (output.len >= OUTPUT_CHUNK)
+            flush_output();
+    }
+}
+
+//
+// With -j, frames are copied into jobs of up to JOB_FRAMES frames,
+// which worker threads decode and format into each job's own buffer.
+// Jobs live in a ring of 'job_count' slots: those from next_write to
+// next_submit have been handed to the workers (those before next_claim
+// are being or have been formatted), and the slot at next_submit is
+// being filled by the main thread, which also writes out finished jobs
+// in order. Workers only touch a job between claiming it and marking
+// it done; everything else is done by the main thread.
+//
+
+#define JOB_FRAMES 256
+
+struct job {
+    int count;
+    int done;
+    struct uat_text text;
+    struct {
+        frame_type_t type;
+        int check_repeats;
+        repeat_mask_t repeats;
+        uint8_t data[UPLINK_FRAME_DATA_BYTES];
+    } frames[JOB_FRAMES];
+};
+
+static int threads;
+static pthread_t *workers;
+static struct job *jobs;
+static unsigned job_count;
+static unsigned long next_write, next_claim, next_submit;
+static int shutting_down;
+
+static pthread_mutex_t job_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t job_submitted = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t job_done = PTHREAD_COND_INITIALIZER;
+
+static struct job *job_slot(unsigned long n)
+{
+    return &jobs[n % job_count];
+}
+
+static void *worker_thread(void *arg)
+{
+    pthread_mutex_lock(&job_lock);
+    for (;;) {
+        struct job *job;
+        int i;
+
+        while (next_claim == next_submit && !shutting_down)
+            pthread_cond_wait(&job_submitted, &job_lock);
+        if (next_claim == next_submit)
+            break;
+
+        job = job_slot(next_claim++);
+        pthread_mutex_unlock(&job_lock);
+
+        job->text.len = 0;
+        for (i = 0; i < job->count; ++i)
+            format_frame(job->frames[i].type, job->frames[i].data,
+                         job->frames[i].check_repeats ? job->frames[i].repeats : NULL,
+                         &job->text);
+
+        pthread_mutex_lock(&job_lock);
+        job->done = 1;
+        pthread_cond_signal(&job_done);
+    }
+    pthread_mutex_unlock(&job_lock);
+
+    return NULL;
+}
+
+// Write out the oldest submitted job, waiting for it to be formatted
+// if 'wait' is set. Returns 1 if a job was written.
+static int write_job(int wait)
+{
+    struct job *job;
+
+    if (next_write == next_submit)
+        return 0;
+
+    job = job_slot(next_write);
+    pthread_mutex_lock(&job_lock);
+    while (!job->done) {
+        if (!wait) {
+            pthread_mutex_unlock(&job_lock);
+            return 0;
+        }
+        pthread_cond_wait(&job_done, &job_lock);
+    }
+    pthread_mutex_unlock(&job_lock);
+
+    fwrite(job->text.buf, 1, job->text.len, stdout);
+    job->done = 0;
+    job->count = 0;
+    ++next_write;
+    return 1;
+}
+
+static void submit_job(void)
+{
+    if (job_slot(next_submit)->count == 0)
+        return;
+
+    pthread_mutex_lock(&job_lock);
+    ++next_submit;
+    pthread_cond_signal(&job_submitted);
+    pthread_mutex_unlock(&job_lock);
+
+    // write out whatever is already finished, and make sure the next
+    // slot is free to fill
+    while (write_job(next_submit - next_write >= job_count))
+        ;
+}
+
+static void flush_jobs(void)
+{
+    submit_job();
+    while (write_job(1))
+        ;
+    fflush(stdout);
+}
+
+static void queue_batch(const struct dump978_frame *frames, int count, void *extra)
+{
+    int i;
+
+    for (i = 0; i < count; ++i) {
+        struct job *job = job_slot(next_submit);
+        int n = job->count++;
+
+        job->frames[n].type = frames[i].type;
+        memcpy(job->frames[n].data, frames[i].data, frames[i].len);
+        if (frames[i].len < LONG_FRAME_DATA_BYTES) {
+            // a short frame with a long payload type is decoded as if
+            // it had been padded with zeros
+            memset(job->frames[n].data + frames[i].len, 0, LONG_FRAME_DATA_BYTES - frames[i].len);
+        }
+        if (reassembly && frames[i].type == UAT_UPLINK)
+            reassemble(job->frames[n].data);
+        job->frames[n].check_repeats = (dedup && frames[i].type == UAT_UPLINK);
+        if (job->frames[n].check_repeats)
+            find_repeats(job->frames[n].data, job->frames[n].repeats);
+
+        if (job->count == JOB_FRAMES)
+            submit_job();
+    }
+}
+
+static void start_workers(void)
+{
+    int i;
+
+    // enough jobs to keep every worker busy while finished ones wait
+    // to be written out in order
+    job_count = threads * 2 + 1;
+    jobs = calloc(job_count, sizeof(*jobs));
+    workers = calloc(threads, sizeof(*workers));
+    if (!jobs || !workers) {
+        perror("calloc");
+        exit(1);
+    }
+
+    for (i = 0; i < threads; ++i) {
+        int err = pthread_create(&workers[i], NULL, worker_thread, NULL);
+        if (err) {
+            fprintf(stderr, "pthread_create: %s\n", strerror(err));
+            exit(1);
+        }
+    }
+}
+
+static void stop_workers(void)
+{
+    unsigned i;
+
+    pthread_mutex_lock(&job_lock);
+    shutting_down = 1;
+    pthread_cond_broadcast(&job_submitted);
+    pthread_mutex_unlock(&job_lock);
+
+    for (i = 0; i < (unsigned) threads; ++i)
+        pthread_join(workers[i], NULL);
+
+    for (i = 0; i < job_count; ++i)
+        uat_text_free(&jobs[i].text);
+    free(jobs);
+    free(workers);
+}
+
+static void usage(int argc, char **argv)
+{
+    fprintf(stderr,
+            "usage: %s [-J] [-d <seconds>] [-j <threads>] [-r <seconds>]\n"
+            "\n"
+            "Reads UAT messages from stdin and writes them to stdout in a\n"
+            "readable form.\n"
+            "\n"
+            "  -J            Write one JSON object per message per line (NDJSON)\n"
+            "  -d <seconds>  Don't repeat FIS-B products already shown in the last\n"
+            "                <seconds>, and report how many were skipped at exit\n"
+            "  -j <threads>  Decode and format on this many worker threads (0 for\n"
+            "                one per CPU); output stays in input order\n"
+            "  -r <seconds>  Reassemble segmented FIS-B products, giving up on\n"
+            "                incomplete ones after <seconds> without a new segment,\n"
+            "                and report how many were completed at exit\n"
+            "  -h            Show this usage message\n",
+            argv[0]);
+}
 
 int main(int argc, char **argv)
 {
     struct dump978_reader *reader;
+    frame_batch_handler_t handler;
     int framecount;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "hJd:j:r:")) > 0) {
+        switch (opt) {
+        case 'h':
+            usage(argc, argv);
+            return 0;
+
+        case 'J':
+            json = 1;
+            break;
+
+        case 'd':
+            dedup = fisb_dedup_new(FISB_DEDUP_DEFAULT_SLOTS, atoi(optarg));
+            if (!dedup) {
+                perror("fisb_dedup_new");
+                return 1;
+            }
+            break;
+
+        case 'r':
+            reassembly = fisb_reassembly_new(REASSEMBLY_MEMORY, atoi(optarg));
+            if (!reassembly) {
+                perror("fisb_reassembly_new");
+                return 1;
+            }
+            break;
+
+        case 'j':
+            threads = atoi(optarg);
+            if (threads <= 0)
+                threads = sysconf(_SC_NPROCESSORS_ONLN);
+            if (threads <= 0)
+                threads = 1;
+            break;
+
+        default:
+            usage(argc, argv);
+            return 1;
+        }
+    }
+
+    if (optind < argc) {
+        usage(argc, argv);
+        return 1;
+    }
 
-    reader = dump978_reader_new(0,0);
+    // nonblocking, so that output can be flushed whenever we would wait
+    reader = dump978_reader_new(0,1);
     if (!reader) {
         perror("dump978_reader_new");
         return 1;
     }
+
+    if (threads) {
+        start_workers();
+        handler = queue_batch;
+    } else {
+        handler = handle_batch;
+    }
     
-    while ((framecount = dump978_read_frames(reader, handle_frame, NULL)) > 0)
-        ;
+    for (;;) {
+        framecount = dump978_read_frame_batches(reader, handler, NULL);
+        if (framecount > 0)
+            continue;
+
+        if (threads)
+            flush_jobs();
+        else
+            flush_output();
+        if (framecount == 0)
+            break; // EOF
 
-    if (framecount < 0) {
-        perror("dump978_read_frames");
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            struct pollfd pfd = { 0, POLLIN, 0 };
+            poll(&pfd, 1, -1);
+            continue;
+        }
+
+        perror("dump978_read_frame_batches");
         return 1;
     }
 
+    if (threads)
+        stop_workers();
+    uat_text_free(&output);
+
+    if (dedup) {
+        const struct fisb_dedup_stats *stats = fisb_dedup_stats(dedup);
+        fprintf(stderr, "FIS-B products: %lu, repeats skipped: %lu (%.1f%%)\n",
+                stats->lookups, stats->hits,
+                stats->lookups ? 100.0 * stats->hits / stats->lookups : 0.0);
+        fisb_dedup_free(dedup);
+    }
+
+    if (reassembly) {
+        const struct fisb_reassembly_stats *stats = fisb_reassembly_stats(reassembly);
+        fprintf(stderr, "FIS-B segments: %lu (%lu duplicates, %lu invalid), products reassembled: %lu, "
+                "evicted: %lu, expired: %lu, incomplete at exit: %u\n",
+                stats->segments, stats->duplicates, stats->invalid, stats->completed,
+                stats->evicted, stats->expired, fisb_reassembly_pending(reassembly));
+        fisb_reassembly_free(reassembly);
+    }
+
     return 0;
 }
-
@@ -16,8 +16,8 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <math.h>
+#include <stdlib.h>
 #include <string.h>
-#include <assert.h>
 
 #include "uat.h"
 #include "uat_decode.h"
@@ -29,6 +29,165 @@ static void uat_decode_hdr(uint8_t *frame, struct uat_adsb_mdb *mdb)
     mdb->address = (frame[1] << 16) | (frame[2] << 8) | frame[3];
 }
 
+//
+// Text output. Messages are formatted into a struct uat_text by these
+// helpers rather than by stdio; the uat_format_*() functions reserve
+// room for the whole message first, so the helpers don't check it.
+//
+
+int uat_text_reserve(struct uat_text *text, size_t n)
+{
+    size_t size;
+    char *grown;
+
+    if (text->size - text->len >= n)
+        return 1;
+
+    size = text->size ? text->size : 4096;
+    while (size - text->len < n)
+        size *= 2;
+
+    grown = realloc(text->buf, size);
+    if (!grown)
+        return 0;
+
+    text->buf = grown;
+    text->size = size;
+    return 1;
+}
+
+void uat_text_free(struct uat_text *text)
+{
+    free(text->buf);
+    text->buf = NULL;
+    text->len = text->size = 0;
+}
+
+static const char digit_pairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static inline void put_mem(struct uat_text *text, const char *s, size_t n)
+{
+    memcpy(text->buf + text->len, s, n);
+    text->len += n;
+}
+
+// string literals only
+#define put_lit(text, s) put_mem((text), (s), sizeof(s) - 1)
+
+static inline void put_str(struct uat_text *text, const char *s)
+{
+    put_mem(text, s, strlen(s));
+}
+
+static inline void put_char(struct uat_text *text, char c)
+{
+    text->buf[text->len++] = c;
+}
+
+// "%u", or "%0<width>u"
+static void put_uint(struct uat_text *text, unsigned v, unsigned width)
+{
+    char tmp[16];
+    char *p = tmp + sizeof(tmp);
+
+    while (v >= 100) {
+        p -= 2;
+        memcpy(p, digit_pairs + (v % 100) * 2, 2);
+        v /= 100;
+    }
+    if (v >= 10) {
+        p -= 2;
+        memcpy(p, digit_pairs + v * 2, 2);
+    } else {
+        *--p = '0' + v;
+    }
+
+    while (p > tmp && tmp + sizeof(tmp) - p < width)
+        *--p = '0';
+
+    put_mem(text, p, tmp + sizeof(tmp) - p);
+}
+
+// "%d"
+static void put_int(struct uat_text *text, int v)
+{
+    if (v < 0) {
+        put_char(text, '-');
+        put_uint(text, 0U - (unsigned) v, 0);
+    } else {
+        put_uint(text, v, 0);
+    }
+}
+
+// "%0<width>X"
+static void put_hex(struct uat_text *text, unsigned v, unsigned width)
+{
+    static const char hex_digits[] = "0123456789ABCDEF";
+    char tmp[8];
+    char *p = tmp + sizeof(tmp);
+
+    do {
+        *--p = hex_digits[v & 15];
+        v >>= 4;
+    } while (v);
+
+    while (p > tmp && tmp + sizeof(tmp) - p < width)
+        *--p = '0';
+
+    put_mem(text, p, tmp + sizeof(tmp) - p);
+}
+
+// "%.<decimals>f", or "%+.<decimals>f" if 'plus', for up to 6 decimals.
+// printf rounds the exact binary value, so anything within a hair of a
+// rounding tie (or too large to scale exactly) is left to snprintf.
+static void put_fixed(struct uat_text *text, double v, unsigned decimals, int plus)
+{
+    static const unsigned scale[7] = { 1, 10, 100, 1000, 10000, 100000, 1000000 };
+    double scaled = fabs(v) * scale[decimals];
+    char tmp[64];
+    int n;
+
+    if (scaled < 1e9) {
+        uint32_t units = (uint32_t) scaled;
+        double frac = scaled - units;
+
+        if (fabs(frac - 0.5) > 1e-6) {
+            if (frac > 0.5)
+                ++units;
+
+            if (signbit(v))
+                put_char(text, '-');
+            else if (plus)
+                put_char(text, '+');
+
+            put_uint(text, units / scale[decimals], 0);
+            if (decimals) {
+                put_char(text, '.');
+                put_uint(text, units % scale[decimals], decimals);
+            }
+            return;
+        }
+    }
+
+    n = snprintf(tmp, sizeof(tmp), plus ? "%+.*f" : "%.*f", decimals, v);
+    if (n < 0)
+        return;
+    if ((size_t) n < sizeof(tmp))
+        put_mem(text, tmp, n);
+    else if (uat_text_reserve(text, n + 1))
+        text->len += snprintf(text->buf + text->len, n + 1, plus ? "%+.*f" : "%.*f", decimals, v);
+}
+
 static const char *address_qualifier_names[8] = {
     "ICAO address via ADS-B",
     "reserved (national use)",
@@ -40,22 +199,25 @@ static const char *address_qualifier_names[8] = {
     "reserved (7)"
 };    
 
-static void uat_display_hdr(const struct uat_adsb_mdb *mdb, FILE *to)
+static void format_hdr(const struct uat_adsb_mdb *mdb, struct uat_text *text)
 {
-    fprintf(to,
-            "HDR:\n"
-            " MDB Type:          %d\n"
-            " Address:           %06X (%s)\n",
-            mdb->mdb_type, 
-            mdb->address,
-            address_qualifier_names[mdb->address_qualifier]);
+    put_lit(text, "HDR:\n"
+            " MDB Type:          ");
+    put_int(text, mdb->mdb_type);
+    put_lit(text, "\n"
+            " Address:           ");
+    put_hex(text, mdb->address, 6);
+    put_lit(text, " (");
+    put_str(text, address_qualifier_names[mdb->address_qualifier]);
+    put_lit(text, ")\n");
 }
 
 static double dimensions_widths[16] = {
     11.5, 23, 28.5, 34, 33, 38, 39.5, 45, 45, 52, 59.5, 67, 72.5, 80, 80, 90
 };
 
-static void uat_decode_sv(uint8_t *frame, struct uat_adsb_mdb *mdb)
+// SV position: position, altitude, NIC, and the UTC coupled / TIS-B site ID bits
+static void uat_decode_sv_position(uint8_t *frame, struct uat_adsb_mdb *mdb, int fixed)
 {
     uint32_t raw_lat, raw_lon, raw_alt;
 
@@ -66,7 +228,15 @@ static void uat_decode_sv(uint8_t *frame, struct uat_adsb_mdb *mdb)
     raw_lat = (frame[4] << 15) | (frame[5] << 7) | (frame[6] >> 1);
     raw_lon = ((frame[6] & 0x01) << 23) | (frame[7] << 15) | (frame[8] << 7) | (frame[9] >> 1);
     
-    if (mdb->nic != 0 || raw_lat != 0 || raw_lon != 0) {
+    if ((mdb->nic != 0 || raw_lat != 0 || raw_lon != 0) && fixed) {
+        // 1e-7 degree units, rounded: 360e7 / 2^24 per LSB
+        int64_t lat_e7 = ((uint64_t) raw_lat * 3600000000ULL + (1 << 23)) >> 24;
+        int64_t lon_e7 = ((uint64_t) raw_lon * 3600000000ULL + (1 << 23)) >> 24;
+
+        mdb->position_valid = 1;
+        mdb->lat_e7 = (int32_t) (raw_lat > 0x400000 ? lat_e7 - 1800000000 : lat_e7);
+        mdb->lon_e7 = (int32_t) (raw_lon > 0x800000 ? lon_e7 - 3600000000LL : lon_e7);
+    } else if (mdb->nic != 0 || raw_lat != 0 || raw_lon != 0) {
         mdb->position_valid = 1;
         mdb->lat = raw_lat * 360.0 / 16777216.0;
         if (mdb->lat > 90)
@@ -81,7 +251,102 @@ static void uat_decode_sv(uint8_t *frame, struct uat_adsb_mdb *mdb)
         mdb->altitude_type = (frame[9] & 1) ? ALT_GEO : ALT_BARO;
         mdb->altitude = (raw_alt - 1) * 25 - 1000;
     }
-    
+
+    mdb->airground_state = (frame[12] >> 6) & 0x03;
+
+    if ((frame[0] & 7) == 2 || (frame[0] & 7) == 3) {
+        mdb->utc_coupled = 0;
+        mdb->tisb_site_id = (frame[16] & 0x0f);
+    } else {
+        mdb->utc_coupled = (frame[16] & 0x08) ? 1 : 0;
+        mdb->tisb_site_id = 0;
+    }
+}
+
+// tan(d degrees) * 2^32, for d = 0..89
+static const uint64_t tan_table[90] = {
+    0ULL, 74968933ULL, 149983563ULL, 225089698ULL,
+    300333370ULL, 375760949ULL, 451419253ULL, 527355674ULL,
+    603618289ULL, 680255991ULL, 757318616ULL, 834857071ULL,
+    912923481ULL, 991571331ULL, 1070855618ULL, 1150833018ULL,
+    1231562054ULL, 1313103278ULL, 1395519469ULL, 1478875838ULL,
+    1563240253ULL, 1648683477ULL, 1735279427ULL, 1823105454ULL,
+    1912242643ULL, 2002776142ULL, 2094795517ULL, 2188395142ULL,
+    2283674620ULL, 2380739248ULL, 2479700525ULL, 2580676708ULL,
+    2683793431ULL, 2789184375ULL, 2896992021ULL, 3007368477ULL,
+    3120476397ULL, 3236490001ULL, 3355596215ULL, 3477995939ULL,
+    3603905474ULL, 3733558110ULL, 3867205923ULL, 4005121798ULL,
+    4147601706ULL, 4294967296ULL, 4447568832ULL, 4605788539ULL,
+    4770044430ULL, 4940794687ULL, 5118542705ULL, 5303842901ULL,
+    5497307451ULL, 5699614109ULL, 5911515335ULL, 6133848983ULL,
+    6367550874ULL, 6613669660ULL, 6873384465ULL, 7148025948ULL,
+    7439101574ULL, 7748326109ULL, 8077658661ULL, 8429347936ULL,
+    8805987946ULL, 9210587090ULL, 9646654490ULL, 10118308865ULL,
+    10630417090ULL, 11188772336ULL, 11800325663ULL, 12473490740ULL,
+    13218550140ULL, 14048205026ULL, 14978330984ULL, 16029036166ULL,
+    17226172941ULL, 18603547223ULL, 20206232460ULL, 22095691251ULL,
+    24357969942ULL, 27117356271ULL, 30560280257ULL, 34979701555ULL,
+    40863884173ULL, 49091700832ULL, 61420893884ULL, 81952858044ULL,
+    122991771330ULL, 246058511593ULL
+};
+
+// floor(atan(a/b)) in degrees, for a >= 0, b > 0
+static unsigned atan_degrees(unsigned a, unsigned b)
+{
+    unsigned lo = 0, hi = 89;
+
+    // find the largest d with tan(d) <= a/b
+    while (lo < hi) {
+        unsigned mid = (lo + hi + 1) / 2;
+        if (((uint64_t) a << 32) >= b * tan_table[mid])
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+
+    return lo;
+}
+
+// The track, in whole degrees clockwise from north, of a velocity
+// that is not zero; the same as the floating-point calculation
+// in uat_decode_sv_velocity() without needing libm
+static uint16_t track_fixed(int ns, int ew)
+{
+    if (ew >= 0 && ns > 0)
+        return atan_degrees(ew, ns);
+    else if (ew > 0)
+        return 90 + atan_degrees(-ns, ew);
+    else if (ns < 0)
+        return 180 + atan_degrees(-ew, -ns);
+    else
+        return 270 + atan_degrees(ns, -ew);
+}
+
+// floor(sqrt(n))
+static uint32_t isqrt(uint32_t n)
+{
+    uint32_t root = 0, bit = 1U << 30;
+
+    while (bit > n)
+        bit >>= 2;
+
+    while (bit) {
+        if (n >= root + bit) {
+            n -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+
+    return root;
+}
+
+// SV velocity: velocities, track/heading, speed, vertical rate, dimensions
+static void uat_decode_sv_velocity(uint8_t *frame, struct uat_adsb_mdb *mdb, int fixed)
+{
+    mdb->has_sv = 1;
     mdb->airground_state = (frame[12] >> 6) & 0x03;
 
     switch (mdb->airground_state) {
@@ -110,7 +375,15 @@ static void uat_decode_sv(uint8_t *frame, struct uat_adsb_mdb *mdb)
                     mdb->ew_vel *= 4;
             }
             
-            if (mdb->ns_vel_valid && mdb->ew_vel_valid) {
+            if (mdb->ns_vel_valid && mdb->ew_vel_valid && fixed) {
+                if (mdb->ns_vel != 0 || mdb->ew_vel != 0) {
+                    mdb->track_type = TT_TRACK;
+                    mdb->track = track_fixed(mdb->ns_vel, mdb->ew_vel);
+                }
+
+                mdb->speed_valid = 1;
+                mdb->speed = isqrt(mdb->ns_vel * mdb->ns_vel + mdb->ew_vel * mdb->ew_vel);
+            } else if (mdb->ns_vel_valid && mdb->ew_vel_valid) {
                 if (mdb->ns_vel != 0 || mdb->ew_vel != 0) {
                     mdb->track_type = TT_TRACK;
                     mdb->track = (uint16_t)(360 + 90 - atan2(mdb->ns_vel, mdb->ew_vel) * 180 / M_PI) % 360;
@@ -161,110 +434,115 @@ static void uat_decode_sv(uint8_t *frame, struct uat_adsb_mdb *mdb)
         // nothing
         break;
     }
-    
-    if ((frame[0] & 7) == 2 || (frame[0] & 7) == 3) {
-        mdb->utc_coupled = 0;
-        mdb->tisb_site_id = (frame[16] & 0x0f);
-    } else {
-        mdb->utc_coupled = (frame[16] & 0x08) ? 1 : 0;
-        mdb->tisb_site_id = 0;
-    }
 }
 
-static void uat_display_sv(const struct uat_adsb_mdb *mdb, FILE *to)
+static void format_sv(const struct uat_adsb_mdb *mdb, struct uat_text *text)
 {
     if (!mdb->has_sv)
         return;
 
-    fprintf(to,
-            "SV:\n"
-            " NIC:               %u\n",
-            mdb->nic);
-
-    if (mdb->position_valid)
-        fprintf(to,
-                " Latitude:          %+.4f\n"
-                " Longitude:         %+.4f\n",
-                mdb->lat,
-                mdb->lon);
+    put_lit(text, "SV:\n"
+            " NIC:               ");
+    put_uint(text, mdb->nic, 0);
+    put_char(text, '\n');
+
+    if (mdb->position_valid) {
+        put_lit(text, " Latitude:          ");
+        put_fixed(text, mdb->lat, 4, 1);
+        put_lit(text, "\n"
+                " Longitude:         ");
+        put_fixed(text, mdb->lon, 4, 1);
+        put_char(text, '\n');
+    }
 
     switch (mdb->altitude_type) {
     case ALT_BARO:
-        fprintf(to,
-                " Altitude:          %d ft (barometric)\n",
-                mdb->altitude);
+        put_lit(text, " Altitude:          ");
+        put_int(text, mdb->altitude);
+        put_lit(text, " ft (barometric)\n");
         break;
     case ALT_GEO:
-        fprintf(to,
-                " Altitude:          %d ft (geometric)\n",
-                mdb->altitude);
+        put_lit(text, " Altitude:          ");
+        put_int(text, mdb->altitude);
+        put_lit(text, " ft (geometric)\n");
         break;
     default:
         break;
     }
 
-    if (mdb->ns_vel_valid)
-        fprintf(to,
-                " N/S velocity:      %d kt\n",
-                mdb->ns_vel);
+    if (mdb->ns_vel_valid) {
+        put_lit(text, " N/S velocity:      ");
+        put_int(text, mdb->ns_vel);
+        put_lit(text, " kt\n");
+    }
 
-    if (mdb->ew_vel_valid)
-        fprintf(to,
-                " E/W velocity:      %d kt\n",
-                mdb->ew_vel);
+    if (mdb->ew_vel_valid) {
+        put_lit(text, " E/W velocity:      ");
+        put_int(text, mdb->ew_vel);
+        put_lit(text, " kt\n");
+    }
 
     switch (mdb->track_type) {
     case TT_TRACK:
-        fprintf(to,
-                " Track:             %u\n",
-                mdb->track);
+        put_lit(text, " Track:             ");
+        put_uint(text, mdb->track, 0);
+        put_char(text, '\n');
         break;
     case TT_MAG_HEADING:
-        fprintf(to,
-                " Heading:           %u (magnetic)\n",
-                mdb->track);
+        put_lit(text, " Heading:           ");
+        put_uint(text, mdb->track, 0);
+        put_lit(text, " (magnetic)\n");
         break;
     case TT_TRUE_HEADING:
-        fprintf(to,
-                " Heading:           %u (true)\n",
-                mdb->track);
+        put_lit(text, " Heading:           ");
+        put_uint(text, mdb->track, 0);
+        put_lit(text, " (true)\n");
         break;
     default:
         break;
     }
 
-    if (mdb->speed_valid)
-        fprintf(to,
-                " Speed:             %u kt\n",
-                mdb->speed);
-        
+    if (mdb->speed_valid) {
+        put_lit(text, " Speed:             ");
+        put_uint(text, mdb->speed, 0);
+        put_lit(text, " kt\n");
+    }
 
     switch (mdb->vert_rate_source) {
     case ALT_BARO:
-        fprintf(to,
-                " Vertical rate:     %d ft/min (from barometric altitude)\n",
-                mdb->vert_rate);
+        put_lit(text, " Vertical rate:     ");
+        put_int(text, mdb->vert_rate);
+        put_lit(text, " ft/min (from barometric altitude)\n");
         break;
     case ALT_GEO:
-        fprintf(to,
-                " Vertical rate:     %d ft/min (from geometric altitude)\n",
-                mdb->vert_rate);
+        put_lit(text, " Vertical rate:     ");
+        put_int(text, mdb->vert_rate);
+        put_lit(text, " ft/min (from geometric altitude)\n");
         break;
     default:
         break;
     }
-        
-    if (mdb->dimensions_valid)
-        fprintf(to,
-                " Dimensions:        %.1fm L x %.1fm W%s\n",
-                mdb->length, mdb->width,
-                mdb->position_offset ? " (position offset applied)" : "");
-    
-    fprintf(to,
-            " UTC coupling:      %s\n"
-            " TIS-B site ID:     %u\n",
-            mdb->utc_coupled ? "yes" : "no",
-            mdb->tisb_site_id);
+
+    if (mdb->dimensions_valid) {
+        put_lit(text, " Dimensions:        ");
+        put_fixed(text, mdb->length, 1, 0);
+        put_lit(text, "m L x ");
+        put_fixed(text, mdb->width, 1, 0);
+        put_lit(text, "m W");
+        if (mdb->position_offset)
+            put_lit(text, " (position offset applied)");
+        put_char(text, '\n');
+    }
+
+    put_lit(text, " UTC coupling:      ");
+    if (mdb->utc_coupled)
+        put_lit(text, "yes");
+    else
+        put_lit(text, "no");
+    put_lit(text, "\n"
+            " TIS-B site ID:     ");
+    put_uint(text, mdb->tisb_site_id, 0);
+    put_char(text, '\n');
 }
 
 static char base40_alphabet[40] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ  ..";
@@ -368,38 +646,63 @@ static const char *emergency_status_names[8] = {
     "reserved"
 };
 
-static void uat_display_ms(const struct uat_adsb_mdb *mdb, FILE *to)
+static void format_ms(const struct uat_adsb_mdb *mdb, struct uat_text *text)
 {
     if (!mdb->has_ms)
         return;
 
-    fprintf(to,
-            "MS:\n"
-            " Emitter category:  %s\n"
-            " Callsign:          %s%s\n"
-            " Emergency status:  %s\n"
-            " UAT version:       %u\n"
-            " SIL:               %u\n"
-            " Transmit MSO:      %u\n"
-            " NACp:              %u\n"
-            " NACv:              %u\n"
-            " NICbaro:           %u\n"
-            " Capabilities:      %s%s\n"
-            " Active modes:      %s%s%s\n"
-            " Target track type: %s\n",
-            emitter_category_names[mdb->emitter_category],
-            mdb->callsign_type == CS_SQUAWK ? "squawk " : "",
-            mdb->callsign_type == CS_INVALID ? "unavailable" : mdb->callsign,
-            emergency_status_names[mdb->emergency_status],
-            mdb->uat_version,
-            mdb->sil,
-            mdb->transmit_mso,
-            mdb->nac_p,
-            mdb->nac_v,
-            mdb->nic_baro,
-            mdb->has_cdti ? "CDTI " : "", mdb->has_acas ? "ACAS " : "",
-            mdb->acas_ra_active ? "ACASRA " : "", mdb->ident_active ? "IDENT " : "", mdb->atc_services ? "ATC " : "",
-            mdb->heading_type == HT_MAGNETIC ? "magnetic heading" : "true heading");
+    put_lit(text, "MS:\n"
+            " Emitter category:  ");
+    put_str(text, emitter_category_names[mdb->emitter_category]);
+    put_lit(text, "\n"
+            " Callsign:          ");
+    if (mdb->callsign_type == CS_SQUAWK)
+        put_lit(text, "squawk ");
+    if (mdb->callsign_type == CS_INVALID)
+        put_lit(text, "unavailable");
+    else
+        put_str(text, mdb->callsign);
+    put_lit(text, "\n"
+            " Emergency status:  ");
+    put_str(text, emergency_status_names[mdb->emergency_status]);
+    put_lit(text, "\n"
+            " UAT version:       ");
+    put_uint(text, mdb->uat_version, 0);
+    put_lit(text, "\n"
+            " SIL:               ");
+    put_uint(text, mdb->sil, 0);
+    put_lit(text, "\n"
+            " Transmit MSO:      ");
+    put_uint(text, mdb->transmit_mso, 0);
+    put_lit(text, "\n"
+            " NACp:              ");
+    put_uint(text, mdb->nac_p, 0);
+    put_lit(text, "\n"
+            " NACv:              ");
+    put_uint(text, mdb->nac_v, 0);
+    put_lit(text, "\n"
+            " NICbaro:           ");
+    put_uint(text, mdb->nic_baro, 0);
+    put_lit(text, "\n"
+            " Capabilities:      ");
+    if (mdb->has_cdti)
+        put_lit(text, "CDTI ");
+    if (mdb->has_acas)
+        put_lit(text, "ACAS ");
+    put_lit(text, "\n"
+            " Active modes:      ");
+    if (mdb->acas_ra_active)
+        put_lit(text, "ACASRA ");
+    if (mdb->ident_active)
+        put_lit(text, "IDENT ");
+    if (mdb->atc_services)
+        put_lit(text, "ATC ");
+    put_lit(text, "\n"
+            " Target track type: ");
+    if (mdb->heading_type == HT_MAGNETIC)
+        put_lit(text, "magnetic heading\n");
+    else
+        put_lit(text, "true heading\n");
 }
 
 static void uat_decode_auxsv(uint8_t *frame, struct uat_adsb_mdb *mdb)
@@ -416,38 +719,42 @@ static void uat_decode_auxsv(uint8_t *frame, struct uat_adsb_mdb *mdb)
 }    
 
 
-static void uat_display_auxsv(const struct uat_adsb_mdb *mdb, FILE *to)
+static void format_auxsv(const struct uat_adsb_mdb *mdb, struct uat_text *text)
 {
     if (!mdb->has_auxsv)
         return;
 
-    fprintf(to,
-            "AUXSV:\n");
+    put_lit(text, "AUXSV:\n"
+            " Sec. altitude:     ");
 
     switch (mdb->sec_altitude_type) {
     case ALT_BARO:
-        fprintf(to,
-                " Sec. altitude:     %d ft (barometric)\n",
-                mdb->sec_altitude);
+        put_int(text, mdb->sec_altitude);
+        put_lit(text, " ft (barometric)\n");
         break;
     case ALT_GEO:
-        fprintf(to,
-                " Sec. altitude:     %d ft (geometric)\n",
-                mdb->sec_altitude);
-        break;        
+        put_int(text, mdb->sec_altitude);
+        put_lit(text, " ft (geometric)\n");
+        break;
     default:
-        fprintf(to,
-                " Sec. altitude:     unavailable\n");
+        put_lit(text, "unavailable\n");
         break;
     }
 }
 
 void uat_decode_adsb_mdb(uint8_t *frame, struct uat_adsb_mdb *mdb)
+{
+    uat_decode_adsb_mdb_fields(frame, mdb, UAT_DECODE_ALL);
+}
+
+void uat_decode_adsb_mdb_fields(uint8_t *frame, struct uat_adsb_mdb *mdb, unsigned fields)
 {
     static struct uat_adsb_mdb mdb_zero;
+    int has_ms = 0, has_auxsv = 0;
 
     *mdb = mdb_zero;
 
+    // always needed, to know what else is present
     uat_decode_hdr(frame, mdb);   
 
     switch (mdb->mdb_type) {
@@ -457,110 +764,417 @@ void uat_decode_adsb_mdb(uint8_t *frame, struct uat_adsb_mdb *mdb)
     case 8: // HDR SV reserved
     case 9: // HDR SV reserved
     case 10: // HDR SV reserved
-        uat_decode_sv(frame, mdb);
         break;
 
     case 1: // HDR SV MS AUXSV
-        uat_decode_sv(frame, mdb);
-        uat_decode_ms(frame, mdb);
-        uat_decode_auxsv(frame, mdb);
+        has_ms = has_auxsv = 1;
         break;
 
     case 2: // HDR SV AUXSV
     case 5: // HDR SV (TC+1) AUXSV
     case 6: // HDR SV (TS) AUXSV
-        uat_decode_sv(frame, mdb);
-        uat_decode_auxsv(frame, mdb);
+        has_auxsv = 1;
         break;
 
     case 3: // HDR SV MS (TS)
-        uat_decode_sv(frame, mdb);
-        uat_decode_ms(frame, mdb);
+        has_ms = 1;
         break;
 
     default:
-        break;
+        return;
     }
+
+    if (fields & UAT_DECODE_SV_POSITION)
+        uat_decode_sv_position(frame, mdb, (fields & UAT_DECODE_FIXED) != 0);
+    if (fields & UAT_DECODE_SV_VELOCITY)
+        uat_decode_sv_velocity(frame, mdb, (fields & UAT_DECODE_FIXED) != 0);
+    if (has_ms && (fields & UAT_DECODE_MS))
+        uat_decode_ms(frame, mdb);
+    if (has_auxsv && (fields & UAT_DECODE_AUXSV))
+        uat_decode_auxsv(frame, mdb);
+}
+
+// More than the longest text of an ADS-B message
+#define ADSB_TEXT_BOUND 2048
+
+int uat_format_adsb_mdb(const struct uat_adsb_mdb *mdb, struct uat_text *text)
+{
+    if (!uat_text_reserve(text, ADSB_TEXT_BOUND))
+        return 0;
+
+    format_hdr(mdb, text);
+    format_sv(mdb, text);
+    format_ms(mdb, text);
+    format_auxsv(mdb, text);
+    return 1;
 }
 
 void uat_display_adsb_mdb(const struct uat_adsb_mdb *mdb, FILE *to)
 {
-    uat_display_hdr(mdb, to);
-    uat_display_sv(mdb, to);
-    uat_display_ms(mdb, to);
-    uat_display_auxsv(mdb, to);
+    struct uat_text text = UAT_TEXT_INIT;
+
+    if (uat_format_adsb_mdb(mdb, &text))
+        fwrite(text.buf, 1, text.len, to);
+    uat_text_free(&text);
 }
 
+//
+// Columnar (structure of arrays) decoding
+//
 
-static void uat_decode_info_frame(struct uat_uplink_info_frame *frame)
+#define COLUMN_ARRAYS(X)                                \
+    X(uint8_t, mdb_type)                                \
+    X(uint8_t, address_qualifier)                       \
+    X(uint32_t, address)                                \
+    X(uint8_t, flags)                                   \
+    X(int32_t, lat_e7)                                  \
+    X(int32_t, lon_e7)                                  \
+    X(uint8_t, nic)                                     \
+    X(uint8_t, altitude_type)                           \
+    X(int32_t, altitude)                                \
+    X(uint8_t, airground_state)                         \
+    X(int16_t, ns_vel)                                  \
+    X(int16_t, ew_vel)                                  \
+    X(uint8_t, track_type)                              \
+    X(uint16_t, track)                                  \
+    X(uint16_t, speed)                                  \
+    X(uint8_t, vert_rate_source)                        \
+    X(int16_t, vert_rate)                               \
+    X(uint8_t, emitter_category)                        \
+    X(uint8_t, callsign_type)                           \
+    X(uint8_t, sec_altitude_type)                       \
+    X(int32_t, sec_altitude)
+
+struct uat_adsb_columns *uat_adsb_columns_new(int capacity)
 {
-    unsigned t_opt;
+    struct uat_adsb_columns *cols = calloc(1, sizeof(*cols));
+    if (!cols)
+        return NULL;
+
+    cols->capacity = capacity;
+#define ALLOC_COLUMN(type, name)                                        \
+    if (!(cols->name = malloc(capacity * sizeof(type) + 1))) {          \
+        uat_adsb_columns_free(cols);                                    \
+        return NULL;                                                    \
+    }
+    COLUMN_ARRAYS(ALLOC_COLUMN)
+#undef ALLOC_COLUMN
+    if (!(cols->callsign = malloc(capacity * sizeof(*cols->callsign) + 1))) {
+        uat_adsb_columns_free(cols);
+        return NULL;
+    }
 
-    frame->is_fisb = 0;
+    return cols;
+}
+
+void uat_adsb_columns_free(struct uat_adsb_columns *cols)
+{
+    if (!cols)
+        return;
+
+#define FREE_COLUMN(type, name) free(cols->name);
+    COLUMN_ARRAYS(FREE_COLUMN)
+#undef FREE_COLUMN
+    free(cols->callsign);
+    free(cols);
+}
+
+// Fill in everything but MS for rows [start,start+n) from the frames.
+// Every field is extracted the same way for every row, selecting the
+// result rather than branching on validity, which keeps the loop
+// short and predictable; the results match uat_decode_adsb_mdb_fields()
+// with UAT_DECODE_ALL | UAT_DECODE_FIXED.
+static void columns_hdr_sv_auxsv(const uint8_t *frames, size_t stride, int n,
+                                 struct uat_adsb_columns *cols, int start)
+{
+    int i;
+
+    for (i = 0; i < n; ++i) {
+        const uint8_t *f = frames + i * stride;
+        int row = start + i;
+
+        // HDR: SV in types 0-10, MS in 1 and 3, AUXSV in 1, 2, 5 and 6
+        unsigned type = f[0] >> 3;
+        int sv = (type <= 10);
+        int auxsv = (0x0066 >> type) & 1;
+        uint8_t flags = (sv ? UAT_COLUMN_HAS_SV : 0) |
+            ((0x000a >> type) & 1 ? UAT_COLUMN_HAS_MS : 0) |
+            (auxsv ? UAT_COLUMN_HAS_AUXSV : 0);
+
+        // SV position
+        uint32_t raw_lat = (f[4] << 15) | (f[5] << 7) | (f[6] >> 1);
+        uint32_t raw_lon = ((f[6] & 0x01) << 23) | (f[7] << 15) | (f[8] << 7) | (f[9] >> 1);
+        uint32_t raw_alt = (f[10] << 4) | ((f[11] & 0xf0) >> 4);
+        unsigned raw_nic = f[11] & 15;
+        int position_valid = sv && (raw_nic | raw_lat | raw_lon) != 0;
+        int altitude_valid = sv && raw_alt != 0;
+        int64_t lat = ((uint64_t) raw_lat * 3600000000ULL + (1 << 23)) >> 24;
+        int64_t lon = ((uint64_t) raw_lon * 3600000000ULL + (1 << 23)) >> 24;
+
+        // SV velocity; the same bits are N/S velocity or ground speed,
+        // and E/W velocity or track
+        int ag = sv ? (f[12] >> 6) & 0x03 : AG_SUBSONIC;
+        int airborne = sv && ag <= AG_SUPERSONIC;
+        int ground = sv && ag == AG_GROUND;
+        int scale = (ag == AG_SUPERSONIC) ? 4 : 1;
+        int raw_ns = ((f[12] & 0x1f) << 6) | ((f[13] & 0xfc) >> 2);
+        int raw_ew = ((f[13] & 0x03) << 9) | (f[14] << 1) | ((f[15] & 0x80) >> 7);
+        int raw_vvel = ((f[15] & 0x7f) << 4) | ((f[16] & 0xf0) >> 4);
+        int ns_valid = airborne && (raw_ns & 0x3ff) != 0;
+        int ew_valid = airborne && (raw_ew & 0x3ff) != 0;
+        int vvel_valid = airborne && (raw_vvel & 0x1ff) != 0;
+        int ground_speed_valid = ground && raw_ns != 0;
+        unsigned ground_track_type = ground ? (raw_ew & 0x0600) >> 9 : TT_INVALID;
+        int ns = ((raw_ns & 0x3ff) - 1) * scale;
+        int ew = ((raw_ew & 0x3ff) - 1) * scale;
+        int vvel = ((raw_vvel & 0x1ff) - 1) * 64;
+
+        // AUXSV
+        int raw_sec_alt = (f[29] << 4) | ((f[30] & 0xf0) >> 4);
+        int sec_altitude_valid = auxsv && raw_sec_alt != 0;
+
+        lat -= (raw_lat > 0x400000) ? 1800000000 : 0;
+        lon -= (raw_lon > 0x800000) ? 3600000000LL : 0;
+        ns = (raw_ns & 0x400) ? -ns : ns;
+        ew = (raw_ew & 0x400) ? -ew : ew;
+        vvel = (raw_vvel & 0x200) ? -vvel : vvel;
+
+        cols->mdb_type[row] = type;
+        cols->address_qualifier[row] = f[0] & 0x07;
+        cols->address[row] = (f[1] << 16) | (f[2] << 8) | f[3];
+        cols->flags[row] = flags |
+            (position_valid ? UAT_COLUMN_POSITION_VALID : 0) |
+            (ns_valid ? UAT_COLUMN_NS_VEL_VALID : 0) |
+            (ew_valid ? UAT_COLUMN_EW_VEL_VALID : 0) |
+            (((ns_valid && ew_valid) || ground_speed_valid) ? UAT_COLUMN_SPEED_VALID : 0);
+
+        cols->lat_e7[row] = position_valid ? (int32_t) lat : 0;
+        cols->lon_e7[row] = position_valid ? (int32_t) lon : 0;
+        cols->nic[row] = sv ? raw_nic : 0;
+        cols->altitude_type[row] = altitude_valid ? ((f[9] & 1) ? ALT_GEO : ALT_BARO) : ALT_INVALID;
+        cols->altitude[row] = altitude_valid ? ((int32_t) raw_alt - 1) * 25 - 1000 : 0;
+        cols->airground_state[row] = ag;
+        cols->ns_vel[row] = ns_valid ? ns : 0;
+        cols->ew_vel[row] = ew_valid ? ew : 0;
+        cols->vert_rate_source[row] = vvel_valid ? ((raw_vvel & 0x400) ? ALT_BARO : ALT_GEO) : ALT_INVALID;
+        cols->vert_rate[row] = vvel_valid ? vvel : 0;
+
+        if (ns_valid && ew_valid) {
+            cols->track_type[row] = (ns | ew) ? TT_TRACK : TT_INVALID;
+            cols->track[row] = (ns | ew) ? track_fixed(ns, ew) : 0;
+            cols->speed[row] = isqrt(ns * ns + ew * ew);
+        } else {
+            cols->track_type[row] = ground_track_type;
+            cols->track[row] = ground_track_type != TT_INVALID ? (raw_ew & 0x1ff) * 360 / 512 : 0;
+            cols->speed[row] = ground_speed_valid ? (raw_ns & 0x3ff) - 1 : 0;
+        }
+
+        cols->sec_altitude_type[row] = sec_altitude_valid ? ((f[9] & 1) ? ALT_BARO : ALT_GEO) : ALT_INVALID;
+        cols->sec_altitude[row] = sec_altitude_valid ? (raw_sec_alt - 1) * 25 - 1000 : 0;
+    }
+}
+
+static void columns_ms(const uint8_t *frames, size_t stride, int n, const uint8_t *flags,
+                       uint8_t *emitter_category, uint8_t *callsign_type, char (*callsign)[9])
+{
+    int i, j;
+
+    // only some messages have MS, and the base 40 decoding is
+    // expensive, so this is a separate, branching loop
+    for (i = 0; i < n; ++i) {
+        const uint8_t *f = frames + i * stride;
+        uint16_t v;
+
+        if (!(flags[i] & UAT_COLUMN_HAS_MS)) {
+            memset(callsign[i], 0, sizeof(callsign[i]));
+            emitter_category[i] = 0;
+            callsign_type[i] = CS_INVALID;
+            continue;
+        }
+
+        v = (f[17] << 8) | f[18];
+        emitter_category[i] = (v / 1600) % 40;
+        callsign[i][0] = base40_alphabet[(v / 40) % 40];
+        callsign[i][1] = base40_alphabet[v % 40];
+        v = (f[19] << 8) | f[20];
+        callsign[i][2] = base40_alphabet[(v / 1600) % 40];
+        callsign[i][3] = base40_alphabet[(v / 40) % 40];
+        callsign[i][4] = base40_alphabet[v % 40];
+        v = (f[21] << 8) | f[22];
+        callsign[i][5] = base40_alphabet[(v / 1600) % 40];
+        callsign[i][6] = base40_alphabet[(v / 40) % 40];
+        callsign[i][7] = base40_alphabet[v % 40];
+        callsign[i][8] = 0;
+
+        // trim trailing spaces
+        for (j = 7; j >= 0 && callsign[i][j] == ' '; --j)
+            callsign[i][j] = 0;
+
+        if (callsign[i][0])
+            callsign_type[i] = (f[26] & 0x02) ? CS_CALLSIGN : CS_SQUAWK;
+        else
+            callsign_type[i] = CS_INVALID;
+    }
+}
+
+int uat_decode_adsb_columns(const uint8_t *frames, size_t stride, int count, struct uat_adsb_columns *cols)
+{
+    int start = cols->count;
+
+    if (count > cols->capacity - start)
+        count = cols->capacity - start;
+    if (count <= 0)
+        return 0;
+
+    columns_hdr_sv_auxsv(frames, stride, count, cols, start);
+    columns_ms(frames, stride, count, cols->flags + start,
+               cols->emitter_category + start, cols->callsign_type + start, cols->callsign + start);
+
+    cols->count += count;
+    return count;
+}
+
+
+int uat_decode_fisb_apdu(const struct uat_uplink_info_frame *frame, struct fisb_apdu *fisb)
+{
+    unsigned t_opt;
+    unsigned header_bits; // header length up to the end of the time fields
+    unsigned offset;
 
     if (frame->type != 0)
-        return; // not FIS-B
+        return 0; // not FIS-B
 
     if (frame->length < 4) // too short for FIS-B
-        return;
+        return 0;
 
     t_opt = ((frame->data[1] & 0x01) << 1) | (frame->data[2] >> 7);
 
     switch (t_opt) {
     case 0: // Hours, Minutes
-        frame->fisb.monthday_valid = 0;
-        frame->fisb.seconds_valid = 0;
-        frame->fisb.hours = (frame->data[2] & 0x7c) >> 2;
-        frame->fisb.minutes = ((frame->data[2] & 0x03) << 4) | (frame->data[3] >> 4);
-        frame->fisb.length = frame->length - 4;
-        frame->fisb.data = frame->data + 4;
+        fisb->monthday_valid = 0;
+        fisb->seconds_valid = 0;
+        fisb->hours = (frame->data[2] & 0x7c) >> 2;
+        fisb->minutes = ((frame->data[2] & 0x03) << 4) | (frame->data[3] >> 4);
+        header_bits = 28;
         break;
     case 1: // Hours, Minutes, Seconds
         if (frame->length < 5)
-            return;
-        frame->fisb.monthday_valid = 0;
-        frame->fisb.seconds_valid = 1;
-        frame->fisb.hours = (frame->data[2] & 0x7c) >> 2;
-        frame->fisb.minutes = ((frame->data[2] & 0x03) << 4) | (frame->data[3] >> 4);
-        frame->fisb.seconds = ((frame->data[3] & 0x0f) << 2) | (frame->data[4] >> 6);
-        frame->fisb.length = frame->length - 5;
-        frame->fisb.data = frame->data + 5;
+            return 0;
+        fisb->monthday_valid = 0;
+        fisb->seconds_valid = 1;
+        fisb->hours = (frame->data[2] & 0x7c) >> 2;
+        fisb->minutes = ((frame->data[2] & 0x03) << 4) | (frame->data[3] >> 4);
+        fisb->seconds = ((frame->data[3] & 0x0f) << 2) | (frame->data[4] >> 6);
+        header_bits = 34;
         break;
     case 2: // Month, Day, Hours, Minutes
         if (frame->length < 5)
-            return;
-        frame->fisb.monthday_valid = 1;
-        frame->fisb.seconds_valid = 0;
-        frame->fisb.month = (frame->data[2] & 0x78) >> 3;
-        frame->fisb.day = ((frame->data[2] & 0x07) << 2) | (frame->data[3] >> 6);
-        frame->fisb.hours = (frame->data[3] & 0x3e) >> 1;
-        frame->fisb.minutes = ((frame->data[3] & 0x01) << 5) | (frame->data[4] >> 3);
-        frame->fisb.length = frame->length - 5; // ???
-        frame->fisb.data = frame->data + 5;
+            return 0;
+        fisb->monthday_valid = 1;
+        fisb->seconds_valid = 0;
+        fisb->month = (frame->data[2] & 0x78) >> 3;
+        fisb->day = ((frame->data[2] & 0x07) << 2) | (frame->data[3] >> 6);
+        fisb->hours = (frame->data[3] & 0x3e) >> 1;
+        fisb->minutes = ((frame->data[3] & 0x01) << 5) | (frame->data[4] >> 3);
+        header_bits = 37;
         break;
     case 3: // Month, Day, Hours, Minutes, Seconds
+    default:
         if (frame->length < 6)
-            return;
-        frame->fisb.monthday_valid = 1;
-        frame->fisb.seconds_valid = 1;
-        frame->fisb.month = (frame->data[2] & 0x78) >> 3;
-        frame->fisb.day = ((frame->data[2] & 0x07) << 2) | (frame->data[3] >> 6);
-        frame->fisb.hours = (frame->data[3] & 0x3e) >> 1;
-        frame->fisb.minutes = ((frame->data[3] & 0x01) << 5) | (frame->data[4] >> 3);
-        frame->fisb.seconds = ((frame->data[4] & 0x03) << 3) | (frame->data[5] >> 5);
-        frame->fisb.length = frame->length - 6;
-        frame->fisb.data = frame->data + 6;
+            return 0;
+        fisb->monthday_valid = 1;
+        fisb->seconds_valid = 1;
+        fisb->month = (frame->data[2] & 0x78) >> 3;
+        fisb->day = ((frame->data[2] & 0x07) << 2) | (frame->data[3] >> 6);
+        fisb->hours = (frame->data[3] & 0x3e) >> 1;
+        fisb->minutes = ((frame->data[3] & 0x01) << 5) | (frame->data[4] >> 3);
+        fisb->seconds = ((frame->data[4] & 0x03) << 3) | (frame->data[5] >> 5);
+        header_bits = 43;
         break;
     }
 
-    frame->fisb.a_flag = (frame->data[0] & 0x80) ? 1 : 0;
-    frame->fisb.g_flag = (frame->data[0] & 0x40) ? 1 : 0;
-    frame->fisb.p_flag = (frame->data[0] & 0x20) ? 1 : 0;
-    frame->fisb.product_id = ((frame->data[0] & 0x1f) << 6) | (frame->data[1] >> 2);
-    frame->fisb.s_flag = (frame->data[1] & 0x02) ? 1 : 0;
-    frame->is_fisb = 1;
+    fisb->a_flag = (frame->data[0] & 0x80) ? 1 : 0;
+    fisb->g_flag = (frame->data[0] & 0x40) ? 1 : 0;
+    fisb->p_flag = (frame->data[0] & 0x20) ? 1 : 0;
+    fisb->product_id = ((frame->data[0] & 0x1f) << 6) | (frame->data[1] >> 2);
+    fisb->s_flag = (frame->data[1] & 0x02) ? 1 : 0;
+
+    if (fisb->s_flag) {
+        // Segmented: the product file ID (10 bits), product file length
+        // (9 bits) and APDU number (9 bits) follow the time fields directly;
+        // they can straddle five bytes, so collect them in 64 bits
+        uint64_t seg = 0;
+        unsigned i;
+
+        offset = (header_bits + 28 + 7) / 8;
+        if (frame->length < offset)
+            return 0;
+
+        for (i = header_bits / 8; i < offset; ++i)
+            seg = (seg << 8) | frame->data[i];
+        seg >>= offset * 8 - (header_bits + 28);
+
+        fisb->product_file_id = (seg >> 18) & 0x3ff;
+        fisb->product_file_length = (seg >> 9) & 0x1ff;
+        fisb->apdu_number = seg & 0x1ff;
+    } else {
+        offset = (header_bits + 7) / 8;
+        fisb->product_file_id = 0;
+        fisb->product_file_length = 0;
+        fisb->apdu_number = 0;
+    }
+
+    fisb->length = frame->length - offset;
+    fisb->data = frame->data + offset;
+    return 1;
 }
 
+int uat_fisb_product_id(const struct uat_uplink_info_frame *frame)
+{
+    if (frame->type != 0 || frame->length < 4)
+        return -1; // not FIS-B
+
+    return ((frame->data[0] & 0x1f) << 6) | (frame->data[1] >> 2);
+}
+
+void uat_uplink_iter_init(struct uat_uplink_iter *iter, uint8_t *frame)
+{
+    if (frame[6] & 0x20) {
+        // app_data_valid
+        iter->next = frame + 8;
+        iter->end = frame + 8 + 424;
+    } else {
+        iter->next = iter->end = NULL;
+    }
+}
+
+int uat_uplink_next_info_frame(struct uat_uplink_iter *iter, struct uat_uplink_info_frame *frame)
+{
+    uint8_t *data = iter->next;
+
+    if (!data || data + 2 > iter->end)
+        return 0;
+
+    frame->is_fisb = 0;
+    frame->length = (data[0] << 1) | (data[1] >> 7);
+    frame->type = (data[1] & 0x0f);
+    if (data + frame->length + 2 > iter->end) {
+        // overrun?
+        iter->next = NULL;
+        return 0;
+    }
+
+    if (frame->length == 0 && frame->type == 0) {
+        iter->next = NULL;
+        return 0; // no more frames
+    }
+
+    frame->data = data + 2;
+    iter->next = data + frame->length + 2;
+    return 1;
+}
+
+
 void uat_decode_uplink_mdb(uint8_t *frame, struct uat_uplink_mdb *mdb)
 {
     mdb->position_valid = (frame[5] & 0x01) ? 1 : 0;
@@ -586,112 +1200,121 @@ void uat_decode_uplink_mdb(uint8_t *frame, struct uat_uplink_mdb *mdb)
     mdb->tisb_site_id = (frame[7] >> 4);
 
     if (mdb->app_data_valid) {
-        uint8_t *data, *end;
+        struct uat_uplink_iter iter;
 
         memcpy(mdb->app_data, frame+8, 424);
         mdb->num_info_frames = 0;
-        
-        data = mdb->app_data;
-        end = mdb->app_data + 424;
-        while (mdb->num_info_frames < UPLINK_MAX_INFO_FRAMES && data+2 <= end) {
-            struct uat_uplink_info_frame *frame = &mdb->info_frames[mdb->num_info_frames];
-            frame->length = (data[0] << 1) | (data[1] >> 7);
-            frame->type = (data[1] & 0x0f);
-            if (data + frame->length + 2 > end) {
-                // overrun?
-                break;
-            }
-
-            if (frame->length == 0 && frame->type == 0) {
-                break; // no more frames
-            }
 
-            frame->data = data + 2;
+        // walk the copy, so the info frames stay valid with the mdb
+        iter.next = mdb->app_data;
+        iter.end = mdb->app_data + 424;
+        while (mdb->num_info_frames < UPLINK_MAX_INFO_FRAMES) {
+            struct uat_uplink_info_frame *info = &mdb->info_frames[mdb->num_info_frames];
 
-            uat_decode_info_frame(frame);
+            if (!uat_uplink_next_info_frame(&iter, info))
+                break;
 
-            data += frame->length + 2;
+            info->is_fisb = uat_decode_fisb_apdu(info, &info->fisb);
             ++mdb->num_info_frames;
         }
     }
 }
 
-static void display_generic_data(uint8_t *data, uint16_t length, FILE *to)
+static void format_generic_data(const uint8_t *data, uint16_t length, struct uat_text *text)
 {
+    static const char hex_digits[] = "0123456789ABCDEF";
     unsigned i;
 
-    fprintf(to,
-            " Data:              ");
+    put_lit(text, " Data:              ");
     for (i = 0; i < length; i += 16) {
         unsigned j;
-        
+
         if (i > 0)
-            fprintf(to,
-                    "                    ");
-        
+            put_lit(text, "                    ");
+
         for (j = i; j < i+16; ++j) {
-            if (j < length)
-                fprintf(to, "%02X ", data[j]);
-            else
-                fprintf(to, "   ");
-        }
-        
-        for (j = i; j < i+16 && j < length; ++j) {
-            fprintf(to, "%c", 
-                    (data[j] >= 32 && data[j] < 127) ? data[j] : '.');
+            if (j < length) {
+                put_char(text, hex_digits[data[j] >> 4]);
+                put_char(text, hex_digits[data[j] & 15]);
+                put_char(text, ' ');
+            } else {
+                put_lit(text, "   ");
+            }
         }
-        fprintf(to, "\n");
+
+        for (j = i; j < i+16 && j < length; ++j)
+            put_char(text, (data[j] >= 32 && data[j] < 127) ? data[j] : '.');
+        put_char(text, '\n');
     }
 }
 
 // The odd two-string-literals here is to avoid \0x3ABCDEF being interpreted as a single (very large valued) character
 static const char *dlac_alphabet = "\x03" "ABCDEFGHIJKLMNOPQRSTUVWXYZ\x1A\t\x1E\n| !\"#$%&'()*+,-./0123456789:;<=>?";
 
-static const char *decode_dlac(uint8_t *data, unsigned bytelen)
+#define DLAC_TAB 28
+
+size_t uat_decode_dlac(const uint8_t *data, unsigned bytelen, char *out, size_t outlen)
 {
-    static char buf[1024];
-    uint8_t *end = data + bytelen;
-    char *p = buf;
-    int step = 0;
+    const uint8_t *end = data + bytelen;
+    char *p = out, *limit;
     int tab = 0;
-    
-    while (data < end) {
-        int ch;
 
-        assert(step >= 0 && step <= 3);
-        switch (step) {
-        case 0:
-            ch = data[0] >> 2;
-            ++data;
-            break;
-        case 1:
-            ch = ((data[-1] & 0x03) << 4) | (data[0] >> 4);
-            ++data;
-            break;
-        case 2:
-            ch = ((data[-1] & 0x0f) << 2) | (data[0] >> 6);
-            break;
-        case 3:
-            ch = data[0] & 0x3f;
-            ++data;
-            break;
-        }
+    if (outlen == 0)
+        return 0;
+    limit = out + outlen - 1; // leave room for the NUL
 
-        if (tab) {
-            while (ch > 0)
-                *p++ = ' ', ch--;
-            tab = 0;
-        } else if (ch == 28) { // tab
-            tab = 1;
+    while (data < end) {
+        unsigned ch[4];
+        uint32_t v;
+        int i, n;
+
+        // each 3 bytes hold 4 characters; a partial group at the
+        // end holds as many whole characters as it has bytes
+        if (end - data >= 3) {
+            v = (data[0] << 16) | (data[1] << 8) | data[2];
+            n = 4;
+            data += 3;
         } else {
-            *p++ = dlac_alphabet[ch];
+            v = (data[0] << 16) | (end - data > 1 ? data[1] << 8 : 0);
+            n = end - data;
+            data = end;
         }
 
-        step = (step+1)%4;
+        ch[0] = v >> 18;
+        ch[1] = (v >> 12) & 0x3f;
+        ch[2] = (v >> 6) & 0x3f;
+        ch[3] = v & 0x3f;
+
+        if (n == 4 && !tab && limit - p >= 4 &&
+            ch[0] != DLAC_TAB && ch[1] != DLAC_TAB && ch[2] != DLAC_TAB && ch[3] != DLAC_TAB) {
+            // the usual case: four plain characters
+            p[0] = dlac_alphabet[ch[0]];
+            p[1] = dlac_alphabet[ch[1]];
+            p[2] = dlac_alphabet[ch[2]];
+            p[3] = dlac_alphabet[ch[3]];
+            p += 4;
+            continue;
+        }
+
+        for (i = 0; i < n; ++i) {
+            if (tab) {
+                // the character after a tab is the number of spaces
+                unsigned spaces = ch[i];
+                if (spaces > (size_t) (limit - p))
+                    spaces = limit - p;
+                memset(p, ' ', spaces);
+                p += spaces;
+                tab = 0;
+            } else if (ch[i] == DLAC_TAB) {
+                tab = 1;
+            } else if (p < limit) {
+                *p++ = dlac_alphabet[ch[i]];
+            }
+        }
     }
 
     *p = 0;
-    return buf;
+    return p - out;
 }
     
 static const char *get_fisb_product_name(uint16_t product_id)
@@ -794,36 +1417,60 @@ static const char *get_fisb_product_format(uint16_t product_id)
     }
 }
 
-static void uat_display_fisb_frame(const struct fisb_apdu *apdu, FILE *to)
+static void format_fisb_frame(const struct fisb_apdu *apdu, struct uat_text *text)
 {
-    fprintf(to, 
-            "FIS-B:\n"
-            " Flags:             %s%s%s%s\n"
-            " Product ID:        %u (%s) - %s\n",
-            apdu->a_flag ? "A" : "",
-            apdu->g_flag ? "G" : "",
-            apdu->p_flag ? "P" : "",
-            apdu->s_flag ? "S" : "",
-            apdu->product_id,
-            get_fisb_product_name(apdu->product_id),
-            get_fisb_product_format(apdu->product_id));
-
-    fprintf(to,
+    put_lit(text, "FIS-B:\n"
+            " Flags:             ");
+    if (apdu->a_flag)
+        put_char(text, 'A');
+    if (apdu->g_flag)
+        put_char(text, 'G');
+    if (apdu->p_flag)
+        put_char(text, 'P');
+    if (apdu->s_flag)
+        put_char(text, 'S');
+    put_lit(text, "\n"
+            " Product ID:        ");
+    put_uint(text, apdu->product_id, 0);
+    put_lit(text, " (");
+    put_str(text, get_fisb_product_name(apdu->product_id));
+    put_lit(text, ") - ");
+    put_str(text, get_fisb_product_format(apdu->product_id));
+    put_lit(text, "\n"
             " Product time:      ");
-    if (apdu->monthday_valid)
-        fprintf(to, "%u/%u ", apdu->month, apdu->day);
-    fprintf(to, "%02u:%02u", apdu->hours, apdu->minutes);
-    if (apdu->seconds_valid)
-        fprintf(to, ":%02u", apdu->seconds);
-    fprintf(to, "\n");
+    if (apdu->monthday_valid) {
+        put_uint(text, apdu->month, 0);
+        put_char(text, '/');
+        put_uint(text, apdu->day, 0);
+        put_char(text, ' ');
+    }
+    put_uint(text, apdu->hours, 2);
+    put_char(text, ':');
+    put_uint(text, apdu->minutes, 2);
+    if (apdu->seconds_valid) {
+        put_char(text, ':');
+        put_uint(text, apdu->seconds, 2);
+    }
+    put_char(text, '\n');
+
+    if (apdu->s_flag) {
+        put_lit(text, " Segment:           ");
+        put_uint(text, apdu->apdu_number, 0);
+        put_lit(text, " of ");
+        put_uint(text, apdu->product_file_length, 0);
+        put_lit(text, " (product file ");
+        put_uint(text, apdu->product_file_id, 0);
+        put_lit(text, ")\n");
+    }
 
     switch (apdu->product_id) {
     case 413:
         {
             // Generic text, DLAC
-            const char *text = decode_dlac(apdu->data, apdu->length);
-            const char *report = text;
-            
+            char dlac[1024];
+            const char *report = dlac;
+
+            uat_decode_dlac(apdu->data, apdu->length, dlac, sizeof(dlac));
             while (report) {
                 char report_buf[1024];
                 const char *next_report;
@@ -848,41 +1495,41 @@ static void uat_display_fisb_frame(const struct fisb_apdu *apdu, FILE *to)
                 p = strchr(r, ' ');
                 if (p) {
                     *p = 0;
-                    fprintf(to,
-                            " Report type:       %s\n",
-                            r);
+                    put_lit(text, " Report type:       ");
+                    put_str(text, r);
+                    put_char(text, '\n');
                     r = p+1;
                 }
                 
                 p = strchr(r, ' ');
                 if (p) {
                     *p = 0;
-                    fprintf(to,
-                            " Report location:   %s\n",
-                            r);
+                    put_lit(text, " Report location:   ");
+                    put_str(text, r);
+                    put_char(text, '\n');
                     r = p+1;
                 }
                 
                 p = strchr(r, ' ');
                 if (p) {
                     *p = 0;
-                    fprintf(to,
-                            " Report time:       %s\n",
-                            r);
+                    put_lit(text, " Report time:       ");
+                    put_str(text, r);
+                    put_char(text, '\n');
                     r = p+1;
                 }
                 
-                fprintf(to,
-                        " Text:\n%s\n",
-                        r);
+                put_lit(text, " Text:\n");
+                put_str(text, r);
+                put_char(text, '\n');
             }
         }            
         break;
     default:
-        display_generic_data(apdu->data, apdu->length, to);
+        format_generic_data(apdu->data, apdu->length, text);
         break;
     }                
-}            
+}
 
 static const char *info_frame_type_names[16] = {
     "FIS-B APDU",
@@ -903,47 +1550,430 @@ static const char *info_frame_type_names[16] = {
     "TIS-B/ADS-R Service Status"
 };
 
-static void uat_display_uplink_info_frame(const struct uat_uplink_info_frame *frame, FILE *to)
+static void format_uplink_info_frame(const struct uat_uplink_info_frame *frame, struct uat_text *text)
 {
-    fprintf(to,
-            "INFORMATION FRAME:\n"
-            " Length:            %u bytes\n"
-            " Type:              %u (%s)\n",
-            frame->length,
-            frame->type,
-            info_frame_type_names[frame->type]);
+    put_lit(text, "INFORMATION FRAME:\n"
+            " Length:            ");
+    put_uint(text, frame->length, 0);
+    put_lit(text, " bytes\n"
+            " Type:              ");
+    put_uint(text, frame->type, 0);
+    put_lit(text, " (");
+    put_str(text, info_frame_type_names[frame->type]);
+    put_lit(text, ")\n");
 
     if (frame->length > 0) {
         if (frame->is_fisb)
-            uat_display_fisb_frame(&frame->fisb, to);
+            format_fisb_frame(&frame->fisb, text);
         else {
-            display_generic_data(frame->data, frame->length, to);
+            format_generic_data(frame->data, frame->length, text);
         }
     }
 }
 
-void uat_display_uplink_mdb(const struct uat_uplink_mdb *mdb, FILE *to)
+// More than the longest text of an uplink message: each info frame is
+// either a hex dump of its data, or DLAC text. A tab expands to up to
+// 63 spaces, so the text is bounded by its buffer (1023 characters)
+// rather than by the frame length; but each report in it takes at least
+// two of the 4 characters per 3 bytes (one character and a separator)
+// and adds at most 71 characters of headings
+static size_t uplink_text_bound(const struct uat_uplink_mdb *mdb)
 {
-    fprintf(to, 
-            "UPLINK:\n");
+    size_t bound = 256;
+    unsigned i;
+
+    if (mdb->app_data_valid) {
+        for (i = 0; i < mdb->num_info_frames; ++i) {
+            unsigned length = mdb->info_frames[i].length;
+            size_t hex = 85 * ((length + 15) / 16);
+            size_t dlac = 1024 + 72 * (4 * ((length + 2) / 3) / 2 + 1);
+
+            bound += 512 + (hex > dlac ? hex : dlac);
+        }
+    }
+
+    return bound;
+}
+
+int uat_format_uplink_mdb(const struct uat_uplink_mdb *mdb, struct uat_text *text)
+{
+    if (!uat_text_reserve(text, uplink_text_bound(mdb)))
+        return 0;
+
+    put_lit(text, "UPLINK:\n"
+            " Site Latitude:     ");
+    put_fixed(text, mdb->lat, 4, 1);
+    if (!mdb->position_valid)
+        put_lit(text, " (possibly invalid)");
+    put_lit(text, "\n"
+            " Site Longitude:    ");
+    put_fixed(text, mdb->lon, 4, 1);
+    if (!mdb->position_valid)
+        put_lit(text, " (possibly invalid)");
+    put_lit(text, "\n"
+            " UTC coupled:       ");
+    if (mdb->utc_coupled)
+        put_lit(text, "yes");
+    else
+        put_lit(text, "no");
+    put_lit(text, "\n"
+            " Slot ID:           ");
+    put_uint(text, mdb->slot_id, 0);
+    put_lit(text, "\n"
+            " TIS-B Site ID:     ");
+    put_uint(text, mdb->tisb_site_id, 0);
+    put_char(text, '\n');
 
-    fprintf(to,
-            " Site Latitude:     %+.4f%s\n"
-            " Site Longitude:    %+.4f%s\n",
-            mdb->lat, mdb->position_valid ? "" : " (possibly invalid)",
-            mdb->lon, mdb->position_valid ? "" : " (possibly invalid)");
-            
-    fprintf(to,
-            " UTC coupled:       %s\n"
-            " Slot ID:           %u\n"
-            " TIS-B Site ID:     %u\n",
-            mdb->utc_coupled ? "yes" : "no",
-            mdb->slot_id,
-            mdb->tisb_site_id);
-    
     if (mdb->app_data_valid) {
         unsigned i;
         for (i = 0; i < mdb->num_info_frames; ++i)
-            uat_display_uplink_info_frame(&mdb->info_frames[i], to);
+            format_uplink_info_frame(&mdb->info_frames[i], text);
     }
+
+    return 1;
+}
+
+void uat_display_uplink_mdb(const struct uat_uplink_mdb *mdb, FILE *to)
+{
+    struct uat_text text = UAT_TEXT_INIT;
+
+    if (uat_format_uplink_mdb(mdb, &text))
+        fwrite(text.buf, 1, text.len, to);
+    uat_text_free(&text);
+}
+
+//
+// JSON output
+//
+
+static const char *altitude_type_names[3] = { NULL, "baro", "geo" };
+static const char *airground_state_names[4] = { "subsonic", "supersonic", "ground", "reserved" };
+static const char *track_type_names[4] = { NULL, "track", "mag_heading", "true_heading" };
+static const char *heading_type_names[3] = { NULL, "magnetic", "true" };
+static const char *callsign_type_names[3] = { NULL, "callsign", "squawk" };
+
+static inline void put_bool(struct uat_text *text, int v)
+{
+    if (v)
+        put_lit(text, "true");
+    else
+        put_lit(text, "false");
+}
+
+// A quoted JSON string, escaping quotes, backslashes and control
+// characters; at most 6 bytes of output per byte of 's'
+static void put_json_string(struct uat_text *text, const char *s)
+{
+    static const char hex_digits[] = "0123456789abcdef";
+    const char *run = s;
+
+    put_char(text, '"');
+    for (; *s; ++s) {
+        unsigned char c = *s;
+
+        if (c >= 0x20 && c != '"' && c != '\\')
+            continue;
+
+        put_mem(text, run, s - run);
+        run = s + 1;
+
+        switch (c) {
+        case '"': put_lit(text, "\\\""); break;
+        case '\\': put_lit(text, "\\\\"); break;
+        case '\n': put_lit(text, "\\n"); break;
+        case '\t': put_lit(text, "\\t"); break;
+        default:
+            put_lit(text, "\\u00");
+            put_char(text, hex_digits[c >> 4]);
+            put_char(text, hex_digits[c & 15]);
+            break;
+        }
+    }
+    put_mem(text, run, s - run);
+    put_char(text, '"');
+}
+
+// A quoted string of hex digit pairs
+static void put_json_hex(struct uat_text *text, const uint8_t *data, unsigned length)
+{
+    static const char hex_digits[] = "0123456789ABCDEF";
+    unsigned i;
+
+    put_char(text, '"');
+    for (i = 0; i < length; ++i) {
+        put_char(text, hex_digits[data[i] >> 4]);
+        put_char(text, hex_digits[data[i] & 15]);
+    }
+    put_char(text, '"');
+}
+
+static void json_sv(const struct uat_adsb_mdb *mdb, struct uat_text *text)
+{
+    put_lit(text, ",\"sv\":{\"nic\":");
+    put_uint(text, mdb->nic, 0);
+
+    if (mdb->position_valid) {
+        put_lit(text, ",\"lat\":");
+        put_fixed(text, mdb->lat, 6, 0);
+        put_lit(text, ",\"lon\":");
+        put_fixed(text, mdb->lon, 6, 0);
+    }
+
+    if (mdb->altitude_type != ALT_INVALID) {
+        put_lit(text, ",\"altitude_type\":\"");
+        put_str(text, altitude_type_names[mdb->altitude_type]);
+        put_lit(text, "\",\"altitude\":");
+        put_int(text, mdb->altitude);
+    }
+
+    put_lit(text, ",\"airground_state\":\"");
+    put_str(text, airground_state_names[mdb->airground_state]);
+    put_char(text, '"');
+
+    if (mdb->ns_vel_valid) {
+        put_lit(text, ",\"ns_vel\":");
+        put_int(text, mdb->ns_vel);
+    }
+
+    if (mdb->ew_vel_valid) {
+        put_lit(text, ",\"ew_vel\":");
+        put_int(text, mdb->ew_vel);
+    }
+
+    if (mdb->track_type != TT_INVALID) {
+        put_lit(text, ",\"track_type\":\"");
+        put_str(text, track_type_names[mdb->track_type]);
+        put_lit(text, "\",\"track\":");
+        put_uint(text, mdb->track, 0);
+    }
+
+    if (mdb->speed_valid) {
+        put_lit(text, ",\"speed\":");
+        put_uint(text, mdb->speed, 0);
+    }
+
+    if (mdb->vert_rate_source != ALT_INVALID) {
+        put_lit(text, ",\"vert_rate_source\":\"");
+        put_str(text, altitude_type_names[mdb->vert_rate_source]);
+        put_lit(text, "\",\"vert_rate\":");
+        put_int(text, mdb->vert_rate);
+    }
+
+    if (mdb->dimensions_valid) {
+        put_lit(text, ",\"length\":");
+        put_fixed(text, mdb->length, 1, 0);
+        put_lit(text, ",\"width\":");
+        put_fixed(text, mdb->width, 1, 0);
+        put_lit(text, ",\"position_offset\":");
+        put_bool(text, mdb->position_offset);
+    }
+
+    put_lit(text, ",\"utc_coupled\":");
+    put_bool(text, mdb->utc_coupled);
+    put_lit(text, ",\"tisb_site_id\":");
+    put_uint(text, mdb->tisb_site_id, 0);
+    put_char(text, '}');
+}
+
+static void json_ms(const struct uat_adsb_mdb *mdb, struct uat_text *text)
+{
+    put_lit(text, ",\"ms\":{\"emitter_category\":");
+    put_uint(text, mdb->emitter_category, 0);
+
+    if (mdb->callsign_type != CS_INVALID) {
+        put_lit(text, ",\"callsign_type\":\"");
+        put_str(text, callsign_type_names[mdb->callsign_type]);
+        put_lit(text, "\",\"callsign\":");
+        put_json_string(text, mdb->callsign);
+    }
+
+    put_lit(text, ",\"emergency_status\":");
+    put_uint(text, mdb->emergency_status, 0);
+    put_lit(text, ",\"uat_version\":");
+    put_uint(text, mdb->uat_version, 0);
+    put_lit(text, ",\"sil\":");
+    put_uint(text, mdb->sil, 0);
+    put_lit(text, ",\"transmit_mso\":");
+    put_uint(text, mdb->transmit_mso, 0);
+    put_lit(text, ",\"nac_p\":");
+    put_uint(text, mdb->nac_p, 0);
+    put_lit(text, ",\"nac_v\":");
+    put_uint(text, mdb->nac_v, 0);
+    put_lit(text, ",\"nic_baro\":");
+    put_uint(text, mdb->nic_baro, 0);
+    put_lit(text, ",\"has_cdti\":");
+    put_bool(text, mdb->has_cdti);
+    put_lit(text, ",\"has_acas\":");
+    put_bool(text, mdb->has_acas);
+    put_lit(text, ",\"acas_ra_active\":");
+    put_bool(text, mdb->acas_ra_active);
+    put_lit(text, ",\"ident_active\":");
+    put_bool(text, mdb->ident_active);
+    put_lit(text, ",\"atc_services\":");
+    put_bool(text, mdb->atc_services);
+
+    if (mdb->heading_type != HT_INVALID) {
+        put_lit(text, ",\"heading_type\":\"");
+        put_str(text, heading_type_names[mdb->heading_type]);
+        put_char(text, '"');
+    }
+
+    put_char(text, '}');
+}
+
+static void json_auxsv(const struct uat_adsb_mdb *mdb, struct uat_text *text)
+{
+    put_lit(text, ",\"auxsv\":{");
+    if (mdb->sec_altitude_type != ALT_INVALID) {
+        put_lit(text, "\"sec_altitude_type\":\"");
+        put_str(text, altitude_type_names[mdb->sec_altitude_type]);
+        put_lit(text, "\",\"sec_altitude\":");
+        put_int(text, mdb->sec_altitude);
+    }
+    put_char(text, '}');
+}
+
+// More than the longest JSON of an ADS-B message
+#define ADSB_JSON_BOUND 1024
+
+int uat_format_adsb_json(const struct uat_adsb_mdb *mdb, struct uat_text *text)
+{
+    if (!uat_text_reserve(text, ADSB_JSON_BOUND))
+        return 0;
+
+    put_lit(text, "{\"type\":\"adsb\",\"mdb_type\":");
+    put_uint(text, mdb->mdb_type, 0);
+    put_lit(text, ",\"address_qualifier\":");
+    put_uint(text, mdb->address_qualifier, 0);
+    put_lit(text, ",\"address\":\"");
+    put_hex(text, mdb->address, 6);
+    put_char(text, '"');
+
+    if (mdb->has_sv)
+        json_sv(mdb, text);
+    if (mdb->has_ms)
+        json_ms(mdb, text);
+    if (mdb->has_auxsv)
+        json_auxsv(mdb, text);
+
+    put_char(text, '}');
+    return 1;
+}
+
+static void json_fisb(const struct fisb_apdu *apdu, struct uat_text *text)
+{
+    put_lit(text, ",\"fisb\":{\"a_flag\":");
+    put_bool(text, apdu->a_flag);
+    put_lit(text, ",\"g_flag\":");
+    put_bool(text, apdu->g_flag);
+    put_lit(text, ",\"p_flag\":");
+    put_bool(text, apdu->p_flag);
+    put_lit(text, ",\"s_flag\":");
+    put_bool(text, apdu->s_flag);
+    put_lit(text, ",\"product_id\":");
+    put_uint(text, apdu->product_id, 0);
+
+    if (apdu->monthday_valid) {
+        put_lit(text, ",\"month\":");
+        put_uint(text, apdu->month, 0);
+        put_lit(text, ",\"day\":");
+        put_uint(text, apdu->day, 0);
+    }
+    put_lit(text, ",\"hours\":");
+    put_uint(text, apdu->hours, 0);
+    put_lit(text, ",\"minutes\":");
+    put_uint(text, apdu->minutes, 0);
+    if (apdu->seconds_valid) {
+        put_lit(text, ",\"seconds\":");
+        put_uint(text, apdu->seconds, 0);
+    }
+
+    if (apdu->s_flag) {
+        put_lit(text, ",\"product_file_id\":");
+        put_uint(text, apdu->product_file_id, 0);
+        put_lit(text, ",\"product_file_length\":");
+        put_uint(text, apdu->product_file_length, 0);
+        put_lit(text, ",\"apdu_number\":");
+        put_uint(text, apdu->apdu_number, 0);
+    }
+
+    put_lit(text, ",\"data\":");
+    put_json_hex(text, apdu->data, apdu->length);
+
+    if (apdu->product_id == 413) {
+        // Generic text, DLAC
+        char dlac[1024];
+
+        uat_decode_dlac(apdu->data, apdu->length, dlac, sizeof(dlac));
+        put_lit(text, ",\"text\":");
+        put_json_string(text, dlac);
+    }
+
+    put_char(text, '}');
+}
+
+// More than the longest JSON of an uplink message: each info frame's
+// data as hex, plus up to 1023 characters of DLAC text of at most 6
+// bytes each once escaped
+static size_t uplink_json_bound(const struct uat_uplink_mdb *mdb)
+{
+    size_t bound = 256;
+    unsigned i;
+
+    if (mdb->app_data_valid) {
+        for (i = 0; i < mdb->num_info_frames; ++i)
+            bound += 512 + 2 * mdb->info_frames[i].length + 6 * 1024;
+    }
+
+    return bound;
+}
+
+int uat_format_uplink_json(const struct uat_uplink_mdb *mdb, struct uat_text *text)
+{
+    if (!uat_text_reserve(text, uplink_json_bound(mdb)))
+        return 0;
+
+    put_lit(text, "{\"type\":\"uplink\",\"position_valid\":");
+    put_bool(text, mdb->position_valid);
+    if (mdb->position_valid) {
+        put_lit(text, ",\"lat\":");
+        put_fixed(text, mdb->lat, 6, 0);
+        put_lit(text, ",\"lon\":");
+        put_fixed(text, mdb->lon, 6, 0);
+    }
+    put_lit(text, ",\"utc_coupled\":");
+    put_bool(text, mdb->utc_coupled);
+    put_lit(text, ",\"slot_id\":");
+    put_uint(text, mdb->slot_id, 0);
+    put_lit(text, ",\"tisb_site_id\":");
+    put_uint(text, mdb->tisb_site_id, 0);
+    put_lit(text, ",\"app_data_valid\":");
+    put_bool(text, mdb->app_data_valid);
+
+    if (mdb->app_data_valid) {
+        unsigned i;
+
+        put_lit(text, ",\"info_frames\":[");
+        for (i = 0; i < mdb->num_info_frames; ++i) {
+            const struct uat_uplink_info_frame *frame = &mdb->info_frames[i];
+
+            if (i > 0)
+                put_char(text, ',');
+            put_lit(text, "{\"length\":");
+            put_uint(text, frame->length, 0);
+            put_lit(text, ",\"type\":");
+            put_uint(text, frame->type, 0);
+            if (frame->is_fisb) {
+                json_fisb(&frame->fisb, text);
+            } else {
+                put_lit(text, ",\"data\":");
+                put_json_hex(text, frame->data, frame->length);
+            }
+            put_char(text, '}');
+        }
+        put_char(text, ']');
+    }
+
+    put_char(text, '}');
+    return 1;
 }
@@ -61,6 +61,9 @@ struct uat_adsb_mdb {
     // if position_valid:
     double lat;
     double lon;
+    // instead, if decoded with UAT_DECODE_FIXED: in units of 1e-7 degrees
+    int32_t lat_e7;
+    int32_t lon_e7;
 
     altitude_type_t altitude_type;
     int32_t altitude; // in feet
@@ -128,8 +131,124 @@ struct uat_adsb_mdb {
 //
 
 void uat_decode_adsb_mdb(uint8_t *frame, struct uat_adsb_mdb *mdb);
+
+// Elements of an ADS-B message for uat_decode_adsb_mdb_fields()
+#define UAT_DECODE_HDR          0x01  // type and address (always decoded)
+#define UAT_DECODE_SV_POSITION  0x02  // position, altitude, NIC, air/ground state, UTC/TIS-B bits
+#define UAT_DECODE_SV_VELOCITY  0x04  // velocity, track, speed, vertical rate, air/ground state, dimensions
+#define UAT_DECODE_MS           0x08  // callsign/squawk, emitter category, status and capabilities
+#define UAT_DECODE_AUXSV        0x10  // secondary altitude
+#define UAT_DECODE_ALL          0x1f
+
+// With UAT_DECODE_FIXED, decode SV with integer arithmetic only: the
+// position goes in lat_e7/lon_e7 (lat/lon are left zero), and track
+// and speed, which are identical to the floating-point results, are
+// computed without libm
+#define UAT_DECODE_FIXED        0x20
+
+// As uat_decode_adsb_mdb, but decode only the elements in 'fields'
+// (UAT_DECODE_* ORed together); everything else is left zeroed,
+// including the has_ms / has_auxsv presence bits.
+void uat_decode_adsb_mdb_fields(uint8_t *frame, struct uat_adsb_mdb *mdb, unsigned fields);
 void uat_display_adsb_mdb(const struct uat_adsb_mdb *mdb, FILE *to);
 
+// Text output into a buffer: uat_format_adsb_mdb() and
+// uat_format_uplink_mdb() append exactly the text that the
+// uat_display_*() functions write, growing the buffer as needed, so
+// that the text of many messages can be written out in one go.
+// They return 1, or 0 if the buffer could not be grown.
+struct uat_text {
+    char *buf;
+    size_t len;     // bytes of text in buf
+    size_t size;    // allocated size of buf
+};
+
+#define UAT_TEXT_INIT { NULL, 0, 0 }
+
+int uat_format_adsb_mdb(const struct uat_adsb_mdb *mdb, struct uat_text *text);
+
+// JSON output into the same kind of buffer: one object per message on
+// a single line, with no trailing newline, so that a stream of them is
+// NDJSON. Fields have the names of the uat_adsb_mdb fields and appear
+// only when valid; the SV, MS and AUXSV elements are nested objects
+// ("sv", "ms", "auxsv") present only if the message has them. The
+// address is a hex string and enumerations are short names, e.g.
+//
+//   {"type":"adsb","mdb_type":0,"address_qualifier":0,"address":"A1B2C3",
+//    "sv":{"nic":8,"lat":37.123456,...}}
+//
+// Returns 1, or 0 if the buffer could not be grown.
+int uat_format_adsb_json(const struct uat_adsb_mdb *mdb, struct uat_text *text);
+
+// Make room for at least 'n' more bytes; returns 1, or 0 on failure.
+int uat_text_reserve(struct uat_text *text, size_t n);
+void uat_text_free(struct uat_text *text);
+
+//
+// Decoding many ADS-B messages at once into columns (a structure of
+// arrays), e.g. for analysis of archived traffic. Row i of every
+// column describes the same message.
+//
+
+// bits of the flags column
+#define UAT_COLUMN_HAS_SV          0x01
+#define UAT_COLUMN_HAS_MS          0x02
+#define UAT_COLUMN_HAS_AUXSV       0x04
+#define UAT_COLUMN_POSITION_VALID  0x08
+#define UAT_COLUMN_NS_VEL_VALID    0x10
+#define UAT_COLUMN_EW_VEL_VALID    0x20
+#define UAT_COLUMN_SPEED_VALID     0x40
+
+// Each column holds the same value as the uat_adsb_mdb field of the
+// same name (decoded with UAT_DECODE_FIXED), or zero where that is
+// not valid. Enumerated fields are stored as uint8_t.
+struct uat_adsb_columns {
+    int count;      // rows filled so far
+    int capacity;   // rows allocated
+
+    uint8_t *mdb_type;
+    uint8_t *address_qualifier;
+    uint32_t *address;
+    uint8_t *flags;             // UAT_COLUMN_* bits
+
+    // SV
+    int32_t *lat_e7;            // 1e-7 degrees
+    int32_t *lon_e7;
+    uint8_t *nic;
+    uint8_t *altitude_type;
+    int32_t *altitude;
+    uint8_t *airground_state;
+    int16_t *ns_vel;
+    int16_t *ew_vel;
+    uint8_t *track_type;
+    uint16_t *track;
+    uint16_t *speed;
+    uint8_t *vert_rate_source;
+    int16_t *vert_rate;
+
+    // MS
+    uint8_t *emitter_category;
+    uint8_t *callsign_type;
+    char (*callsign)[9];
+
+    // AUXSV
+    uint8_t *sec_altitude_type;
+    int32_t *sec_altitude;
+};
+
+// Allocate empty columns with room for 'capacity' rows.
+// Returns NULL if out of memory.
+struct uat_adsb_columns *uat_adsb_columns_new(int capacity);
+void uat_adsb_columns_free(struct uat_adsb_columns *cols);
+
+// Decode 'count' downlink messages, stored 'stride' bytes apart from
+// 'frames', into the next rows of 'cols'. 'stride' must be at least
+// LONG_FRAME_DATA_BYTES, with short frames zero-padded, as every
+// message is read in full. Reset cols->count to 0 to start again.
+// Returns the number of rows added, which is less than 'count' if
+// the columns fill up.
+int uat_decode_adsb_columns(const uint8_t *frames, size_t stride, int count, struct uat_adsb_columns *cols);
+
 //
 // UPLINK 
 //
@@ -153,6 +272,12 @@ struct fisb_apdu {
     uint8_t minutes;
     uint8_t seconds; // if seconds_valid
 
+    // if s_flag: this APDU is segment apdu_number (1-based) of the
+    // product_file_length segments of product file product_file_id
+    uint16_t product_file_id;
+    uint16_t product_file_length;
+    uint16_t apdu_number;
+
     uint16_t length;
     uint8_t *data;
 };
@@ -188,5 +313,56 @@ struct uat_uplink_mdb {
 
 void uat_decode_uplink_mdb(uint8_t *frame, struct uat_uplink_mdb *mdb);
 void uat_display_uplink_mdb(const struct uat_uplink_mdb *mdb, FILE *to);
+int uat_format_uplink_mdb(const struct uat_uplink_mdb *mdb, struct uat_text *text);
+
+// As uat_format_adsb_json(), for an uplink message: the site fields
+// ("lat" and "lon" only if position_valid), then "info_frames", an
+// array of {"length","type"} objects each with either the raw "data"
+// as hex or, for FIS-B, a "fisb" object holding the APDU header
+// fields, its "data" and, for DLAC generic text (product 413), the
+// decoded "text".
+int uat_format_uplink_json(const struct uat_uplink_mdb *mdb, struct uat_text *text);
+
+// A lighter alternative to uat_decode_uplink_mdb: walk the info frames
+// of an uplink frame in place, without copying the application data,
+// and decode only the parts that are needed. The info frames point
+// into 'frame', so are valid only as long as it is.
+//
+//   struct uat_uplink_iter iter;
+//   struct uat_uplink_info_frame info;
+//
+//   uat_uplink_iter_init(&iter, frame);
+//   while (uat_uplink_next_info_frame(&iter, &info)) {
+//       if (uat_fisb_product_id(&info) == 63 && uat_decode_fisb_apdu(&info, &info.fisb))
+//           ...
+//   }
+
+struct uat_uplink_iter {
+    uint8_t *next;  // next info frame, or NULL when done
+    uint8_t *end;   // end of the application data
+};
+
+// Start iterating over the info frames of uplink frame 'frame'; there
+// are none unless the frame's app_data_valid bit is set.
+void uat_uplink_iter_init(struct uat_uplink_iter *iter, uint8_t *frame);
+
+// Fill in the length, type and data of the next info frame (but not
+// its FIS-B fields). Returns 1, or 0 if there are no more.
+int uat_uplink_next_info_frame(struct uat_uplink_iter *iter, struct uat_uplink_info_frame *frame);
+
+// Return the product ID of a FIS-B info frame without decoding the
+// rest of its header, or -1 if it is not FIS-B.
+int uat_fisb_product_id(const struct uat_uplink_info_frame *frame);
+
+// Decode the FIS-B APDU header of an info frame into 'fisb'.
+// Returns 1, or 0 if it is not a (valid) FIS-B frame.
+int uat_decode_fisb_apdu(const struct uat_uplink_info_frame *frame, struct fisb_apdu *fisb);
+
+// Decode 'bytelen' bytes of DLAC-encoded text (e.g. the data of a FIS-B
+// text product) to 'out', expanding tabs, and NUL-terminate it.
+// At most outlen-1 characters are written; the rest are dropped.
+// Returns the number of characters written. Safe to call from
+// several threads at once.
+size_t uat_decode_dlac(const uint8_t *data, unsigned bytelen, char *out, size_t outlen);
 
 #endif